@@ -6,54 +6,67 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <pthread.h>
-#include <sys/epoll.h>
+#include <signal.h>
 #include "./cache/cache.h"
+#include "./cache/freshness.h"
+#include "./cache/disk_tier.h"
+#include "./cache/coalesce.h"
 #include "./load_balancer/load_balancer.h"
 #include "./health_check/health_check.h"
+#include "./reactor/reactor.h"
+#include "./upstream/upstream_pool.h"
+#include "./upstream/retry_policy.h"
 
-#define MAX_BUFFER_SIZE 655036
-#define MAX_EVENTS 100
-#define THREAD_POOL_SIZE 8 // 스레드 풀 크기
-#define QUEUE_SIZE 10000   // 작업 큐 크기
+#define CONFIG_FILE "reverse_proxy.conf"
 
-// 작업 큐 구조체
-typedef struct
-{
-    int client_sockets[QUEUE_SIZE];
-    int front;
-    int rear;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-} task_queue_t;
-
-httpserver servers[] = {
-    {"10.198.138.212", 12345, 3, 1},
-    {"10.198.138.213", 12345, 10, 1}};
-
-int server_count = 2;
-
-// 전역 작업 큐 선언
-task_queue_t task_queue = {
-    .front = 0,
-    .rear = 0,
-    .mutex = PTHREAD_MUTEX_INITIALIZER,
-    .cond = PTHREAD_COND_INITIALIZER
-};
-
-// 함수 프로토타입
-void *worker_thread(void *arg);
-void enqueue_task(int client_sock);
-int dequeue_task();
-
-void *handle_request(void *client_sock_ptr);
-void send_response(int client_sock, const char *response_header, const char *response_body, int is_head, int response_size);
-
-// 전역 변수로 설정 값 선언
+// 전역 변수로 설정 값 선언 (백엔드 목록은 load_backends 가 따로 읽음)
 int PROXY_PORT;
-char TARGET_SERVER1[256];
-char TARGET_SERVER2[256];
-int TARGET_PORT;
 int CACHE_ENABLED;
+int LOAD_BALANCER_MODE = LB_WEIGHTED_ROUND_ROBIN; // 0: round robin, 1: weighted round robin, 2: least connection, 3: power of two choices, 4: peak EWMA, 5: consistent hash
+long LB_EWMA_DECAY_MS = 10000;     // peak EWMA 가 옛 지연 측정값을 잊는 시간 상수(ms)
+char LB_HASH_KEY[64] = "url";      // consistent hash 키: url, path(쿼리 제외), 또는 요청 헤더 이름
+int LB_HASH_VNODES = LB_DEFAULT_HASH_VNODES; // consistent hash 링에서 가중치 1 당 가상 노드 수
+int LB_BREAKER_FAILURES = 5;        // 이만큼 연달아 실패하면 백엔드 차단 (0 이면 사용 안 함)
+int LB_BREAKER_ERROR_PERCENT = 50;  // window 안의 오류율이 이 이상이면 차단 (0 이면 사용 안 함)
+int LB_BREAKER_MIN_REQUESTS = 20;   // 오류율을 따지기 위한 window 안의 최소 요청 수
+long LB_BREAKER_WINDOW_MS = 10000;  // 오류율을 세는 구간(ms)
+long LB_BREAKER_OPEN_MS = 1000;     // 처음 차단 시간(ms), 시험 요청이 실패할 때마다 두 배
+long LB_BREAKER_MAX_OPEN_MS = 60000; // 차단 시간 상한(ms)
+long LB_SLOW_START_MS = 30000;      // 되살아난 백엔드가 몫을 다 받기까지의 시간(ms), 0 이면 바로
+int LB_SLOW_START_MIN_PERCENT = 10; // slow start 를 시작하는 몫(%)
+int LB_SLOW_START_EXPONENTIAL = 0;  // 몫을 늘리는 방식 (linear, exponential)
+long CACHE_MAX_BYTES = 64L * 1024 * 1024;     // 캐시 전체 바이트 예산
+long CACHE_MAX_OBJECT_SIZE = 1024L * 1024;    // 캐시할 응답 하나의 최대 크기 (헤더 포함)
+int CACHE_SHARDS = CACHE_DEFAULT_SHARDS;      // 캐시 락 분할 수
+int CACHE_ADMISSION = CACHE_ADMISSION_TINYLFU; // 새 항목 입장 방식 (lru, tinylfu)
+long CACHE_DEFAULT_TTL = 60;                  // Cache-Control/Expires 가 없는 응답의 유효 시간 상한(초)
+long CACHE_STALE_WHILE_REVALIDATE = 10;       // 만료 뒤 바로 응답하고 뒤에서 갱신하는 기간(초), 응답에 지시자가 없을 때
+long CACHE_STALE_IF_ERROR = 300;              // 백엔드 오류 때 만료 항목으로 응답하는 기간(초), 응답에 지시자가 없을 때
+char CACHE_DISK_PATH[256];                    // 비어 있지 않으면 RAM 에서 밀려난 항목을 이 파일에 보관
+long CACHE_DISK_BYTES = 256L * 1024 * 1024;   // 디스크 계층 파일 크기
+int COALESCE_ENABLED = 1;          // 같은 URL 의 동시 캐시 미스는 하나만 백엔드로 보내고 나머지는 그 본문을 함께 받음
+int COALESCE_TIMEOUT_MS = 5000;    // 리더의 응답 헤더를 기다리다 포기하고 직접 백엔드로 가는 시간(ms)
+long COALESCE_UNCACHEABLE_MS = 1000; // 캐시할 수 없는 응답을 받은 URL 을 합치지 않고 바로 백엔드로 보내는 시간(ms)
+int KEEPALIVE_TIMEOUT = 5;         // 요청 사이 클라이언트 연결 유휴 허용 시간(초)
+int KEEPALIVE_MAX_REQUESTS = 100;  // 클라이언트 연결 하나가 처리할 최대 요청 수
+int SPLICE_ENABLED = 1;            // 캐시하지 않는 응답 본문을 splice 로 중계
+int UPSTREAM_MAX_IDLE = 32;        // reactor 당 백엔드별 유휴 연결 최대 수
+int UPSTREAM_MAX_CONNS = 256;      // reactor 당 백엔드별 연결 최대 수 (유휴 + 사용 중)
+int UPSTREAM_IDLE_TIMEOUT = 30;    // 유휴 백엔드 연결 유지 시간(초)
+long HEALTH_CHECK_INTERVAL_MS = 5000; // 백엔드마다 능동 검사 간격(ms)
+int HEALTH_CHECK_JITTER_PERCENT = 10;  // 검사 간격을 이 비율만큼 무작위로 흩뜨림
+long HEALTH_CHECK_TIMEOUT_MS = 2000;  // 검사 하나의 제한 시간(ms)
+int HEALTH_CHECK_RISE = 2;            // 비정상 백엔드를 되살리는 연속 성공 수
+int HEALTH_CHECK_FALL = 3;            // 정상 백엔드를 빼는 연속 실패 수
+char HEALTH_CHECK_PATH[256];          // 비어 있으면 TCP 연결만, 있으면 이 경로로 HTTP GET
+int HEALTH_CHECK_EXPECT_STATUS = 0;   // HTTP 검사의 기대 상태 코드, 0 이면 2xx/3xx
+int UPSTREAM_RETRIES = 1;          // 연결 실패나 첫 바이트 전 끊김 때 다른 백엔드로 다시 보내는 횟수 (hedge 는 세지 않음)
+int RETRY_BUDGET_PERCENT = 20;     // 재시도와 hedge 는 요청 수의 이 비율까지
+int RETRY_BUDGET_MIN_PER_SEC = 10; // 요청이 적을 때도 초마다 허용하는 재시도 수
+int HEDGE_ENABLED = 0;             // 첫 바이트가 늦으면 다른 백엔드로도 보내고 먼저 온 응답을 씀
+int HEDGE_PERCENTILE = 95;         // 첫 바이트 지연 분포의 이 percentile 을 넘으면 hedge
+long HEDGE_MIN_DELAY_MS = 10;      // hedge 지연 하한(ms)
+int REACTOR_COUNT = 1; // 1 이면 메인 스레드 하나의 reactor, N 이면 코어별 reactor N 개
 
 // 설정 파일에서 값을 읽어오는 함수
 void load_config(const char *config_file)
@@ -75,58 +88,312 @@ void load_config(const char *config_file)
             {
                 PROXY_PORT = atoi(value);
             }
-            else if (strcmp(key, "TARGET_SERVER1") == 0)
+            else if (strcmp(key, "CACHE_ENABLED") == 0)
             {
-                strncpy(TARGET_SERVER1, value, sizeof(TARGET_SERVER1) - 1);
-                TARGET_SERVER1[sizeof(TARGET_SERVER1) - 1] = '\0';
+                CACHE_ENABLED = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) ? 1 : 0;
             }
-            else if (strcmp(key, "TARGET_SERVER2") == 0)
+            else if (strcmp(key, "LOAD_BALANCER_MODE") == 0)
             {
-                strncpy(TARGET_SERVER2, value, sizeof(TARGET_SERVER2) - 1);
-                TARGET_SERVER2[sizeof(TARGET_SERVER2) - 1] = '\0';
+                LOAD_BALANCER_MODE = atoi(value);
             }
-            else if (strcmp(key, "TARGET_PORT") == 0)
+            else if (strcmp(key, "LB_EWMA_DECAY_MS") == 0)
             {
-                TARGET_PORT = atoi(value);
+                LB_EWMA_DECAY_MS = atol(value);
             }
-            else if (strcmp(key, "CACHE_ENABLED") == 0)
+            else if (strcmp(key, "LB_HASH_KEY") == 0)
             {
-                CACHE_ENABLED = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) ? 1 : 0;
+                strncpy(LB_HASH_KEY, value, sizeof(LB_HASH_KEY) - 1);
+                LB_HASH_KEY[sizeof(LB_HASH_KEY) - 1] = '\0';
+            }
+            else if (strcmp(key, "LB_HASH_VNODES") == 0)
+            {
+                LB_HASH_VNODES = atoi(value);
+            }
+            else if (strcmp(key, "LB_SLOW_START_MS") == 0)
+            {
+                LB_SLOW_START_MS = atol(value);
+            }
+            else if (strcmp(key, "LB_SLOW_START_MIN_PERCENT") == 0)
+            {
+                LB_SLOW_START_MIN_PERCENT = atoi(value);
+            }
+            else if (strcmp(key, "LB_SLOW_START_CURVE") == 0)
+            {
+                LB_SLOW_START_EXPONENTIAL = strcmp(value, "exponential") == 0;
+            }
+            else if (strcmp(key, "HEALTH_CHECK_INTERVAL_MS") == 0)
+            {
+                HEALTH_CHECK_INTERVAL_MS = atol(value);
+            }
+            else if (strcmp(key, "HEALTH_CHECK_JITTER_PERCENT") == 0)
+            {
+                HEALTH_CHECK_JITTER_PERCENT = atoi(value);
+            }
+            else if (strcmp(key, "HEALTH_CHECK_TIMEOUT_MS") == 0)
+            {
+                HEALTH_CHECK_TIMEOUT_MS = atol(value);
+            }
+            else if (strcmp(key, "HEALTH_CHECK_RISE") == 0)
+            {
+                HEALTH_CHECK_RISE = atoi(value);
+            }
+            else if (strcmp(key, "HEALTH_CHECK_FALL") == 0)
+            {
+                HEALTH_CHECK_FALL = atoi(value);
+            }
+            else if (strcmp(key, "HEALTH_CHECK_PATH") == 0)
+            {
+                strncpy(HEALTH_CHECK_PATH, value, sizeof(HEALTH_CHECK_PATH) - 1);
+                HEALTH_CHECK_PATH[sizeof(HEALTH_CHECK_PATH) - 1] = '\0';
+            }
+            else if (strcmp(key, "HEALTH_CHECK_EXPECT_STATUS") == 0)
+            {
+                HEALTH_CHECK_EXPECT_STATUS = atoi(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_FAILURES") == 0)
+            {
+                LB_BREAKER_FAILURES = atoi(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_ERROR_PERCENT") == 0)
+            {
+                LB_BREAKER_ERROR_PERCENT = atoi(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_MIN_REQUESTS") == 0)
+            {
+                LB_BREAKER_MIN_REQUESTS = atoi(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_WINDOW_MS") == 0)
+            {
+                LB_BREAKER_WINDOW_MS = atol(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_OPEN_MS") == 0)
+            {
+                LB_BREAKER_OPEN_MS = atol(value);
+            }
+            else if (strcmp(key, "LB_BREAKER_MAX_OPEN_MS") == 0)
+            {
+                LB_BREAKER_MAX_OPEN_MS = atol(value);
+            }
+            else if (strcmp(key, "CACHE_MAX_BYTES") == 0)
+            {
+                CACHE_MAX_BYTES = atol(value);
+            }
+            else if (strcmp(key, "CACHE_MAX_OBJECT_SIZE") == 0)
+            {
+                CACHE_MAX_OBJECT_SIZE = atol(value);
+            }
+            else if (strcmp(key, "CACHE_SHARDS") == 0)
+            {
+                CACHE_SHARDS = atoi(value);
+            }
+            else if (strcmp(key, "CACHE_ADMISSION") == 0)
+            {
+                CACHE_ADMISSION = strcmp(value, "lru") == 0 ? CACHE_ADMISSION_LRU : CACHE_ADMISSION_TINYLFU;
+            }
+            else if (strcmp(key, "CACHE_DEFAULT_TTL") == 0)
+            {
+                CACHE_DEFAULT_TTL = atol(value);
+            }
+            else if (strcmp(key, "CACHE_STALE_WHILE_REVALIDATE") == 0)
+            {
+                CACHE_STALE_WHILE_REVALIDATE = atol(value);
+            }
+            else if (strcmp(key, "CACHE_STALE_IF_ERROR") == 0)
+            {
+                CACHE_STALE_IF_ERROR = atol(value);
+            }
+            else if (strcmp(key, "CACHE_DISK_PATH") == 0)
+            {
+                strncpy(CACHE_DISK_PATH, value, sizeof(CACHE_DISK_PATH) - 1);
+                CACHE_DISK_PATH[sizeof(CACHE_DISK_PATH) - 1] = '\0';
+            }
+            else if (strcmp(key, "CACHE_DISK_BYTES") == 0)
+            {
+                CACHE_DISK_BYTES = atol(value);
+            }
+            else if (strcmp(key, "COALESCE_ENABLED") == 0)
+            {
+                COALESCE_ENABLED = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) ? 1 : 0;
+            }
+            else if (strcmp(key, "COALESCE_TIMEOUT_MS") == 0)
+            {
+                COALESCE_TIMEOUT_MS = atoi(value);
+            }
+            else if (strcmp(key, "COALESCE_UNCACHEABLE_MS") == 0)
+            {
+                COALESCE_UNCACHEABLE_MS = atol(value);
+            }
+            else if (strcmp(key, "KEEPALIVE_TIMEOUT") == 0)
+            {
+                KEEPALIVE_TIMEOUT = atoi(value);
+            }
+            else if (strcmp(key, "KEEPALIVE_MAX_REQUESTS") == 0)
+            {
+                KEEPALIVE_MAX_REQUESTS = atoi(value);
+            }
+            else if (strcmp(key, "UPSTREAM_RETRIES") == 0)
+            {
+                UPSTREAM_RETRIES = atoi(value);
+            }
+            else if (strcmp(key, "RETRY_BUDGET_PERCENT") == 0)
+            {
+                RETRY_BUDGET_PERCENT = atoi(value);
+            }
+            else if (strcmp(key, "RETRY_BUDGET_MIN_PER_SEC") == 0)
+            {
+                RETRY_BUDGET_MIN_PER_SEC = atoi(value);
+            }
+            else if (strcmp(key, "HEDGE_ENABLED") == 0)
+            {
+                HEDGE_ENABLED = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) ? 1 : 0;
+            }
+            else if (strcmp(key, "HEDGE_PERCENTILE") == 0)
+            {
+                HEDGE_PERCENTILE = atoi(value);
+            }
+            else if (strcmp(key, "HEDGE_MIN_DELAY_MS") == 0)
+            {
+                HEDGE_MIN_DELAY_MS = atol(value);
+            }
+            else if (strcmp(key, "SPLICE_ENABLED") == 0)
+            {
+                SPLICE_ENABLED = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) ? 1 : 0;
+            }
+            else if (strcmp(key, "UPSTREAM_MAX_IDLE") == 0)
+            {
+                UPSTREAM_MAX_IDLE = atoi(value);
+            }
+            else if (strcmp(key, "UPSTREAM_MAX_CONNS") == 0)
+            {
+                UPSTREAM_MAX_CONNS = atoi(value);
+            }
+            else if (strcmp(key, "UPSTREAM_IDLE_TIMEOUT") == 0)
+            {
+                UPSTREAM_IDLE_TIMEOUT = atoi(value);
+            }
+            else if (strcmp(key, "REACTOR_COUNT") == 0)
+            {
+                REACTOR_COUNT = atoi(value);
+                if (REACTOR_COUNT < 1)
+                {
+                    REACTOR_COUNT = 1;
+                }
             }
         }
     }
     fclose(file);
 }
 
-int main()
+// 설정 파일의 BACKEND=ip:port [가중치] 줄을 모두 읽어 개수 반환 (가중치를 빼면 1)
+// 잘못된 줄이나 겹치는 ip:port 가 있으면 -1 (설정을 다시 읽을 때는 지금 목록을 그대로 둠)
+int load_backends(const char *config_file, lb_backend **backends)
 {
-    int server_sock, client_sock, epoll_fd;
-    struct sockaddr_in server_addr;
-    struct epoll_event ev, events[MAX_EVENTS];
+    FILE *file = fopen(config_file, "r");
+    if (!file)
+    {
+        perror("Failed to open config file");
+        return -1;
+    }
 
-    // 설정 파일 읽기
-    load_config("reverse_proxy.conf");
+    lb_backend *list = NULL;
+    int count = 0;
+    int capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        char key[256], value[256];
+        if (sscanf(line, "%255[^=]=%255[^\n]", key, value) != 2 || strcmp(key, "BACKEND") != 0)
+        {
+            continue;
+        }
 
-    init_http_servers(servers, 2);
+        lb_backend backend = {.weight = 1};
+        struct in_addr addr;
+        int duplicate = 0;
+        if (sscanf(value, "%15[^:]:%d %d", backend.ip, &backend.port, &backend.weight) < 2 ||
+            inet_pton(AF_INET, backend.ip, &addr) != 1 || backend.port < 1 || backend.port > 65535 ||
+            backend.weight < 1)
+        {
+            fprintf(stderr, "Invalid BACKEND: %s\n", value);
+            count = -1;
+            break;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            duplicate |= list[i].port == backend.port && strcmp(list[i].ip, backend.ip) == 0;
+        }
+        if (duplicate)
+        {
+            fprintf(stderr, "Duplicate BACKEND: %s\n", value);
+            count = -1;
+            break;
+        }
 
-    // health_check 스레드 생성 및 분리(백그라운드에서 실행되도록)
-    pthread_t health_thread;
-    health_check_args args = {servers, server_count};
-    if (pthread_create(&health_thread, NULL, health_check, &args) != 0)
+        if (count == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 8;
+            lb_backend *grown = realloc(list, capacity * sizeof(lb_backend));
+            if (grown == NULL)
+            {
+                perror("Failed to allocate backends");
+                count = -1;
+                break;
+            }
+            list = grown;
+        }
+        list[count++] = backend;
+    }
+    fclose(file);
+
+    if (count < 0)
     {
-        perror("Failed to create health check thread");
-        exit(EXIT_FAILURE);
+        free(list);
+        return -1;
     }
-    pthread_detach(health_thread);
+    *backends = list;
+    return count;
+}
 
-    // 캐시 초기화
-    if (CACHE_ENABLED)
+// SIGHUP 으로 백엔드 목록을 다시 읽는 스레드. 다른 스레드는 SIGHUP 을 막아 두므로 이 스레드만 받음
+// 목록만 바꿔 끼우므로 진행 중 요청과 캐시는 그대로. 그 밖의 설정은 재시작해야 반영됨
+// 초마다 깨어나 이제 아무도 보지 않는 옛 목록과 빠진 서버를 해제
+void *reload_backends(void *arg)
+{
+    sigset_t *signals = (sigset_t *)arg;
+    while (1)
     {
-        cache_init();
+        struct timespec tick = {1, 0};
+        if (sigtimedwait(signals, NULL, &tick) == SIGHUP)
+        {
+            lb_backend *backends = NULL;
+            int count = load_backends(CONFIG_FILE, &backends);
+            if (count > 0)
+            {
+                load_balancer_update(backends, count);
+            }
+            else
+            {
+                fprintf(stderr, "Reload failed, keeping current backends\n");
+            }
+            free(backends);
+        }
+        load_balancer_reclaim();
     }
+    return NULL;
+}
 
+// SIGUSR1: 다음 reactor 틱에서 통계 출력
+void request_stats(int signo)
+{
+    (void)signo;
+    reactor_stats_requested++;
+}
+
+// 프록시 포트에 listen 소켓 생성
+int create_listen_socket(int reuse_port)
+{
     // 서버 소켓 생성
-    server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (server_sock < 0)
     {
         perror("Socket creation failed");
@@ -142,6 +409,15 @@ int main()
         exit(EXIT_FAILURE);
     }
 
+    // reactor 마다 같은 포트에 자기 listen 소켓을 열고 커널이 연결을 분산
+    if (reuse_port && setsockopt(server_sock, SOL_SOCKET, SO_REUSEPORT, &optvalue, sizeof(optvalue)) < 0)
+    {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(server_sock);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -156,351 +432,145 @@ int main()
     }
 
     // 서버 리슨
-    if (listen(server_sock, 5) < 0)
+    if (listen(server_sock, SOMAXCONN) < 0)
     {
         perror("Listen failed");
         close(server_sock);
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d...\n", PROXY_PORT);
+    return server_sock;
+}
 
-    // epoll 생성
-    epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1)
+int main()
+{
+    // 설정 파일 읽기
+    load_config(CONFIG_FILE);
+
+    lb_backend *backends = NULL;
+    int backend_count = load_backends(CONFIG_FILE, &backends);
+    if (backend_count <= 0 || load_balancer_update(backends, backend_count) < 0)
     {
-        perror("epoll_create1 failed");
-        close(server_sock);
+        fprintf(stderr, "No valid BACKEND in %s\n", CONFIG_FILE);
         exit(EXIT_FAILURE);
     }
+    free(backends);
+    load_balancer_set_mode(LOAD_BALANCER_MODE);
+    load_balancer_set_ewma_decay(LB_EWMA_DECAY_MS);
+    load_balancer_set_hash_vnodes(LB_HASH_VNODES);
+    lb_breaker_config breaker = {LB_BREAKER_FAILURES, LB_BREAKER_ERROR_PERCENT, LB_BREAKER_MIN_REQUESTS,
+                                 LB_BREAKER_WINDOW_MS, LB_BREAKER_OPEN_MS, LB_BREAKER_MAX_OPEN_MS};
+    load_balancer_set_breaker(&breaker);
+    load_balancer_set_slow_start(LB_SLOW_START_MS, LB_SLOW_START_MIN_PERCENT, LB_SLOW_START_EXPONENTIAL);
+
+    // SIGHUP 은 설정을 다시 읽는 스레드만 받도록, 이후에 만드는 모든 스레드에서 막아 둠
+    static sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
 
-    // 서버 소켓을 epoll에 등록
-    ev.events = EPOLLIN;
-    ev.data.fd = server_sock;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_sock, &ev) == -1)
+    // health_check 스레드 생성 및 분리(백그라운드에서 실행되도록)
+    pthread_t health_thread;
+    health_check_args args = {HEALTH_CHECK_INTERVAL_MS, HEALTH_CHECK_JITTER_PERCENT,
+                              HEALTH_CHECK_TIMEOUT_MS, HEALTH_CHECK_RISE, HEALTH_CHECK_FALL,
+                              HEALTH_CHECK_PATH, HEALTH_CHECK_EXPECT_STATUS};
+    if (pthread_create(&health_thread, NULL, health_check, &args) != 0)
     {
-        perror("epoll_ctl failed");
-        close(server_sock);
-        close(epoll_fd);
+        perror("Failed to create health check thread");
         exit(EXIT_FAILURE);
     }
+    pthread_detach(health_thread);
 
-    // 스레드 풀 초기화
-    pthread_t threads[THREAD_POOL_SIZE];
-    for (int i = 0; i < THREAD_POOL_SIZE; i++)
+    pthread_t reload_thread;
+    if (pthread_create(&reload_thread, NULL, reload_backends, &reload_signals) != 0)
     {
-        if (pthread_create(&threads[i], NULL, worker_thread, NULL) != 0)
-        {
-            perror("Thread creation failed");
-            close(server_sock);
-            close(epoll_fd);
-            exit(EXIT_FAILURE);
-        }
+        perror("Failed to create reload thread");
+        exit(EXIT_FAILURE);
     }
+    pthread_detach(reload_thread);
 
-    while (1)
+    // 캐시 초기화
+    if (CACHE_ENABLED && cache_init(CACHE_MAX_BYTES, CACHE_MAX_OBJECT_SIZE, CACHE_SHARDS, CACHE_ADMISSION) < 0)
     {
-        // 이벤트 대기
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, 5000);
-        if (nfds == -1)
-        {
-            perror("epoll_wait failed");
-            break;
-        }
-
-        for (int i = 0; i < nfds; i++)
-        {
-            if (events[i].data.fd == server_sock)
-            {
-                // 새로운 클라이언트 연결 수락
-                client_sock = accept(server_sock, NULL, NULL);
-                if (client_sock == -1)
-                {
-                    perror("Accept failed");
-                    continue;
-                }
-
-                // 작업 큐에 클라이언트 소켓 추가
-                enqueue_task(client_sock);
-            }
-        }
+        exit(EXIT_FAILURE);
     }
+    freshness_configure(CACHE_DEFAULT_TTL, CACHE_STALE_WHILE_REVALIDATE, CACHE_STALE_IF_ERROR);
+    coalesce_configure(COALESCE_UNCACHEABLE_MS);
 
-    close(server_sock);
-    close(epoll_fd);
-    return 0;
-}
-
-// 작업 큐에 작업 추가
-void enqueue_task(int client_sock)
-{
-    pthread_mutex_lock(&task_queue.mutex);
-
-    if ((task_queue.rear + 1) % QUEUE_SIZE == task_queue.front)
-    {
-        fprintf(stderr, "Task queue is full, dropping connection.\n");
-        close(client_sock);
-    }
-    else
+    // 디스크 계층은 매핑만 하고 읽지 않으므로 재시작 직후부터 이전 항목으로 응답 가능. 실패하면 RAM 만 사용
+    if (CACHE_ENABLED && CACHE_DISK_PATH[0] != '\0')
     {
-        task_queue.client_sockets[task_queue.rear] = client_sock;
-        task_queue.rear = (task_queue.rear + 1) % QUEUE_SIZE;
-        pthread_cond_signal(&task_queue.cond);
+        disk_tier_open(CACHE_DISK_PATH, CACHE_DISK_BYTES);
     }
 
-    pthread_mutex_unlock(&task_queue.mutex);
-}
+    // 백엔드별 upstream 연결 풀 설정 (풀 자체는 reactor 마다 생성)
+    upstream_pool_configure(UPSTREAM_MAX_IDLE, UPSTREAM_MAX_CONNS, UPSTREAM_IDLE_TIMEOUT);
+    retry_budget_configure(RETRY_BUDGET_PERCENT, RETRY_BUDGET_MIN_PER_SEC);
+    hedge_configure(HEDGE_PERCENTILE, HEDGE_MIN_DELAY_MS);
 
-// 작업 큐에서 작업 제거
-int dequeue_task()
-{
-    pthread_mutex_lock(&task_queue.mutex);
+    // 끊긴 클라이언트에 write 해도 프로세스가 종료되지 않도록
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, request_stats);
 
-    while (task_queue.front == task_queue.rear)
+    if (REACTOR_COUNT == 1)
     {
-        pthread_cond_wait(&task_queue.cond, &task_queue.mutex);
-    }
+        // 모든 연결을 하나의 epoll 루프에서 상태 머신으로 처리
+        reactor main_reactor;
+        int server_sock = create_listen_socket(0);
+        printf("Server listening on port %d...\n", PROXY_PORT);
 
-    int client_sock = task_queue.client_sockets[task_queue.front];
-    task_queue.front = (task_queue.front + 1) % QUEUE_SIZE;
-
-    pthread_mutex_unlock(&task_queue.mutex);
-    return client_sock;
-}
-
-// 워커 스레드
-void *worker_thread(void *arg)
-{
-    while (1)
-    {
-        int client_sock = dequeue_task();
-        handle_request(&client_sock);
-        close(client_sock);
-    }
-    return NULL;
-}
+        if (reactor_init(&main_reactor, server_sock) < 0)
+        {
+            close(server_sock);
+            exit(EXIT_FAILURE);
+        }
+        main_reactor.cpu = -1;
+        reactor_run(&main_reactor);
 
-void *handle_request(void *client_sock_ptr)
-{
-    int client_sock = *(int *)client_sock_ptr;
-    int server_sock;
-    struct sockaddr_in target_addr;
-    char buffer[MAX_BUFFER_SIZE] = {0};
-    char method[10] = {0};
-    char url[256] = {0};
-    char protocol[10] = {0};
-
-    ssize_t bytes_read = read(client_sock, buffer, sizeof(buffer));
-    if (bytes_read <= 0)
-    {
-        perror("Failed to read client request");
-        close(client_sock);
-        return NULL;
+        close(server_sock);
+        close(main_reactor.epoll_fd);
+        return 0;
     }
 
-    // 디버깅: 수신된 요청 출력
-    printf("Request content:\n%.*s\n", (int)bytes_read, buffer);
-
-    // GET, HEAD 메서드 및 URL, 프로토콜 추출
-    if (sscanf(buffer, "%s %s %s", method, url, protocol) != 3)
+    // 멀티 reactor 모드: 코어마다 listen 소켓, epoll, 연결 집합을 따로 가진 스레드
+    reactor *reactors = calloc(REACTOR_COUNT, sizeof(reactor));
+    pthread_t *threads = calloc(REACTOR_COUNT, sizeof(pthread_t));
+    if (reactors == NULL || threads == NULL)
     {
-        fprintf(stderr, "Failed to parse the request line properly\n");
-        close(client_sock);
-        return NULL;
+        perror("Failed to allocate reactors");
+        exit(EXIT_FAILURE);
     }
 
-    httpserver server = weighted_round_robin(); // 로드밸런서 호출
-    printf("Forwarding to server: %s:%d\n", server.ip, server.port);
-
-    // 디버깅: 파싱된 결과 출력
-    printf("Parsed method: %s, URL: %s, Protocol: %s\n", method, url, protocol);
-
-    // URL 유효성 검사
-    if ((strcmp(method, "GET") != 0) && (strcmp(method, "HEAD") != 0))
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1)
     {
-        fprintf(stderr, "Invalid request method: %s\n", method);
-        close(client_sock);
-        return NULL;
+        cpu_count = 1;
     }
 
-    char cached_data[MAX_BUFFER_SIZE] = {0};
-    int header_size = 0;
-    char header_buffer[MAX_BUFFER_SIZE] = {0};
-    int newline_count = 0;
-    int max_newline = 4;
-
-    if (CACHE_ENABLED && cache_lookup(url, cached_data))
-    {
-        // 캐시 히트 메시지 출력
-        printf("Cache hit for URL: %s\n\n\n", url);
-
-        if (strstr(cached_data, "Transfer-Encoding: chunked") != NULL)
-        {
-            max_newline = 5; // chunked가 있으면 \n 5개까지 찾기
-            printf("this is chuncked\n");
-        }
-
-        for (int i = 0; i < sizeof(cached_data); i++)
-        {
-            header_size++;
-            if (cached_data[i] == '\n')
-            {
-                newline_count++;
-                if (newline_count == max_newline)
-                {
-                    break;
-                }
-            }
-        }
-        // 헤더와 본문을 분리
-        memcpy(header_buffer, cached_data, header_size);
-
-        send_response(client_sock, header_buffer, cached_data, strcmp(method, "HEAD") == 0, strlen(cached_data));
-    }
-    else
+    for (int i = 0; i < REACTOR_COUNT; i++)
     {
-        // 캐시 미스 처리
-        printf("Cache miss for URL: %s\n\n\n", url);
-
-        // 백엔드 서버와 연결
-        server_sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_sock < 0)
+        int server_sock = create_listen_socket(1);
+        if (reactor_init(&reactors[i], server_sock) < 0)
         {
-            perror("Socket creation failed");
-            close(client_sock);
-            return;
+            exit(EXIT_FAILURE);
         }
+        reactors[i].id = i;
+        reactors[i].cpu = i % cpu_count;
 
-        memset(&target_addr, 0, sizeof(target_addr));
-        target_addr.sin_family = AF_INET;
-        target_addr.sin_port = htons(server.port);
-        inet_pton(AF_INET, server.ip, &target_addr.sin_addr);
-
-        if (connect(server_sock, (struct sockaddr *)&target_addr, sizeof(target_addr)) < 0)
-        {
-            perror("Connection failed");
-            close(client_sock);
-            close(server_sock);
-            return;
-        }
-        // 요청 전달
-        if (write(server_sock, buffer, bytes_read) < 0)
+        if (pthread_create(&threads[i], NULL, reactor_thread, &reactors[i]) != 0)
         {
-            perror("Failed to forward request");
-            close(client_sock);
-            close(server_sock);
-            return;
-        }
-        // 응답 수신 및 스트리밍 방식으로 클라이언트로 전달
-        ssize_t bytes_received;
-        char response_buffer[MAX_BUFFER_SIZE] = {0};
-        int response_size = 0;
-        if (strstr(url, "/jpg") != NULL)
-        {
-            size_t chunk_size;
-            while (1)
-            {
-                // 청크 헤더 읽기 (청크 크기)
-                bytes_received = read(server_sock, buffer, MAX_BUFFER_SIZE);
-                if (bytes_received <= 0)
-                {
-                    if (bytes_received == 0)
-                    {
-                        printf("Connection closed by server.\n");
-                    }
-                    else
-                    {
-                        perror("Read failed");
-                    }
-                    break;
-                }
-                buffer[bytes_received] = '\0';
-
-                // 청크 크기 파싱
-                sscanf(buffer, "%zx", &chunk_size);
-                if (chunk_size == 0)
-                {
-                    printf("End of chunked transfer.\n");
-                    break;
-                }
-
-                // 청크 데이터 읽기
-                char *data_start = strstr(buffer, "\r\n") + 2; // 청크 헤더 이후 데이터 시작
-                fwrite(data_start, 1, chunk_size, stdout);
-
-                // 다음 청크로 이동
-            }
-        }
-        else
-        {
-            while ((bytes_received = read(server_sock, response_buffer + response_size, sizeof(response_buffer) - response_size)) > 0)
-            {
-                response_size += bytes_received;
-            }
-
-            if (strstr(response_buffer, "Transfer-Encoding: chunked") != NULL)
-            {
-                max_newline = 5; // chunked가 있으면 \n 5개까지 찾기
-                printf("this is chuncked\n");
-            }
-
-            for (int i = 0; i < sizeof(response_buffer); i++)
-            {
-                header_size++;
-                if (response_buffer[i] == '\n')
-                {
-                    newline_count++;
-                    if (newline_count == max_newline)
-                    {
-                        break;
-                    }
-                }
-            }
-
-            // 헤더와 본문을 분리
-            memcpy(header_buffer, response_buffer, header_size);
-
-            if (bytes_received < 0)
-            {
-                perror("Failed to receive response from backend server");
-            }
-            else
-            {
-                // 캐시에 응답 저장 (응답 크기 검사)
-                if (CACHE_ENABLED)
-                {
-                    printf("Store response for URL: %s into cache\n\n\n", url);
-                    cache_store(url, response_buffer);
-                }
-                // 클라이언트로 응답 전송
-                send_response(client_sock, header_buffer, response_buffer + header_size, strcmp(method, "HEAD") == 0, response_size - header_size);
-            }
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
         }
-        close(server_sock);
     }
-    close(client_sock);
-    return NULL;
-}
+    printf("Server listening on port %d with %d reactors...\n", PROXY_PORT, REACTOR_COUNT);
 
-void send_response(int client_sock, const char *response_header, const char *response_body, int is_head, int response_size)
-{
-    // 응답 헤더의 크기를 계산하여 Content-Length에 설정
-    char header[512];
-    snprintf(header, sizeof(header), response_header, response_size);
-
-    // 헤더 전송
-    if (write(client_sock, header, strlen(header)) < 0)
+    for (int i = 0; i < REACTOR_COUNT; i++)
     {
-        perror("Failed to send header");
-        return;
+        pthread_join(threads[i], NULL);
     }
 
-    // 본문이 있으면 본문 전송
-    if (!is_head)
-    {
-        if (write(client_sock, response_body, response_size) < 0)
-        {
-            perror("Failed to send response body");
-        }
-    }
-}
\ No newline at end of file
+    free(threads);
+    free(reactors);
+    return 0;
+}
@@ -0,0 +1,84 @@
+// 캐시 조회 처리량: 스레드 수별, 샤드 1개(전역 락과 같음)와 기본 샤드 수 비교
+// 사용법: ./bench/cache_bench [스레드당 조회 수] [저장 비율 %]  (기본 1000000, 0)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "../cache/cache.h"
+
+#define KEY_COUNT 20000
+#define VALUE_SIZE 512
+
+static long ops_per_thread;
+static int store_percent;
+static char value[VALUE_SIZE];
+static char keys[KEY_COUNT][48]; // 키 생성 비용이 측정에 섞이지 않도록 미리 만들어 둠
+
+static void *worker(void *arg) {
+    uint64_t x = (uintptr_t)arg * 0x9e3779b97f4a7c15ULL + 1;
+    long found = 0;
+
+    for (long i = 0; i < ops_per_thread; i++) {
+        // xorshift64
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        const char *key = keys[x % KEY_COUNT];
+        if ((int)(x >> 40) % 100 < store_percent) {
+            cache_store(key, "", 0, value, sizeof(value), NULL);
+        } else {
+            cache_entry *e = cache_lookup(key);
+            if (e != NULL) {
+                found++;
+                cache_release(e);
+            }
+        }
+    }
+    return (void *)found;
+}
+
+static void run(int shards, int threads) {
+    if (cache_init(64L * 1024 * 1024, 1024 * 1024, shards, CACHE_ADMISSION_TINYLFU) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < KEY_COUNT; i++) {
+        cache_store(keys[i], "", 0, value, sizeof(value), NULL);
+    }
+
+    pthread_t tids[64];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("shards %2d  threads %2d  %8.2f Mops/s\n", shards, threads, ops_per_thread * threads / elapsed / 1e6);
+    cache_destroy();
+}
+
+int main(int argc, char *argv[]) {
+    ops_per_thread = argc > 1 ? atol(argv[1]) : 1000000;
+    store_percent = argc > 2 ? atoi(argv[2]) : 0;
+    memset(value, 'v', sizeof(value));
+    for (int i = 0; i < KEY_COUNT; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "/static/assets/item-%d.js?v=3", i);
+    }
+
+    printf("%d keys x %d bytes, %ld ops per thread, %d%% stores\n", KEY_COUNT, VALUE_SIZE, ops_per_thread, store_percent);
+    static const int thread_counts[] = {1, 2, 4, 8, 16};
+    static const int shard_counts[] = {1, CACHE_DEFAULT_SHARDS};
+    for (size_t s = 0; s < sizeof(shard_counts) / sizeof(shard_counts[0]); s++) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            run(shard_counts[s], thread_counts[t]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+// consistent hash 조회 비용과 키 이동량
+// 가상 노드 수별로: 조회 한 번의 시간, 서버별 키 비율의 편차, 서버 하나가 빠지거나 늘 때 자리를 옮기는 키 비율
+// 비교 기준으로 건강한 서버 수로 나눈 나머지(hash % N) 방식의 이동량도 출력
+// 사용법: ./bench/hash_bench [키 수] [서버 수]  (기본 200000, 8)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "../load_balancer/load_balancer.h"
+
+#define MAX_SERVERS 10
+
+static httpserver servers[MAX_SERVERS];
+static int server_count;
+static int key_count;
+static char (*keys)[48];
+
+// 키마다 고른 서버 번호
+static void assign(int *out) {
+    for (int i = 0; i < key_count; i++) {
+        httpserver *server = consistent_hash(keys[i], strlen(keys[i]));
+        out[i] = server != NULL ? (int)(server - servers) : -1;
+    }
+}
+
+static int count_moved(const int *before, const int *after) {
+    int moved = 0;
+    for (int i = 0; i < key_count; i++) {
+        moved += before[i] != after[i];
+    }
+    return moved;
+}
+
+// 나머지 방식: 건강한 서버만 순서대로 세어 hash % N 번째
+static void assign_modulo(int *out, int skip) {
+    int healthy = server_count - (skip >= 0);
+    for (int i = 0; i < key_count; i++) {
+        uint64_t h = 14695981039346656037ULL;
+        for (const char *p = keys[i]; *p; p++) {
+            h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+        }
+        int n = (int)(h % healthy);
+        out[i] = n >= skip && skip >= 0 ? n + 1 : n;
+    }
+}
+
+static void run(int vnodes, int *before, int *after) {
+    init_http_servers(servers, server_count);
+    load_balancer_set_hash_vnodes(vnodes);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    assign(before);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / key_count;
+
+    // 서버별 비율의 최대/최소 (모두 가중치 1 이므로 이상적으로는 1/N)
+    int counts[MAX_SERVERS] = {0};
+    for (int i = 0; i < key_count; i++) {
+        counts[before[i]]++;
+    }
+    int min = key_count, max = 0;
+    for (int i = 0; i < server_count; i++) {
+        min = counts[i] < min ? counts[i] : min;
+        max = counts[i] > max ? counts[i] : max;
+    }
+
+    // 서버 하나가 비정상이 되면: 그 서버의 키만 옮겨가야 함
+    int victim = server_count / 2;
+    atomic_store(&servers[victim].is_healthy, 0);
+    assign(after);
+    int moved = count_moved(before, after);
+    int wrongly_moved = 0;
+    for (int i = 0; i < key_count; i++) {
+        wrongly_moved += before[i] != after[i] && before[i] != victim;
+    }
+    atomic_store(&servers[victim].is_healthy, 1);
+
+    // 서버를 하나 늘리면: 새 서버 몫(1/(N+1))만 옮겨가야 함
+    int added = 0;
+    if (server_count < MAX_SERVERS) {
+        init_http_servers(servers, server_count + 1);
+        load_balancer_set_hash_vnodes(vnodes);
+        assign(after);
+        added = count_moved(before, after);
+    }
+
+    printf("vnodes %4d  %6.1f ns/lookup  share min/max %5.2f%%/%5.2f%%  remove one: moved %5.2f%% (other servers %d)  add one: moved %5.2f%%\n",
+           vnodes, ns, 100.0 * min / key_count, 100.0 * max / key_count,
+           100.0 * moved / key_count, wrongly_moved, 100.0 * added / key_count);
+}
+
+int main(int argc, char *argv[]) {
+    key_count = argc > 1 ? atoi(argv[1]) : 200000;
+    server_count = argc > 2 ? atoi(argv[2]) : 8;
+    if (server_count < 2 || server_count > MAX_SERVERS) {
+        fprintf(stderr, "server count must be 2..%d\n", MAX_SERVERS);
+        return EXIT_FAILURE;
+    }
+
+    keys = malloc((size_t)key_count * sizeof(*keys));
+    int *before = malloc(key_count * sizeof(int));
+    int *after = malloc(key_count * sizeof(int));
+    if (keys == NULL || before == NULL || after == NULL) {
+        perror("Failed to allocate keys");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < key_count; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "/static/assets/item-%d.js?v=3", i);
+    }
+    for (int i = 0; i < MAX_SERVERS; i++) {
+        snprintf(servers[i].ip, sizeof(servers[i].ip), "10.0.0.%d", i + 1);
+        servers[i].port = 8080;
+        servers[i].weight = 1;
+    }
+
+    printf("%d keys, %d servers (ideal share %.2f%%)\n", key_count, server_count, 100.0 / server_count);
+    static const int vnode_counts[] = {10, 40, 100, 400};
+    for (size_t v = 0; v < sizeof(vnode_counts) / sizeof(vnode_counts[0]); v++) {
+        run(vnode_counts[v], before, after);
+    }
+
+    assign_modulo(before, -1);
+    assign_modulo(after, server_count / 2);
+    printf("hash %% N    remove one: moved %5.2f%%\n", 100.0 * count_moved(before, after) / key_count);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// 로드밸런서 선택 처리량: 스레드 수별, 모드별 초당 선택 수
+// 스레드마다 요청 IN_FLIGHT 개를 진행 중으로 들고 있다가 오래된 것부터 끝냄 (load_balancer_pick/release)
+// 요청이 끝날 때 서버별로 정해 둔 지연을 기록하므로 peak_ewma 는 빠른 서버로 몰림
+// 비교 기준으로 전역 mutex 하나로 보호한 smooth weighted round robin 도 같이 측정
+// 사용법: ./bench/lb_bench [스레드당 선택 수]  (기본 2000000)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "../load_balancer/load_balancer.h"
+
+#define SERVER_COUNT 4
+#define IN_FLIGHT 8
+
+static httpserver servers[SERVER_COUNT] = {
+    {.ip = "10.0.0.1", .port = 8080, .weight = 3},
+    {.ip = "10.0.0.2", .port = 8080, .weight = 10},
+    {.ip = "10.0.0.3", .port = 8080, .weight = 5},
+    {.ip = "10.0.0.4", .port = 8080, .weight = 1},
+};
+static const long long latencies_us[SERVER_COUNT] = {2000, 8000, 1000, 4000};
+
+static long picks_per_thread;
+static atomic_long picked[SERVER_COUNT];
+
+// 비교용: 모든 스레드가 current_weight 하나를 mutex 로 공유하는 방식
+static pthread_mutex_t locked_lock = PTHREAD_MUTEX_INITIALIZER;
+static int locked_weights[SERVER_COUNT];
+
+static httpserver *locked_weighted_round_robin(const char *key, size_t key_len, int *trial) {
+    (void)key;
+    (void)key_len;
+    *trial = 0;
+    pthread_mutex_lock(&locked_lock);
+    int total_weight = 0;
+    int selected_index = -1;
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        if (servers[i].is_healthy) {
+            total_weight += servers[i].weight;
+            locked_weights[i] += servers[i].weight;
+            if (selected_index < 0 || locked_weights[i] > locked_weights[selected_index]) {
+                selected_index = i;
+            }
+        }
+    }
+    locked_weights[selected_index] -= total_weight;
+    pthread_mutex_unlock(&locked_lock);
+    atomic_fetch_add_explicit(&servers[selected_index].active_connections, 1, memory_order_relaxed);
+    return &servers[selected_index];
+}
+
+typedef struct {
+    const char *name;
+    int mode;               // -1 이면 mutex 기준
+} bench_mode;
+
+static httpserver *(*current_pick)(const char *, size_t, int *);
+
+static void *worker(void *arg) {
+    (void)arg;
+    long counts[SERVER_COUNT] = {0};
+    httpserver *in_flight[IN_FLIGHT] = {NULL};
+    int trials[IN_FLIGHT] = {0};
+    for (long i = 0; i < picks_per_thread; i++) {
+        httpserver **slot = &in_flight[i % IN_FLIGHT];
+        if (*slot != NULL) {
+            load_balancer_observe(*slot, latencies_us[*slot - servers]);
+            load_balancer_release(*slot, LB_RESULT_SUCCESS, trials[i % IN_FLIGHT]);
+        }
+        *slot = current_pick("/", 1, &trials[i % IN_FLIGHT]);
+        counts[*slot - servers]++;
+    }
+    for (int i = 0; i < IN_FLIGHT; i++) {
+        if (in_flight[i] != NULL) {
+            load_balancer_release(in_flight[i], LB_RESULT_CANCELLED, trials[i]);
+        }
+    }
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        atomic_fetch_add(&picked[i], counts[i]);
+    }
+    return NULL;
+}
+
+static void run(const bench_mode *mode, int threads) {
+    if (mode->mode >= 0) {
+        load_balancer_set_mode(mode->mode);
+        current_pick = load_balancer_pick;
+    } else {
+        current_pick = locked_weighted_round_robin;
+    }
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        atomic_store(&picked[i], 0);
+        atomic_store(&servers[i].active_connections, 0);
+    }
+
+    pthread_t tids[64];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, worker, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    // 모든 요청을 끝냈으므로 진행 중 요청 수는 0 으로 돌아와야 함
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        int active = atomic_load(&servers[i].active_connections);
+        if (active != 0) {
+            fprintf(stderr, "%s: server %d left %d requests in flight\n", mode->name, i, active);
+        }
+    }
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double total = (double)picks_per_thread * threads;
+    printf("%-22s threads %2d  %8.2f Mpicks/s  share", mode->name, threads, total / elapsed / 1e6);
+    for (int i = 0; i < SERVER_COUNT; i++) {
+        printf(" %5.1f%%", 100.0 * atomic_load(&picked[i]) / total);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    picks_per_thread = argc > 1 ? atol(argv[1]) : 2000000;
+    init_http_servers(servers, SERVER_COUNT);
+
+    static const bench_mode modes[] = {
+        {"round_robin", LB_ROUND_ROBIN},
+        {"weighted_round_robin", LB_WEIGHTED_ROUND_ROBIN},
+        {"least_connection", LB_LEAST_CONNECTION},
+        {"power_of_two_choices", LB_POWER_OF_TWO_CHOICES},
+        {"peak_ewma", LB_PEAK_EWMA},
+        {"locked_weighted_rr", -1},
+    };
+    static const int thread_counts[] = {1, 2, 4, 8, 16};
+
+    printf("%d servers (weights 3/10/5/1, latency 2/8/1/4 ms), %ld picks per thread\n", SERVER_COUNT, picks_per_thread);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            run(&modes[m], thread_counts[t]);
+        }
+    }
+    return 0;
+}
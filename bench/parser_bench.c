@@ -0,0 +1,132 @@
+// HTTP 헤더 파서 속도: 줄바꿈 검색 구현별(scalar/SSE2/AVX2), 한 번에 받은 경우와 잘게 나눠 받은 경우
+// 비교용으로 예전 방식(read 마다 strstr 로 빈 줄을 처음부터 다시 찾고 sscanf)도 측정
+// 사용법: ./bench/parser_bench [반복 횟수]  (기본 200000)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../http/http_parser.h"
+
+static const char request[] =
+    "GET /static/app/bundle.min.js?v=20240611 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: ko-KR,ko;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/products/list?category=shoes&page=3\r\n"
+    "Cookie: session=8f2a9c0d4b1e6f7a3c5d9e0b2a4f6c8d; theme=dark; _ga=GA1.2.1234567890.1700000000\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Pragma: no-cache\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static const char response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Tue, 11 Jun 2024 08:12:45 GMT\r\n"
+    "Server: nginx/1.24.0\r\n"
+    "Content-Type: application/javascript; charset=utf-8\r\n"
+    "Content-Length: 183422\r\n"
+    "Last-Modified: Mon, 10 Jun 2024 22:01:13 GMT\r\n"
+    "ETag: \"6667782d-2cc7e\"\r\n"
+    "Cache-Control: public, max-age=31536000, immutable\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "Strict-Transport-Security: max-age=63072000; includeSubDomains; preload\r\n"
+    "Accept-Ranges: bytes\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static volatile size_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// step 바이트씩 도착한다고 보고 매번 이어서 해석 (step 0 이면 한 번에)
+static void parse_message(http_message_kind kind, const char *msg, size_t len, size_t step) {
+    http_parser p;
+    http_parser_init(&p, kind);
+    size_t have = step == 0 ? len : 0;
+    int rc;
+    do {
+        if (step != 0) {
+            have = have + step < len ? have + step : len;
+        }
+        rc = http_parse(&p, msg, have);
+    } while (rc == HTTP_PARSE_AGAIN && have < len);
+
+    if (rc != HTTP_PARSE_DONE) {
+        fprintf(stderr, "parse failed\n");
+        exit(EXIT_FAILURE);
+    }
+    sink += p.header_count + p.content_length;
+}
+
+// 예전 방식: 받을 때마다 처음부터 빈 줄을 찾고, 찾으면 시작 줄을 sscanf
+static void legacy_message(const char *msg, size_t len, size_t step) {
+    static char buf[4096];
+    size_t have = 0;
+    char a[256], b[256], c[256];
+    memcpy(buf, msg, len + 1);
+    while (have < len) {
+        size_t n = step == 0 || have + step > len ? len - have : step;
+        have += n;
+        // 지금까지 도착한 부분만 문자열로 보이도록 잠시 끊음
+        char saved = buf[have];
+        buf[have] = '\0';
+        const char *end = strstr(buf, "\r\n\r\n");
+        buf[have] = saved;
+        if (end != NULL) {
+            sink += sscanf(buf, "%255s %255s %255s", a, b, c);
+            const char *cl = strcasestr(buf, "\r\nContent-Length:");
+            sink += cl != NULL ? strtoul(cl + 17, NULL, 10) : 0;
+            break;
+        }
+    }
+}
+
+static void run(const char *name, int iterations, size_t step, int legacy) {
+    size_t req_len = sizeof(request) - 1;
+    size_t resp_len = sizeof(response) - 1;
+
+    double t0 = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        if (legacy) {
+            legacy_message(request, req_len, step);
+            legacy_message(response, resp_len, step);
+        } else {
+            parse_message(HTTP_REQUEST, request, req_len, step);
+            parse_message(HTTP_RESPONSE, response, resp_len, step);
+        }
+    }
+    double elapsed = now_ns() - t0;
+
+    double bytes = (double)(req_len + resp_len) * iterations;
+    printf("%-8s %-12s %8.1f ns/msg  %8.1f MB/s\n", name, step == 0 ? "whole" : step == 64 ? "64B reads" : "16B reads",
+           elapsed / (2.0 * iterations), bytes / (1024.0 * 1024.0) / (elapsed / 1e9));
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    static const char *names[] = {"scalar", "sse2", "avx2"};
+    static const size_t steps[] = {0, 64, 16};
+
+    printf("request %zu bytes, response %zu bytes, %d iterations\n", sizeof(request) - 1, sizeof(response) - 1, iterations);
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        run("legacy", iterations, steps[s], 1);
+        for (int level = HTTP_SIMD_SCALAR; level <= HTTP_SIMD_AVX2; level++) {
+            if (http_parser_use_simd(level) != level) {
+                continue; // CPU 가 지원하지 않음
+            }
+            run(names[level], iterations, steps[s], 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+// 응답 본문 중계 방식 비교: 링 버퍼 복사(read/write) vs splice(파이프)
+// 사용법: ./bench/relay_bench [MB]  (기본 1024MB)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
+#define COPY_BUFFER_SIZE 16384 // connection.c 의 RELAY_BUFFER_SIZE 와 같은 크기
+#define PIPE_SIZE 65536        // connection.c 의 SPLICE_PIPE_SIZE 와 같은 크기
+
+static size_t total_bytes;
+
+static void die(const char *msg) {
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+// 루프백 TCP 연결 한 쌍 (connect 쪽, accept 쪽)
+static void tcp_pair(int listener, int fds[2]) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(listener, (struct sockaddr *)&addr, &len);
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] < 0 || connect(fds[0], (struct sockaddr *)&addr, len) < 0) {
+        die("connect");
+    }
+    fds[1] = accept(listener, NULL, NULL);
+    if (fds[1] < 0) {
+        die("accept");
+    }
+}
+
+static void *producer(void *arg) {
+    int fd = *(int *)arg;
+    static char buf[65536];
+    memset(buf, 'x', sizeof(buf));
+
+    size_t sent = 0;
+    while (sent < total_bytes) {
+        size_t len = total_bytes - sent < sizeof(buf) ? total_bytes - sent : sizeof(buf);
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            die("producer write");
+        }
+        sent += n;
+    }
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    int fd = *(int *)arg;
+    static char buf[65536];
+    size_t received = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        received += n;
+    }
+    if (received != total_bytes) {
+        fprintf(stderr, "consumer received %zu of %zu bytes\n", received, total_bytes);
+    }
+    return NULL;
+}
+
+static void relay_copy(int in, int out) {
+    static char buf[COPY_BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w <= 0) {
+                die("relay write");
+            }
+            off += w;
+        }
+    }
+}
+
+static void relay_splice(int in, int out) {
+    int p[2];
+    if (pipe(p) < 0) {
+        die("pipe");
+    }
+    fcntl(p[1], F_SETPIPE_SZ, PIPE_SIZE);
+
+    ssize_t n;
+    while ((n = splice(in, NULL, p[1], NULL, PIPE_SIZE, SPLICE_F_MOVE)) > 0) {
+        while (n > 0) {
+            ssize_t w = splice(p[0], NULL, out, NULL, n, SPLICE_F_MOVE);
+            if (w <= 0) {
+                die("splice out");
+            }
+            n -= w;
+        }
+    }
+    close(p[0]);
+    close(p[1]);
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void run(const char *name, void (*relay)(int, int)) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 4) < 0) {
+        die("listen");
+    }
+
+    int src[2], dst[2];
+    tcp_pair(listener, src); // src[0]: 백엔드 역할, src[1]: 프록시의 백엔드 소켓
+    tcp_pair(listener, dst); // dst[0]: 프록시의 클라이언트 소켓, dst[1]: 클라이언트 역할
+
+    pthread_t prod, cons;
+    pthread_create(&prod, NULL, producer, &src[0]);
+    pthread_create(&cons, NULL, consumer, &dst[1]);
+
+    struct timespec t0, t1;
+    struct rusage r0, r1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    getrusage(RUSAGE_THREAD, &r0);
+
+    relay(src[1], dst[0]);
+    shutdown(dst[0], SHUT_WR);
+
+    getrusage(RUSAGE_THREAD, &r1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double user = seconds(r1.ru_utime) - seconds(r0.ru_utime);
+    double sys = seconds(r1.ru_stime) - seconds(r0.ru_stime);
+    double gb = total_bytes / (1024.0 * 1024.0 * 1024.0);
+
+    printf("%-7s %8.1f MB/s  relay cpu %7.1f ms/GB (user %6.1f, sys %7.1f)\n", name,
+           total_bytes / (1024.0 * 1024.0) / wall, (user + sys) * 1000 / gb, user * 1000 / gb, sys * 1000 / gb);
+
+    close(src[0]);
+    close(src[1]);
+    close(dst[0]);
+    close(dst[1]);
+    close(listener);
+}
+
+int main(int argc, char *argv[]) {
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    total_bytes = mb * 1024 * 1024;
+
+    printf("relaying %zu MB over loopback TCP\n", mb);
+    run("copy", relay_copy);
+    run("splice", relay_splice);
+    return 0;
+}
@@ -0,0 +1,171 @@
+// 추적 재생 적중률: 같은 URL 순서를 LRU 와 W-TinyLFU 입장 방식의 캐시에 재생해 비교
+// 사용법: ./bench/trace_bench [추적 파일|-] [캐시 바이트] [객체 크기]  (기본 합성 추적, 16 MB, 4096)
+//   추적 파일: 한 줄에 "URL [크기]". 프록시 로그를 그대로 주면 "URL: " 뒤를 사용하고 크기는 객체 크기
+//   합성 추적: 인기 URL 의 Zipf 분포 요청 사이사이에 한 번씩만 요청되는 URL 을 훑는 크롤러가 끼어듦
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "../cache/cache.h"
+
+#define SYNTH_HOT_KEYS 50000
+#define SYNTH_REQUESTS 2000000
+#define SYNTH_ZIPF_S 0.9
+#define SYNTH_SCAN_EVERY 100000   // 이만큼 요청마다
+#define SYNTH_SCAN_LENGTH 20000   // 이만큼 새 URL 을 연달아 요청
+
+typedef struct {
+    char *url;
+    size_t size;
+} trace_request;
+
+static trace_request *trace = NULL;
+static size_t trace_len = 0;
+static size_t trace_cap = 0;
+static size_t max_size = 0;
+
+static void trace_add(const char *url, size_t url_len, size_t size) {
+    if (trace_len == trace_cap) {
+        trace_cap = trace_cap ? trace_cap * 2 : 65536;
+        trace = realloc(trace, trace_cap * sizeof(trace_request));
+        if (trace == NULL) {
+            perror("Failed to allocate trace");
+            exit(EXIT_FAILURE);
+        }
+    }
+    trace[trace_len].url = strndup(url, url_len);
+    trace[trace_len].size = size;
+    trace_len++;
+    if (size > max_size) {
+        max_size = size;
+    }
+}
+
+static void load_trace(const char *path, size_t object_size) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Failed to open trace");
+        exit(EXIT_FAILURE);
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        char *url = strstr(line, "URL: ");
+        url = url != NULL ? url + 5 : line;
+        url += strspn(url, " \t");
+        size_t url_len = strcspn(url, " \t\r\n");
+        if (url_len == 0) {
+            continue;
+        }
+        char *rest = url + url_len;
+        long size = strtol(rest, NULL, 10);
+        trace_add(url, url_len, size > 0 ? (size_t)size : object_size);
+    }
+    fclose(file);
+}
+
+static uint64_t xorshift(uint64_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+    return *x;
+}
+
+static void synthesize_trace(size_t object_size) {
+    double *cdf = malloc(SYNTH_HOT_KEYS * sizeof(double));
+    if (cdf == NULL) {
+        perror("Failed to allocate zipf table");
+        exit(EXIT_FAILURE);
+    }
+    double sum = 0;
+    for (int i = 0; i < SYNTH_HOT_KEYS; i++) {
+        sum += 1.0 / pow(i + 1, SYNTH_ZIPF_S);
+        cdf[i] = sum;
+    }
+
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    long scanned = 0;
+    char url[64];
+    for (long i = 0; i < SYNTH_REQUESTS; i++) {
+        int n;
+        if (i % SYNTH_SCAN_EVERY < SYNTH_SCAN_LENGTH && i >= SYNTH_SCAN_EVERY) {
+            n = snprintf(url, sizeof(url), "/crawl/page-%ld.html", scanned++);
+        } else {
+            double u = (xorshift(&x) >> 11) * (1.0 / 9007199254740992.0) * sum;
+            int lo = 0, hi = SYNTH_HOT_KEYS - 1;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (cdf[mid] < u) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            n = snprintf(url, sizeof(url), "/static/assets/item-%d.js", lo);
+        }
+        trace_add(url, n, object_size);
+    }
+    free(cdf);
+}
+
+static void replay(const char *name, int admission, size_t capacity, const char *body) {
+    if (cache_init(capacity, max_size, CACHE_DEFAULT_SHARDS, admission) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    size_t hits = 0;
+    size_t hit_bytes = 0;
+    size_t total_bytes = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < trace_len; i++) {
+        const trace_request *r = &trace[i];
+        total_bytes += r->size;
+        cache_entry *e = cache_lookup(r->url);
+        if (e != NULL) {
+            hits++;
+            hit_bytes += r->size;
+            cache_release(e);
+        } else {
+            cache_store(r->url, "", 0, body, r->size, NULL);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%-8s hit ratio %6.2f%%  byte hit ratio %6.2f%%  %8.2f Mops/s\n", name,
+           100.0 * hits / trace_len, total_bytes ? 100.0 * hit_bytes / total_bytes : 0.0,
+           trace_len / elapsed / 1e6);
+    cache_destroy();
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "-";
+    size_t capacity = argc > 2 ? (size_t)atol(argv[2]) : 16L * 1024 * 1024;
+    size_t object_size = argc > 3 ? (size_t)atol(argv[3]) : 4096;
+
+    if (strcmp(path, "-") == 0) {
+        synthesize_trace(object_size);
+        printf("synthetic trace: %d hot keys (zipf %.1f) + %d-request scans every %d, ",
+               SYNTH_HOT_KEYS, SYNTH_ZIPF_S, SYNTH_SCAN_LENGTH, SYNTH_SCAN_EVERY);
+    } else {
+        load_trace(path, object_size);
+        printf("trace %s: ", path);
+    }
+    if (trace_len == 0) {
+        fprintf(stderr, "Empty trace\n");
+        return EXIT_FAILURE;
+    }
+    printf("%zu requests, cache %zu bytes\n", trace_len, capacity);
+
+    char *body = calloc(1, max_size);
+    if (body == NULL) {
+        perror("Failed to allocate body");
+        return EXIT_FAILURE;
+    }
+    replay("lru", CACHE_ADMISSION_LRU, capacity, body);
+    replay("tinylfu", CACHE_ADMISSION_TINYLFU, capacity, body);
+    return 0;
+}
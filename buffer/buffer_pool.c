@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buffer_pool.h"
+
+void buffer_pool_init(buffer_pool *p) {
+    memset(p, 0, sizeof(*p));
+    p->small.slab_size = BUFFER_SMALL_SIZE;
+    p->large.slab_size = BUFFER_LARGE_SIZE;
+}
+
+// 빈 슬랩이 없으면 BUFFER_CHUNK_SLABS 개를 한 덩어리로 할당해 빈 목록에 연결
+static int class_refill(buffer_class *cls) {
+    char *chunk = malloc(cls->slab_size * BUFFER_CHUNK_SLABS);
+    if (chunk == NULL) {
+        perror("Failed to allocate buffer slabs");
+        return -1;
+    }
+
+    for (int i = 0; i < BUFFER_CHUNK_SLABS; i++) {
+        void *slab = chunk + cls->slab_size * i;
+        *(void **)slab = cls->free_list;
+        cls->free_list = slab;
+    }
+    cls->total += BUFFER_CHUNK_SLABS;
+    return 0;
+}
+
+static char *class_get(buffer_class *cls) {
+    if (cls->free_list == NULL && class_refill(cls) < 0) {
+        return NULL;
+    }
+
+    void *slab = cls->free_list;
+    cls->free_list = *(void **)slab;
+    if (++cls->in_use > cls->peak) {
+        cls->peak = cls->in_use;
+    }
+    return slab;
+}
+
+static void class_put(buffer_class *cls, char *buf) {
+    *(void **)buf = cls->free_list;
+    cls->free_list = buf;
+    cls->in_use--;
+}
+
+char *buffer_pool_alloc(buffer_pool *p, size_t size, size_t *cap) {
+    char *buf;
+    if (size <= BUFFER_SMALL_SIZE) {
+        buf = class_get(&p->small);
+        *cap = BUFFER_SMALL_SIZE;
+    } else if (size <= BUFFER_LARGE_SIZE) {
+        buf = class_get(&p->large);
+        *cap = BUFFER_LARGE_SIZE;
+    } else {
+        buf = malloc(size);
+        if (buf == NULL) {
+            perror("malloc failed");
+            return NULL;
+        }
+        *cap = size;
+        p->oversize_in_use++;
+        p->oversize_total++;
+    }
+    return buf;
+}
+
+// 용량만 보고 어디서 온 버퍼인지 구분 (힙 버퍼는 항상 BUFFER_LARGE_SIZE 보다 큼)
+void buffer_pool_free(buffer_pool *p, char *buf, size_t cap) {
+    if (buf == NULL) {
+        return;
+    }
+    if (cap == BUFFER_SMALL_SIZE) {
+        class_put(&p->small, buf);
+    } else if (cap == BUFFER_LARGE_SIZE) {
+        class_put(&p->large, buf);
+    } else {
+        free(buf);
+        p->oversize_in_use--;
+    }
+}
+
+int buffer_pool_grow(buffer_pool *p, char **buf, size_t *cap, size_t used, size_t need) {
+    if (need <= *cap) {
+        return 0;
+    }
+
+    // 슬랩보다 커지면 두 배씩 늘림. 이미 힙 버퍼면 realloc
+    size_t new_cap = need;
+    if (need > BUFFER_LARGE_SIZE) {
+        new_cap = *cap > BUFFER_LARGE_SIZE ? *cap : BUFFER_LARGE_SIZE;
+        while (new_cap < need) {
+            new_cap *= 2;
+        }
+        if (*cap > BUFFER_LARGE_SIZE) {
+            char *grown = realloc(*buf, new_cap);
+            if (grown == NULL) {
+                perror("realloc failed");
+                return -1;
+            }
+            *buf = grown;
+            *cap = new_cap;
+            return 0;
+        }
+    }
+
+    size_t got;
+    char *grown = buffer_pool_alloc(p, new_cap, &got);
+    if (grown == NULL) {
+        return -1;
+    }
+    if (used > 0) {
+        memcpy(grown, *buf, used);
+    }
+    buffer_pool_free(p, *buf, *cap);
+    *buf = grown;
+    *cap = got;
+    return 0;
+}
+
+void buffer_pool_release(buffer_pool *p, char **buf, size_t *cap) {
+    buffer_pool_free(p, *buf, *cap);
+    *buf = NULL;
+    *cap = 0;
+}
+
+void buffer_pool_print_stats(buffer_pool *p, int reactor_id) {
+    printf("Reactor %d buffers: 4K in_use=%zu/%zu peak=%zu, 16K in_use=%zu/%zu peak=%zu, oversize in_use=%zu total=%zu\n",
+           reactor_id,
+           p->small.in_use, p->small.total, p->small.peak,
+           p->large.in_use, p->large.total, p->large.peak,
+           p->oversize_in_use, p->oversize_total);
+    fflush(stdout);
+}
@@ -0,0 +1,42 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#define BUFFER_SMALL_SIZE 4096   // 요청, 재작성한 헤더, 캐시 조회
+#define BUFFER_LARGE_SIZE 16384  // 응답 헤더 수신, 본문 중계 링 버퍼
+#define BUFFER_CHUNK_SLABS 32    // 슬랩이 모자라면 한 번에 늘리는 개수
+
+// 같은 크기 슬랩의 빈 목록. 빈 슬랩의 앞부분에 다음 슬랩 포인터를 저장
+typedef struct {
+    size_t slab_size;
+    void *free_list;
+    size_t total;   // 만든 슬랩 수
+    size_t in_use;  // 연결에 나가 있는 슬랩 수
+    size_t peak;
+} buffer_class;
+
+// reactor 하나의 버퍼 아레나. 해당 reactor 스레드만 접근하므로 락이 없음
+// 슬랩 용량은 BUFFER_SMALL_SIZE/BUFFER_LARGE_SIZE 중 하나이고, 그보다 커진 버퍼만 힙에서 따로 할당
+typedef struct buffer_pool {
+    buffer_class small;
+    buffer_class large;
+    size_t oversize_in_use; // 슬랩보다 커서 힙에 있는 버퍼 수
+    size_t oversize_total;  // 지금까지 슬랩보다 커진 횟수
+} buffer_pool;
+
+void buffer_pool_init(buffer_pool *p);
+
+// size 바이트 이상의 버퍼 (내용은 초기화하지 않음). 실제 용량은 *cap
+char *buffer_pool_alloc(buffer_pool *p, size_t size, size_t *cap);
+void buffer_pool_free(buffer_pool *p, char *buf, size_t cap);
+
+// 앞의 used 바이트를 유지하면서 용량을 need 이상으로 확장
+int buffer_pool_grow(buffer_pool *p, char **buf, size_t *cap, size_t used, size_t need);
+
+// 버퍼를 풀에 돌려주고 포인터/용량을 비움
+void buffer_pool_release(buffer_pool *p, char **buf, size_t *cap);
+
+void buffer_pool_print_stats(buffer_pool *p, int reactor_id);
+
+#endif
@@ -1,49 +1,733 @@
 #include "cache.h"
+#include "disk_tier.h"
+#include "tinylfu.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 #include <pthread.h>
 
-#define CACHE_SIZE 5
+#define CACHE_MIN_BUCKETS 64
+#define CACHE_WINDOW_PERCENT 1            // TinyLFU: 샤드 예산 중 윈도우 LRU 몫
+#define CACHE_PROTECTED_PERCENT 80        // TinyLFU: 윈도우를 뺀 나머지(main) 중 보호 구간 몫
+#define CACHE_SKETCH_OBJECT_ESTIMATE 8192 // 빈도 스케치 처음 크기를 정할 때 가정하는 평균 항목 크기
+#define CACHE_IO_MAX_READS 1024           // I/O 스레드에 쌓아 둘 디스크 읽기 수 (넘으면 디스크를 보지 않고 미스)
+#define CACHE_IO_MAX_DEMOTE_BYTES (32L * 1024 * 1024) // 디스크로 내리려고 쌓아 둘 바이트 (넘으면 내리지 않고 버림)
 
+// 새 항목은 윈도우로 들어오고, 윈도우에서 밀려나면 입장 심사를 거쳐 수습 구간으로,
+// 수습 구간에서 다시 적중하면 보호 구간으로. LRU 방식이면 윈도우 하나만 씀
+enum {
+    SEGMENT_WINDOW,
+    SEGMENT_PROBATION,
+    SEGMENT_PROTECTED,
+    SEGMENT_COUNT
+};
+
+typedef struct {
+    cache_entry *head;              // 가장 최근에 사용
+    cache_entry *tail;              // 가장 오래전에 사용 (먼저 제거)
+    size_t bytes;
+} cache_lru;
+
+// 샤드마다 락, 해시 테이블, LRU 목록, 바이트 예산을 따로 가짐
+typedef struct {
+    pthread_mutex_t lock;
+    cache_entry **buckets;
+    size_t bucket_count;            // 2의 거듭제곱
+    size_t entry_count;
+    cache_lru lru[SEGMENT_COUNT];
+    size_t bytes;
+    size_t budget;
+    size_t window_budget;
+    size_t protected_budget;
+    tinylfu_sketch sketch;          // TinyLFU 방식에서만 사용
+} cache_shard;
+
+// 락 안에서 고른 제거 결과. 디스크로 내릴 항목은 참조를 유지한 채 hash_next 로 묶어 둠
 typedef struct {
-    char url[256];
-    char data[MAX_BUFFER_SIZE];
-} CacheEntry;
+    cache_entry *demoted;
+    unsigned long evicted;
+    unsigned long rejected;
+} cache_eviction;
+
+// 디스크 계층에서 RAM 으로 올리는 읽기. I/O 스레드와 기다리는 연결이 참조를 나눠 가짐
+struct cache_disk_read {
+    struct cache_disk_read *next;   // I/O 대기열
+    atomic_int refs;
+    atomic_int done;
+    int wake_fd;                    // 기다리는 연결이 있는 reactor 의 eventfd
+    cache_entry *entry;             // 결과 (참조 하나), 없으면 NULL
+    size_t key_len;
+    char key[];
+};
+
+// 디스크 계층의 읽기와 쓰기는 페이지 폴트로 reactor 가 멈추지 않도록 I/O 스레드 하나가 맡음
+// 디스크 계층을 쓸 때 처음 맡기는 순간 시작. 읽기는 클라이언트가 기다리므로 쌓인 쓰기보다 먼저
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    cache_disk_read *reads;
+    cache_disk_read **reads_tail;
+    int read_count;
+    cache_entry *demotions;         // 디스크로 내릴 항목 (참조 보유, hash_next 로 묶음)
+    cache_entry **demotions_tail;
+    size_t demotion_bytes;
+    int started;
+} cache_io;
+
+static cache_io io = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, NULL, NULL, 0, 0};
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+
+static cache_shard *shards = NULL;
+static int shard_bits = 0;
+static size_t max_object_size = 0;
+static int admission = CACHE_ADMISSION_LRU;
 
-static CacheEntry cache[CACHE_SIZE];
-static int cache_index = 0;
-static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;  // 뮤텍스 추가
+static atomic_ulong stat_hits;
+static atomic_ulong stat_misses;
+static atomic_ulong stat_stores;
+static atomic_ulong stat_evictions;
+static atomic_ulong stat_refreshes;
+static atomic_ulong stat_rejections;
+static atomic_ulong stat_demote_dropped;
+
+// 64비트 FNV-1a
+uint64_t cache_hash(const char *key, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// 상위 비트로 샤드, 하위 비트로 버킷을 골라 서로 겹치지 않게 함
+static cache_shard *shard_for(uint64_t hash) {
+    return &shards[shard_bits == 0 ? 0 : hash >> (64 - shard_bits)];
+}
+
+static size_t entry_charge(const cache_entry *e) {
+    size_t charge = sizeof(cache_entry) + e->key_len + 1;
+    for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+        charge += e->iov[i].iov_len;
+    }
+    return charge;
+}
+
+void cache_release(cache_entry *e) {
+    if (atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) == 1) {
+        free(e);
+    }
+}
 
 // 캐시 초기화
-void cache_init() {
-    memset(cache, 0, sizeof(cache));
+int cache_init(size_t capacity, size_t max_object, int shard_count, int admission_policy) {
+    int count = 1;
+    shard_bits = 0;
+    while (count < shard_count) {
+        count <<= 1;
+        shard_bits++;
+    }
+
+    shards = calloc(count, sizeof(cache_shard));
+    if (shards == NULL) {
+        perror("Failed to allocate cache shards");
+        return -1;
+    }
+    admission = admission_policy;
+    max_object_size = max_object < capacity / count ? max_object : capacity / count;
+    for (int i = 0; i < count; i++) {
+        cache_shard *s = &shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->bucket_count = CACHE_MIN_BUCKETS;
+        s->buckets = calloc(s->bucket_count, sizeof(cache_entry *));
+        if (s->buckets == NULL) {
+            perror("Failed to allocate cache buckets");
+            return -1;
+        }
+        s->budget = capacity / count;
+        s->window_budget = s->budget;
+        if (admission == CACHE_ADMISSION_TINYLFU) {
+            // 새 항목이 최근성만으로 한 번은 머물 수 있도록 윈도우는 가장 큰 항목 하나 이상
+            size_t window = s->budget * CACHE_WINDOW_PERCENT / 100;
+            if (window < max_object_size) {
+                window = max_object_size;
+            }
+            s->window_budget = window < s->budget / 2 ? window : s->budget / 2;
+            s->protected_budget = (s->budget - s->window_budget) * CACHE_PROTECTED_PERCENT / 100;
+            if (tinylfu_init(&s->sketch, s->budget / CACHE_SKETCH_OBJECT_ESTIMATE) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+size_t cache_max_object_size(void) {
+    return max_object_size;
+}
+
+static void lru_unlink(cache_shard *s, cache_entry *e) {
+    cache_lru *l = &s->lru[e->segment];
+    if (e->lru_prev != NULL) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        l->head = e->lru_next;
+    }
+    if (e->lru_next != NULL) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        l->tail = e->lru_prev;
+    }
+    e->lru_prev = e->lru_next = NULL;
+    l->bytes -= entry_charge(e);
+}
+
+static void lru_push_front(cache_shard *s, cache_entry *e, int segment) {
+    cache_lru *l = &s->lru[segment];
+    e->segment = segment;
+    e->lru_prev = NULL;
+    e->lru_next = l->head;
+    if (l->head != NULL) {
+        l->head->lru_prev = e;
+    } else {
+        l->tail = e;
+    }
+    l->head = e;
+    l->bytes += entry_charge(e);
+}
+
+// 적중한 항목을 최근 사용으로. 수습 구간에서 다시 쓰이면 보호 구간으로 올리고, 넘친 보호 항목은 수습으로 내림
+static void lru_touch(cache_shard *s, cache_entry *e) {
+    if (e->segment == SEGMENT_PROBATION) {
+        lru_unlink(s, e);
+        lru_push_front(s, e, SEGMENT_PROTECTED);
+        while (s->lru[SEGMENT_PROTECTED].bytes > s->protected_budget && s->lru[SEGMENT_PROTECTED].tail != e) {
+            cache_entry *overflow = s->lru[SEGMENT_PROTECTED].tail;
+            lru_unlink(s, overflow);
+            lru_push_front(s, overflow, SEGMENT_PROBATION);
+        }
+    } else if (s->lru[e->segment].head != e) {
+        int segment = e->segment;
+        lru_unlink(s, e);
+        lru_push_front(s, e, segment);
+    }
+}
+
+// 버킷 체인에서 링크 위치를 찾음 (없으면 체인 끝의 NULL 링크)
+static cache_entry **find_link(cache_shard *s, uint64_t hash, const char *key, size_t key_len) {
+    cache_entry **link = &s->buckets[hash & (s->bucket_count - 1)];
+    while (*link != NULL) {
+        cache_entry *e = *link;
+        if (e->hash == hash && e->key_len == key_len && memcmp(e->key, key, key_len) == 0) {
+            break;
+        }
+        link = &e->hash_next;
+    }
+    return link;
 }
 
-// 캐시에서 URL에 해당하는 데이터를 찾아서 반환
-int cache_lookup(const char *url, char *data) {
-    pthread_mutex_lock(&cache_mutex);  // 캐시 접근 전에 락
+// 테이블에서 빼고 캐시의 참조를 놓음. 전송 중인 연결이 참조를 가지고 있으면 그쪽에서 해제
+static void remove_entry(cache_shard *s, cache_entry *e) {
+    cache_entry **link = find_link(s, e->hash, e->key, e->key_len);
+    *link = e->hash_next;
+    lru_unlink(s, e);
+    s->bytes -= entry_charge(e);
+    s->entry_count--;
+    cache_release(e);
+}
 
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        if (strcmp(cache[i].url, url) == 0) {
-            strcpy(data, cache[i].data);
-            pthread_mutex_unlock(&cache_mutex);  // 캐시 접근 후 락 해제
-            return 1;  // 캐시에서 데이터를 찾은 경우
+// 항목 수가 버킷 수를 넘으면 버킷을 두 배로 (실패하면 체인이 길어질 뿐)
+static void maybe_grow(cache_shard *s) {
+    if (s->entry_count <= s->bucket_count) {
+        return;
+    }
+    size_t new_count = s->bucket_count * 2;
+    cache_entry **buckets = calloc(new_count, sizeof(cache_entry *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < s->bucket_count; i++) {
+        cache_entry *e = s->buckets[i];
+        while (e != NULL) {
+            cache_entry *next = e->hash_next;
+            size_t b = e->hash & (new_count - 1);
+            e->hash_next = buckets[b];
+            buckets[b] = e;
+            e = next;
         }
     }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->bucket_count = new_count;
+}
+
+static cache_entry *entry_create(const char *key, size_t key_len, const char *head, size_t head_len, const char *body,
+                                 size_t body_len, const cache_freshness *f);
+static void entry_insert(cache_entry *e, cache_entry **existing);
 
-    pthread_mutex_unlock(&cache_mutex);  // 캐시 접근 후 락 해제
-    return 0;  // 캐시에서 데이터 미발견
+// 디스크 계층에서 찾아 RAM 으로 다시 올림 (I/O 스레드)
+// 디스크를 읽는 사이 다른 스레드가 같은 URL 의 새 응답을 저장했으면 옛 디스크 사본은 버리고 그 항목을 씀
+static cache_entry *lookup_disk(const char *url, size_t key_len) {
+    cache_entry *e = disk_tier_get(url, key_len, entry_create);
+    if (e == NULL) {
+        atomic_fetch_add_explicit(&stat_misses, 1, memory_order_relaxed);
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed); // 호출한 쪽의 참조
+    cache_entry *existing = NULL;
+    entry_insert(e, &existing);
+    if (existing != NULL) {
+        cache_release(e); // 테이블에 넣지 못한 사본의 두 참조
+        cache_release(e);
+        e = existing;
+    }
+    atomic_fetch_add_explicit(&stat_hits, 1, memory_order_relaxed);
+    return e;
 }
 
-// 캐시에 URL과 데이터를 저장
-void cache_store(const char *url, const char *data) {
-    pthread_mutex_lock(&cache_mutex);  // 캐시 접근 전에 락
+// RAM 에서 찾아 참조를 하나 늘려 반환. record 면 빈도를 기록 (요청 하나에 한 번만)
+static cache_entry *lookup_ram(const char *url, size_t key_len, uint64_t hash, int record) {
+    cache_shard *s = shard_for(hash);
 
-    strcpy(cache[cache_index].url, url);
-    strncpy(cache[cache_index].data, data, MAX_BUFFER_SIZE);
+    pthread_mutex_lock(&s->lock);
+    // 빈도는 적중/실패 모두 기록해야 아직 캐시에 없는 인기 URL 도 입장 심사를 통과함
+    if (record && admission == CACHE_ADMISSION_TINYLFU) {
+        tinylfu_increment(&s->sketch, hash);
+    }
+    cache_entry *e = *find_link(s, hash, url, key_len);
+    if (e != NULL) {
+        lru_touch(s, e);
+        atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
 
-    cache_index = (cache_index + 1) % CACHE_SIZE;  // 캐시 인덱스를 순환
+static void read_release(cache_disk_read *r) {
+    if (atomic_fetch_sub_explicit(&r->refs, 1, memory_order_acq_rel) == 1) {
+        if (r->entry != NULL) {
+            cache_release(r->entry);
+        }
+        free(r);
+    }
+}
+
+// 먼저 온 읽기가 이미 올렸으면 그 RAM 항목을, 아니면 디스크에서 올린 항목을 결과로 두고 기다리는 reactor 를 깨움
+// 기다리던 연결이 이미 닫혔으면 읽지 않음
+static void run_read(cache_disk_read *r) {
+    if (atomic_load_explicit(&r->refs, memory_order_acquire) > 1) {
+        cache_entry *e = lookup_ram(r->key, r->key_len, cache_hash(r->key, r->key_len), 0);
+        if (e != NULL) {
+            atomic_fetch_add_explicit(&stat_hits, 1, memory_order_relaxed);
+        } else {
+            e = lookup_disk(r->key, r->key_len);
+        }
+        r->entry = e;
+    }
+    atomic_store_explicit(&r->done, 1, memory_order_release);
+
+    uint64_t one = 1;
+    if (write(r->wake_fd, &one, sizeof(one)) < 0) {
+        perror("Failed to wake reactor");
+    }
+    read_release(r);
+}
+
+static void *io_thread(void *arg) {
+    (void)arg;
+    // 그때까지 reactor 는 인덱스를 보지 않고 RAM 에 없는 키를 모두 이 스레드에 맡김
+    disk_tier_prefault();
+    pthread_mutex_lock(&io.lock);
+    while (1) {
+        if (io.reads != NULL) {
+            cache_disk_read *r = io.reads;
+            io.reads = r->next;
+            if (io.reads == NULL) {
+                io.reads_tail = &io.reads;
+            }
+            io.read_count--;
+            pthread_mutex_unlock(&io.lock);
+            run_read(r);
+            pthread_mutex_lock(&io.lock);
+        } else if (io.demotions != NULL) {
+            cache_entry *e = io.demotions;
+            io.demotions = e->hash_next;
+            if (io.demotions == NULL) {
+                io.demotions_tail = &io.demotions;
+            }
+            io.demotion_bytes -= entry_charge(e);
+            pthread_mutex_unlock(&io.lock);
+            disk_tier_put(e);
+            cache_release(e);
+            pthread_mutex_lock(&io.lock);
+        } else {
+            pthread_cond_wait(&io.ready, &io.lock);
+        }
+    }
+    return NULL;
+}
+
+static void io_start(void) {
+    io.reads_tail = &io.reads;
+    io.demotions_tail = &io.demotions;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, io_thread, NULL) != 0) {
+        perror("Failed to create cache I/O thread");
+        return;
+    }
+    pthread_detach(tid);
+    io.started = 1;
+}
 
-    pthread_mutex_unlock(&cache_mutex);  // 캐시 접근 후 락 해제
+// 디스크 읽기를 I/O 스레드에 맡김. 대기열이 가득 찼거나 I/O 스레드가 없으면 0
+static int queue_read(const char *url, size_t key_len, int wake_fd, cache_disk_read **out) {
+    pthread_once(&io_once, io_start);
+    if (!io.started) {
+        return 0;
+    }
+    cache_disk_read *r = malloc(sizeof(cache_disk_read) + key_len + 1);
+    if (r == NULL) {
+        perror("Failed to allocate disk read");
+        return 0;
+    }
+    r->next = NULL;
+    atomic_init(&r->refs, 2); // I/O 스레드와 기다리는 연결
+    atomic_init(&r->done, 0);
+    r->wake_fd = wake_fd;
+    r->entry = NULL;
+    r->key_len = key_len;
+    memcpy(r->key, url, key_len + 1);
+
+    pthread_mutex_lock(&io.lock);
+    if (io.read_count >= CACHE_IO_MAX_READS) {
+        pthread_mutex_unlock(&io.lock);
+        free(r);
+        return 0;
+    }
+    *io.reads_tail = r;
+    io.reads_tail = &r->next;
+    io.read_count++;
+    pthread_cond_signal(&io.ready);
+    pthread_mutex_unlock(&io.lock);
+    *out = r;
+    return 1;
 }
 
+// 밀려난 항목들(hash_next 로 묶고 참조 보유)을 디스크로 내리도록 I/O 스레드에 맡김
+// 디스크가 따라오지 못해 쌓인 양이 한도를 넘으면 내리지 않고 버림. I/O 스레드가 없으면 직접 씀
+static void queue_demotions(cache_entry *list) {
+    pthread_once(&io_once, io_start);
+    cache_entry *dropped = NULL;
+    if (io.started) {
+        pthread_mutex_lock(&io.lock);
+        while (list != NULL) {
+            cache_entry *e = list;
+            list = e->hash_next;
+            size_t charge = entry_charge(e);
+            if (io.demotion_bytes + charge > CACHE_IO_MAX_DEMOTE_BYTES) {
+                e->hash_next = dropped;
+                dropped = e;
+                continue;
+            }
+            e->hash_next = NULL;
+            *io.demotions_tail = e;
+            io.demotions_tail = &e->hash_next;
+            io.demotion_bytes += charge;
+        }
+        pthread_cond_signal(&io.ready);
+        pthread_mutex_unlock(&io.lock);
+    }
+    while (list != NULL) {
+        cache_entry *e = list;
+        list = e->hash_next;
+        disk_tier_put(e);
+        cache_release(e);
+    }
+    while (dropped != NULL) {
+        cache_entry *e = dropped;
+        dropped = e->hash_next;
+        cache_release(e);
+        atomic_fetch_add_explicit(&stat_demote_dropped, 1, memory_order_relaxed);
+    }
+}
+
+cache_entry *cache_lookup_async(const char *url, int wake_fd, cache_disk_read **read) {
+    size_t key_len = strlen(url);
+    uint64_t hash = cache_hash(url, key_len);
+    if (read != NULL) {
+        *read = NULL;
+    }
+
+    cache_entry *e = lookup_ram(url, key_len, hash, 1);
+    if (e != NULL) {
+        atomic_fetch_add_explicit(&stat_hits, 1, memory_order_relaxed);
+        return e;
+    }
+    // 디스크 계층에서의 적중/실패는 I/O 스레드가 셈
+    if (read != NULL && disk_tier_may_contain(hash) && queue_read(url, key_len, wake_fd, read)) {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&stat_misses, 1, memory_order_relaxed);
+    return NULL;
+}
+
+// 캐시에서 URL에 해당하는 항목을 찾아 참조를 하나 늘려 반환
+cache_entry *cache_lookup(const char *url) {
+    return cache_lookup_async(url, -1, NULL);
+}
+
+int cache_disk_read_done(const cache_disk_read *r) {
+    return atomic_load_explicit(&r->done, memory_order_acquire);
+}
+
+cache_entry *cache_disk_read_finish(cache_disk_read *r) {
+    cache_entry *e = NULL;
+    if (cache_disk_read_done(r)) {
+        e = r->entry;
+        r->entry = NULL;
+    }
+    read_release(r);
+    return e;
+}
+
+// 키, 헤더, 본문, 검증자를 구조체 뒤에 이어서 한 번에 할당
+static cache_entry *entry_create(const char *key, size_t key_len, const char *head, size_t head_len, const char *body,
+                                 size_t body_len, const cache_freshness *f) {
+    size_t etag_len = f != NULL ? f->etag_len : 0;
+    size_t last_modified_len = f != NULL ? f->last_modified_len : 0;
+    cache_entry *e = malloc(sizeof(cache_entry) + key_len + 1 + head_len + body_len + etag_len + last_modified_len);
+    if (e == NULL) {
+        perror("Failed to allocate cache entry");
+        return NULL;
+    }
+    e->hash = cache_hash(key, key_len);
+    e->key_len = key_len;
+    memcpy(e->key, key, key_len);
+    e->key[key_len] = '\0';
+
+    const char *parts[CACHE_IOV_COUNT] = {head, body, f != NULL ? f->etag : NULL, f != NULL ? f->last_modified : NULL};
+    size_t lens[CACHE_IOV_COUNT] = {head_len, body_len, etag_len, last_modified_len};
+    char *data = e->key + key_len + 1;
+    for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+        if (lens[i] > 0) {
+            memcpy(data, parts[i], lens[i]);
+        }
+        e->iov[i].iov_base = data;
+        e->iov[i].iov_len = lens[i];
+        data += lens[i];
+    }
+
+    if (f != NULL) {
+        e->stored_at = f->stored_at;
+        e->expires = f->expires;
+        e->initial_age = f->initial_age;
+        e->stale_while_revalidate = f->stale_while_revalidate;
+        e->stale_if_error = f->stale_if_error;
+    } else {
+        e->stored_at = time(NULL);
+        e->expires = (time_t)INT64_MAX;
+        e->initial_age = 0;
+        e->stale_while_revalidate = e->expires;
+        e->stale_if_error = e->expires;
+    }
+    e->lru_prev = e->lru_next = NULL;
+    atomic_init(&e->refs, 1); // 캐시 테이블의 참조
+    return e;
+}
+
+// 테이블에서 빼고, demote 면 디스크로 내릴 수 있도록 ev 에 묶어 둠
+static void evict(cache_shard *s, cache_entry *e, cache_eviction *ev, int demote) {
+    if (demote && disk_tier_enabled()) {
+        atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+        remove_entry(s, e);
+        e->hash_next = ev->demoted;
+        ev->demoted = e;
+    } else {
+        remove_entry(s, e);
+    }
+}
+
+// main(수습 + 보호)에서 다음에 밀려날 항목
+static cache_entry *main_victim(cache_shard *s, const cache_entry *candidate) {
+    cache_entry *victim = s->lru[SEGMENT_PROBATION].tail;
+    return victim != NULL && victim != candidate ? victim : s->lru[SEGMENT_PROTECTED].tail;
+}
+
+// 윈도우에서 밀려난 항목을 수습 구간에 넣고, main 이 넘치면 그 항목과 main 의 희생자 중 덜 자주 쓰인 쪽을 제거
+// 동률이면 자리를 지키던 쪽을 남겨, 한 번 쓰고 마는 URL 이 이어져도 인기 항목이 밀려나지 않게 함
+static void admit(cache_shard *s, cache_eviction *ev) {
+    size_t main_budget = s->budget - s->window_budget;
+    while (s->lru[SEGMENT_WINDOW].bytes > s->window_budget) {
+        cache_entry *candidate = s->lru[SEGMENT_WINDOW].tail;
+        lru_unlink(s, candidate);
+        lru_push_front(s, candidate, SEGMENT_PROBATION);
+
+        int frequency = tinylfu_frequency(&s->sketch, candidate->hash);
+        while (s->lru[SEGMENT_PROBATION].bytes + s->lru[SEGMENT_PROTECTED].bytes > main_budget) {
+            cache_entry *victim = main_victim(s, candidate);
+            if (victim == NULL || tinylfu_frequency(&s->sketch, victim->hash) >= frequency) {
+                // 들어오지 못한 항목은 디스크 계층도 어지럽히지 않도록 그냥 버림
+                evict(s, candidate, ev, 0);
+                ev->rejected++;
+                break;
+            }
+            evict(s, victim, ev, 1);
+            ev->evicted++;
+        }
+    }
+}
+
+// 같은 키의 항목이 있으면 같은 구간에서 교체하고, 예산을 넘으면 admission 방식에 따라 제거
+// existing 이 있으면 교체하지 않음: 같은 키의 항목이 이미 있으면 그 참조를 하나 늘려 *existing 에 두고 e 는 넣지 않음
+static void entry_insert(cache_entry *e, cache_entry **existing) {
+    cache_shard *s = shard_for(e->hash);
+    cache_eviction ev = {NULL, 0, 0};
+    int segment = SEGMENT_WINDOW;
+
+    pthread_mutex_lock(&s->lock);
+    cache_entry *old = *find_link(s, e->hash, e->key, e->key_len);
+    if (old != NULL && existing != NULL) {
+        lru_touch(s, old);
+        atomic_fetch_add_explicit(&old->refs, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&s->lock);
+        *existing = old;
+        return;
+    }
+    if (old != NULL) {
+        segment = old->segment;
+        remove_entry(s, old);
+    }
+
+    cache_entry **bucket = &s->buckets[e->hash & (s->bucket_count - 1)];
+    e->hash_next = *bucket;
+    *bucket = e;
+    lru_push_front(s, e, segment);
+    s->bytes += entry_charge(e);
+    s->entry_count++;
+
+    if (admission == CACHE_ADMISSION_TINYLFU) {
+        tinylfu_ensure_capacity(&s->sketch, s->entry_count);
+        admit(s, &ev);
+    }
+    // 남은 초과분(LRU 방식, 또는 더 큰 항목으로 교체된 경우)은 오래된 쪽부터. 방금 넣은 항목은 남김
+    while (s->bytes > s->budget) {
+        cache_entry *victim = main_victim(s, NULL);
+        if (victim == NULL) {
+            victim = s->lru[SEGMENT_WINDOW].tail;
+        }
+        if (victim == e) {
+            break;
+        }
+        evict(s, victim, &ev, 1);
+        ev.evicted++;
+    }
+    maybe_grow(s);
+    pthread_mutex_unlock(&s->lock);
+
+    // 디스크 쓰기는 샤드 락 밖에서 I/O 스레드가. 만료됐고 재검증할 수도 없는 항목은 버림
+    time_t now = time(NULL);
+    cache_entry *demote = NULL;
+    while (ev.demoted != NULL) {
+        cache_entry *victim = ev.demoted;
+        ev.demoted = victim->hash_next;
+        if (cache_entry_fresh(victim, now) || cache_entry_has_validator(victim)) {
+            victim->hash_next = demote;
+            demote = victim;
+        } else {
+            cache_release(victim);
+        }
+    }
+    if (demote != NULL) {
+        queue_demotions(demote);
+    }
+
+    atomic_fetch_add_explicit(&stat_stores, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_evictions, ev.evicted, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_rejections, ev.rejected, memory_order_relaxed);
+}
+
+// 캐시에 URL과 헤더/본문을 저장
+void cache_store(const char *url, const char *head, size_t head_len, const char *body, size_t body_len,
+                 const cache_freshness *freshness) {
+    if (head_len + body_len > max_object_size) {
+        return;
+    }
+
+    cache_entry *e = entry_create(url, strlen(url), head, head_len, body, body_len, freshness);
+    if (e != NULL) {
+        entry_insert(e, NULL);
+    }
+}
+
+// 재검증된 항목을 새 헤더로 다시 저장. 호출한 쪽이 old 의 참조를 가지고 있으므로 본문은 그대로 복사 가능
+cache_entry *cache_refresh(cache_entry *old, const char *head, size_t head_len, const cache_freshness *freshness) {
+    const struct iovec *body = &old->iov[CACHE_IOV_BODY];
+    if (head_len + body->iov_len > max_object_size) {
+        return NULL;
+    }
+
+    cache_entry *e = entry_create(old->key, old->key_len, head, head_len, body->iov_base, body->iov_len, freshness);
+    if (e == NULL) {
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed); // 호출한 쪽의 참조
+    entry_insert(e, NULL);
+    atomic_fetch_add_explicit(&stat_refreshes, 1, memory_order_relaxed);
+    return e;
+}
+
+// 모든 항목과 샤드 해제 (다른 스레드가 캐시를 쓰지 않을 때만, 디스크 계층 없이)
+void cache_destroy(void) {
+    if (shards == NULL) {
+        return;
+    }
+    for (int i = 0; i < (1 << shard_bits); i++) {
+        cache_shard *s = &shards[i];
+        for (int seg = 0; seg < SEGMENT_COUNT; seg++) {
+            while (s->lru[seg].head != NULL) {
+                remove_entry(s, s->lru[seg].head);
+            }
+        }
+        free(s->buckets);
+        tinylfu_free(&s->sketch);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(shards);
+    shards = NULL;
+}
+
+void cache_print_stats(void) {
+    if (shards == NULL) {
+        return;
+    }
+
+    size_t bytes = 0;
+    size_t entries = 0;
+    size_t budget = 0;
+    for (int i = 0; i < (1 << shard_bits); i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        bytes += shards[i].bytes;
+        entries += shards[i].entry_count;
+        budget += shards[i].budget;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    printf("Cache entries=%zu bytes=%zu/%zu hits=%lu misses=%lu stores=%lu evictions=%lu rejections=%lu refreshes=%lu\n",
+           entries, bytes, budget,
+           atomic_load(&stat_hits), atomic_load(&stat_misses),
+           atomic_load(&stat_stores), atomic_load(&stat_evictions), atomic_load(&stat_rejections),
+           atomic_load(&stat_refreshes));
+    if (disk_tier_enabled()) {
+        pthread_mutex_lock(&io.lock);
+        int reads = io.read_count;
+        size_t demotion_bytes = io.demotion_bytes;
+        pthread_mutex_unlock(&io.lock);
+        printf("Cache I/O queued reads=%d demotion_bytes=%zu dropped_demotions=%lu\n",
+               reads, demotion_bytes, atomic_load(&stat_demote_dropped));
+    }
+    fflush(stdout);
+    disk_tier_print_stats();
+}
@@ -1,11 +1,109 @@
 #ifndef CACHE_H
 #define CACHE_H
 
-#define MAX_BUFFER_SIZE 1024
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/uio.h>
 
-void cache_init();
-int cache_lookup(const char *url, char *data);
-void cache_store(const char *url, const char *data);
+#define CACHE_DEFAULT_SHARDS 16
 
-#endif
+// 새 항목을 받아들이는 방식
+enum {
+    CACHE_ADMISSION_LRU,     // 모두 받아들이고 가장 오래전에 쓴 항목부터 제거
+    CACHE_ADMISSION_TINYLFU, // 작은 윈도우 LRU 를 지난 항목은 밀어낼 항목보다 자주 쓰였을 때만 남김 (W-TinyLFU)
+};
+
+enum {
+    CACHE_IOV_HEAD, // 시작 줄 + end-to-end 헤더 + Content-Length (마지막 빈 줄 제외)
+    CACHE_IOV_BODY,
+    CACHE_IOV_ETAG,          // 재검증용 검증자 (없으면 길이 0)
+    CACHE_IOV_LAST_MODIFIED,
+    CACHE_IOV_COUNT
+};
+
+// 저장할 응답의 신선도 정보 (freshness_evaluate 가 채움). 검증자는 저장할 때 항목 안으로 복사
+typedef struct {
+    time_t stored_at;        // 응답을 받은 시각
+    time_t expires;          // 이 시각부터 stale, 재검증해야 사용 가능
+    long initial_age;        // 받았을 때 이미 지난 나이(초), Age 헤더 계산용
+    time_t stale_while_revalidate; // 이 시각 전까지는 stale 이어도 먼저 보내고 뒤에서 갱신
+    time_t stale_if_error;   // 이 시각 전까지는 백엔드 오류 시 stale 항목으로 응답
+    const char *etag;
+    size_t etag_len;
+    const char *last_modified;
+    size_t last_modified_len;
+} cache_freshness;
+
+// 캐시 항목. 저장한 뒤에는 바뀌지 않고, 참조를 가진 동안은 캐시에서 빠져도 해제되지 않음
+typedef struct cache_entry {
+    uint64_t hash;
+    struct cache_entry *hash_next;  // 같은 버킷 체인
+    struct cache_entry *lru_prev;   // 최근 사용 쪽
+    struct cache_entry *lru_next;   // 오래된 쪽
+    int segment;                    // 속한 LRU 구간 (윈도우, 수습, 보호)
+    atomic_int refs;                // 캐시 테이블 1 + 전송 중인 연결 수
+    time_t stored_at;
+    time_t expires;
+    long initial_age;
+    time_t stale_while_revalidate;
+    time_t stale_if_error;
+    struct iovec iov[CACHE_IOV_COUNT]; // 헤더, 본문, 검증자 (key 뒤에 이어서 저장)
+    size_t key_len;
+    char key[];
+} cache_entry;
+
+// capacity: 전체 바이트 예산, max_object: 항목 하나의 최대 크기, shards: 락 분할 수 (2의 거듭제곱으로 올림)
+// admission: CACHE_ADMISSION_LRU 또는 CACHE_ADMISSION_TINYLFU
+int cache_init(size_t capacity, size_t max_object, int shards, int admission);
+void cache_destroy(void);
+
+// 디스크 계층에서 RAM 으로 올리는 읽기 하나 (cache_lookup_async)
+typedef struct cache_disk_read cache_disk_read;
+
+// RAM 에 항목이 있으면 참조를 하나 가져와 반환 (다 쓰면 cache_release), 없으면 NULL. 디스크 계층은 보지 않음
+cache_entry *cache_lookup(const char *url);
+void cache_release(cache_entry *e);
+
+// cache_lookup 과 같지만 RAM 에 없고 디스크 계층에 있을 수 있으면 캐시 I/O 스레드에 읽기를 맡기고 *read 에 둠
+// (NULL 반환). 읽기가 끝나면 wake_fd 에 써서 알리고, 호출한 쪽은 cache_disk_read_finish 로 결과를 받음
+cache_entry *cache_lookup_async(const char *url, int wake_fd, cache_disk_read **read);
+
+int cache_disk_read_done(const cache_disk_read *r);
+
+// 끝난 읽기의 결과(참조 하나, 없으면 NULL)를 가져오고 읽기를 놓음
+// 끝나기 전에 호출하면(기다리던 연결이 닫힘) NULL 을 반환하고, 결과는 I/O 스레드가 끝낼 때 버림
+cache_entry *cache_disk_read_finish(cache_disk_read *r);
 
+// freshness 가 NULL 이면 만료되지 않는 항목으로 저장
+void cache_store(const char *url, const char *head, size_t head_len, const char *body, size_t body_len,
+                 const cache_freshness *freshness);
+
+// 304 로 재검증된 항목을 새 헤더/신선도로 교체 (본문은 old 것을 그대로 사용). 참조를 하나 가진 새 항목 반환, 실패하면 NULL
+cache_entry *cache_refresh(cache_entry *old, const char *head, size_t head_len, const cache_freshness *freshness);
+
+static inline int cache_entry_fresh(const cache_entry *e, time_t now) {
+    return now < e->expires;
+}
+
+static inline void cache_retain(cache_entry *e) {
+    atomic_fetch_add_explicit(&e->refs, 1, memory_order_relaxed);
+}
+
+static inline int cache_entry_has_validator(const cache_entry *e) {
+    return e->iov[CACHE_IOV_ETAG].iov_len > 0 || e->iov[CACHE_IOV_LAST_MODIFIED].iov_len > 0;
+}
+
+// 지금 시각 기준 항목의 나이(초), 적중 응답의 Age 헤더 값
+static inline long cache_entry_age(const cache_entry *e, time_t now) {
+    return e->initial_age + (now > e->stored_at ? now - e->stored_at : 0);
+}
+
+// 캐시 키 해시 (64비트 FNV-1a)
+uint64_t cache_hash(const char *key, size_t len);
+
+size_t cache_max_object_size(void);
+void cache_print_stats(void);
+
+#endif
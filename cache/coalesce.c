@@ -0,0 +1,335 @@
+#include "coalesce.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define COALESCE_BUCKETS 256 // 동시에 진행 중인 요청 수만큼만 있으면 되므로 고정 크기
+#define COALESCE_BODY_MIN 16384 // 길이를 모르는 본문의 첫 버퍼 크기 (이후 두 배씩)
+
+// 본문 버퍼. 옮긴 뒤에도 읽는 쪽이 있을 수 있어 본문을 해제할 때 함께 해제
+struct coalesce_block {
+    struct coalesce_block *prev;
+    char data[];
+};
+
+// 최근에 캐시할 수 없는 응답을 받은 URL. 만료된 것은 같은 버킷에 합류할 때 정리
+typedef struct uncacheable_mark {
+    uint64_t hash;
+    long long until_ms;
+    struct uncacheable_mark *next;
+    size_t key_len;
+    char key[];
+} uncacheable_mark;
+
+typedef struct {
+    pthread_mutex_t lock;
+    coalesce_flight *head;
+    uncacheable_mark *marks;
+} flight_bucket;
+
+static flight_bucket buckets[COALESCE_BUCKETS];
+static long uncacheable_ttl_ms = 1000;
+
+static atomic_ulong stat_leaders;
+static atomic_ulong stat_coalesced;
+static atomic_ulong stat_timeouts;
+static atomic_ulong stat_uncacheable;
+static atomic_ulong stat_streamed;
+
+__attribute__((constructor))
+static void coalesce_init(void) {
+    for (int i = 0; i < COALESCE_BUCKETS; i++) {
+        pthread_mutex_init(&buckets[i].lock, NULL);
+    }
+}
+
+static flight_bucket *bucket_for(uint64_t hash) {
+    return &buckets[hash & (COALESCE_BUCKETS - 1)];
+}
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void coalesce_configure(long uncacheable_ms) {
+    uncacheable_ttl_ms = uncacheable_ms > 0 ? uncacheable_ms : 0;
+}
+
+// 버킷 락을 쥐고 호출. 만료된 표시는 지우면서 key 의 표시를 찾음
+static uncacheable_mark *find_mark(flight_bucket *b, uint64_t hash, const char *key, size_t key_len, long long now) {
+    uncacheable_mark **link = &b->marks;
+    uncacheable_mark *found = NULL;
+    while (*link != NULL) {
+        uncacheable_mark *m = *link;
+        if (now >= m->until_ms) {
+            *link = m->next;
+            free(m);
+            continue;
+        }
+        if (m->hash == hash && m->key_len == key_len && memcmp(m->key, key, key_len) == 0) {
+            found = m;
+        }
+        link = &m->next;
+    }
+    return found;
+}
+
+static void free_blocks(struct coalesce_block *block) {
+    while (block != NULL) {
+        struct coalesce_block *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+}
+
+coalesce_body *coalesce_body_create(size_t expected) {
+    coalesce_body *b = calloc(1, sizeof(coalesce_body));
+    if (b == NULL) {
+        return NULL;
+    }
+    atomic_init(&b->refs, 1);
+    atomic_init(&b->state, COALESCE_BODY_FILLING);
+    atomic_init(&b->data, NULL);
+    atomic_init(&b->len, 0);
+    if (expected > 0) {
+        b->blocks = malloc(sizeof(struct coalesce_block) + expected);
+        if (b->blocks == NULL) {
+            free(b);
+            return NULL;
+        }
+        b->blocks->prev = NULL;
+        b->cap = expected;
+        atomic_init(&b->data, b->blocks->data);
+    }
+    return b;
+}
+
+int coalesce_body_append(coalesce_body *b, const char *data, size_t len) {
+    size_t used = atomic_load_explicit(&b->len, memory_order_relaxed);
+    if (len == 0) {
+        return 0;
+    }
+    if (len > b->cap - used) {
+        size_t cap = b->cap > 0 ? b->cap : COALESCE_BODY_MIN;
+        while (cap - used < len) {
+            cap *= 2;
+        }
+        struct coalesce_block *block = malloc(sizeof(struct coalesce_block) + cap);
+        if (block == NULL) {
+            return -1;
+        }
+        if (used > 0) {
+            memcpy(block->data, b->blocks->data, used);
+        }
+        // 리더 혼자 가진 본문이면 옛 버퍼를 읽는 쪽이 없으므로 바로 해제
+        block->prev = atomic_load_explicit(&b->refs, memory_order_acquire) > 1 ? b->blocks : NULL;
+        if (block->prev == NULL) {
+            free_blocks(b->blocks);
+        }
+        b->blocks = block;
+        b->cap = cap;
+        atomic_store_explicit(&b->data, block->data, memory_order_release);
+    }
+    memcpy(b->blocks->data + used, data, len);
+    atomic_store_explicit(&b->len, used + len, memory_order_release);
+    return 0;
+}
+
+void coalesce_body_end(coalesce_body *b, int state) {
+    if (atomic_load_explicit(&b->state, memory_order_relaxed) == COALESCE_BODY_FILLING) {
+        atomic_store_explicit(&b->state, state, memory_order_release);
+    }
+}
+
+void coalesce_body_release(coalesce_body *b) {
+    if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) {
+        free_blocks(b->blocks);
+        free(b->head);
+        free(b);
+    }
+}
+
+static void flight_release(coalesce_flight *f) {
+    if (atomic_fetch_sub_explicit(&f->refs, 1, memory_order_acq_rel) == 1) {
+        coalesce_body *b = atomic_load_explicit(&f->body, memory_order_relaxed);
+        if (b != NULL) {
+            coalesce_body_release(b);
+        }
+        free(f);
+    }
+}
+
+// 대기 중인 연결이 있는 reactor 들을 깨움
+static void wake_waiters(coalesce_flight *f) {
+    flight_bucket *b = bucket_for(f->hash);
+    int wake_fds[COALESCE_MAX_WAKERS];
+    int count;
+
+    pthread_mutex_lock(&b->lock);
+    count = f->waker_count;
+    memcpy(wake_fds, f->wake_fds, count * sizeof(int));
+    pthread_mutex_unlock(&b->lock);
+
+    uint64_t one = 1;
+    for (int i = 0; i < count; i++) {
+        if (write(wake_fds[i], &one, sizeof(one)) < 0) {
+            perror("Failed to wake reactor");
+        }
+    }
+}
+
+// reactor 의 eventfd 를 깨울 목록에 추가 (이미 있으면 그대로). 목록이 가득 차면 -1
+static int add_waker(coalesce_flight *f, int wake_fd) {
+    for (int i = 0; i < f->waker_count; i++) {
+        if (f->wake_fds[i] == wake_fd) {
+            return 0;
+        }
+    }
+    if (f->waker_count == COALESCE_MAX_WAKERS) {
+        return -1;
+    }
+    f->wake_fds[f->waker_count++] = wake_fd;
+    return 0;
+}
+
+int coalesce_join(const char *url, int wake_fd, coalesce_flight **out) {
+    size_t key_len = strlen(url);
+    uint64_t hash = cache_hash(url, key_len);
+    flight_bucket *b = bucket_for(hash);
+
+    pthread_mutex_lock(&b->lock);
+    if (b->marks != NULL && find_mark(b, hash, url, key_len, monotonic_ms()) != NULL) {
+        pthread_mutex_unlock(&b->lock);
+        atomic_fetch_add_explicit(&stat_uncacheable, 1, memory_order_relaxed);
+        return COALESCE_BYPASS;
+    }
+    coalesce_flight *f = b->head;
+    while (f != NULL && !(f->hash == hash && f->key_len == key_len && memcmp(f->key, url, key_len) == 0)) {
+        f = f->next;
+    }
+
+    if (f != NULL) {
+        if (add_waker(f, wake_fd) < 0) {
+            pthread_mutex_unlock(&b->lock);
+            return COALESCE_BYPASS;
+        }
+        atomic_fetch_add_explicit(&f->refs, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&b->lock);
+        atomic_fetch_add_explicit(&stat_coalesced, 1, memory_order_relaxed);
+        *out = f;
+        return COALESCE_FOLLOWER;
+    }
+
+    f = malloc(sizeof(coalesce_flight) + key_len + 1);
+    if (f == NULL) {
+        pthread_mutex_unlock(&b->lock);
+        perror("Failed to allocate coalesce flight");
+        return COALESCE_BYPASS;
+    }
+    f->hash = hash;
+    atomic_init(&f->refs, 1); // 리더의 참조
+    atomic_init(&f->done, 0);
+    atomic_init(&f->body, NULL);
+    atomic_init(&f->wanted, 0);
+    f->waker_count = 0;
+    f->key_len = key_len;
+    memcpy(f->key, url, key_len + 1);
+    f->next = b->head;
+    b->head = f;
+    pthread_mutex_unlock(&b->lock);
+
+    atomic_fetch_add_explicit(&stat_leaders, 1, memory_order_relaxed);
+    *out = f;
+    return COALESCE_LEADER;
+}
+
+// 버킷 락을 쥐고 호출. 이미 있으면 시간만 늘림 (메모리가 없으면 표시하지 않고 계속 합침)
+static void mark_uncacheable(flight_bucket *b, coalesce_flight *f) {
+    long long now = monotonic_ms();
+    uncacheable_mark *m = find_mark(b, f->hash, f->key, f->key_len, now);
+    if (m == NULL) {
+        m = malloc(sizeof(uncacheable_mark) + f->key_len);
+        if (m == NULL) {
+            return;
+        }
+        m->hash = f->hash;
+        m->key_len = f->key_len;
+        memcpy(m->key, f->key, f->key_len);
+        m->next = b->marks;
+        b->marks = m;
+    }
+    m->until_ms = now + uncacheable_ttl_ms;
+}
+
+void coalesce_finish(coalesce_flight *f, int uncacheable) {
+    flight_bucket *b = bucket_for(f->hash);
+    coalesce_body *body = atomic_load_explicit(&f->body, memory_order_relaxed);
+    if (body != NULL) {
+        coalesce_body_end(body, COALESCE_BODY_ABORTED);
+    }
+
+    // 테이블에서 빼 두면 이후의 요청은 캐시를 보거나 새 리더가 됨
+    pthread_mutex_lock(&b->lock);
+    coalesce_flight **link = &b->head;
+    while (*link != f) {
+        link = &(*link)->next;
+    }
+    *link = f->next;
+    if (uncacheable && uncacheable_ttl_ms > 0) {
+        mark_uncacheable(b, f);
+    }
+    atomic_store_explicit(&f->done, 1, memory_order_release);
+    pthread_mutex_unlock(&b->lock);
+
+    wake_waiters(f);
+    flight_release(f);
+}
+
+int coalesce_publish(coalesce_flight *f, coalesce_body *b, const char *head, size_t head_len, int sized) {
+    b->head = malloc(head_len > 0 ? head_len : 1);
+    if (b->head == NULL) {
+        return -1;
+    }
+    memcpy(b->head, head, head_len);
+    b->head_len = head_len;
+    b->sized = sized;
+    atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed); // flight 의 참조
+    atomic_store_explicit(&f->body, b, memory_order_release);
+    atomic_fetch_add_explicit(&stat_streamed, 1, memory_order_relaxed);
+    wake_waiters(f);
+    return 0;
+}
+
+// 덧붙인 길이를 공개한 것과 기다린다는 표시를 서로 순서대로 보도록 양쪽 모두 fence (한쪽은 반드시 상대를 봄)
+void coalesce_notify(coalesce_flight *f) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&f->wanted, memory_order_relaxed) && atomic_exchange(&f->wanted, 0)) {
+        wake_waiters(f);
+    }
+}
+
+void coalesce_want(coalesce_flight *f) {
+    atomic_store_explicit(&f->wanted, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void coalesce_leave(coalesce_flight *f, int timed_out) {
+    if (timed_out) {
+        atomic_fetch_add_explicit(&stat_timeouts, 1, memory_order_relaxed);
+    }
+    flight_release(f);
+}
+
+void coalesce_print_stats(void) {
+    printf("Coalesce leaders=%lu coalesced=%lu streamed=%lu timeouts=%lu uncacheable=%lu\n",
+           atomic_load(&stat_leaders), atomic_load(&stat_coalesced), atomic_load(&stat_streamed),
+           atomic_load(&stat_timeouts), atomic_load(&stat_uncacheable));
+    fflush(stdout);
+}
@@ -0,0 +1,112 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define COALESCE_MAX_WAKERS 64 // 한 요청을 기다릴 수 있는 reactor 수 (넘으면 기다리지 않고 직접 가져옴)
+
+// coalesce_join 반환값
+enum {
+    COALESCE_LEADER, // 이 연결이 백엔드에서 가져오고 끝나면 coalesce_finish
+    COALESCE_FOLLOWER, // 다른 연결이 가져오는 중. 리더가 본문을 공개하거나 끝나면 wake_fd 로 알림을 받고, 다 쓰면 coalesce_leave
+    COALESCE_BYPASS  // 합칠 수 없음 (메모리 부족, 대기 reactor 초과, 최근 캐시할 수 없던 URL), 직접 가져옴
+};
+
+// coalesce_body 상태
+enum {
+    COALESCE_BODY_FILLING,  // 리더가 아직 받는 중
+    COALESCE_BODY_COMPLETE, // 본문을 끝까지 받음
+    COALESCE_BODY_ABORTED   // 리더가 중간에 그만둠 (캐시 항목 한도 초과, 백엔드 오류, 리더 연결 종료)
+};
+
+// 리더가 백엔드에서 받아 디코딩한 본문. 리더 스레드만 덧붙이고, 대기하던 연결은 락 없이 공개된 길이까지 읽어 중계
+// 커질 때는 새 버퍼로 옮기고 옛 버퍼는 마지막 참조를 놓을 때까지 두므로 읽는 쪽이 받은 포인터는 계속 유효
+typedef struct coalesce_body {
+    atomic_int refs;
+    atomic_int state;               // COALESCE_BODY_*. 끝난 뒤의 len 은 바뀌지 않음
+    _Atomic(char *) data;
+    atomic_size_t len;              // 공개된 바이트 수. data 를 바꾼 뒤에 늘림
+    size_t cap;                     // 아래 둘은 리더만 사용
+    struct coalesce_block *blocks;  // 현재 버퍼와 옮기기 전 버퍼들
+    char *head;                     // 대기하던 연결에 보낼 응답 헤더 (시작 줄, end-to-end 헤더, 빈 줄 제외. 공개 뒤 불변)
+    size_t head_len;
+    int sized;                      // head 에 본문 길이가 있음 (Content-Length 이거나 본문이 없는 응답)
+} coalesce_body;
+
+// 같은 캐시 키로 진행 중인 백엔드 요청 하나. 리더와 대기 중인 연결이 참조를 나눠 가짐
+// 캐시할 수 있는 응답이면 리더가 모으는 본문을 공개하고, 대기 중인 연결은 그것을 받는 대로 함께 중계함
+typedef struct coalesce_flight {
+    uint64_t hash;
+    struct coalesce_flight *next;   // 같은 버킷 체인
+    atomic_int refs;
+    atomic_int done;                // 리더가 끝냈는지 (본문을 다 받았거나 그만둠, 또는 캐시할 수 없음이 확인됨)
+    _Atomic(coalesce_body *) body;  // 리더가 공개한 본문 (참조 보유, 없으면 NULL)
+    atomic_int wanted;              // 공개된 본문을 다 보내고 더 기다리는 연결이 있음 (coalesce_notify 가 깨움)
+    int waker_count;
+    int wake_fds[COALESCE_MAX_WAKERS]; // 대기 중인 연결이 있는 reactor 의 eventfd
+    size_t key_len;
+    char key[];
+} coalesce_flight;
+
+// url 을 가져오는 중인 요청에 합류하거나 새 리더가 됨. wake_fd: 호출한 reactor 의 eventfd
+int coalesce_join(const char *url, int wake_fd, coalesce_flight **out);
+
+// 캐시할 수 없던 URL 을 합치지 않는 시간(ms). 0 이면 기억하지 않음 (reactor 스레드를 시작하기 전에)
+void coalesce_configure(long uncacheable_ms);
+
+// 리더가 끝났음을 알리고 대기 중인 reactor 들을 깨움 (리더의 참조도 놓음). 공개한 본문이 덜 찼으면 ABORTED
+// uncacheable 이면 이 URL 은 잠시(coalesce_configure) 합치지 않음. 기다려도 받을 수 있는 본문이 없으므로
+void coalesce_finish(coalesce_flight *f, int uncacheable);
+
+// 리더: 응답 헤더를 받아 본문을 모으기 시작함. head 를 복사해 b 에 붙이고 공개한 뒤 대기 중인 reactor 들을 깨움
+// sized: head 에 본문 길이가 있음. 메모리가 없으면 -1 (공개하지 않음, 대기 중인 연결은 끝날 때까지 기다림)
+int coalesce_publish(coalesce_flight *f, coalesce_body *b, const char *head, size_t head_len, int sized);
+
+// 리더: 공개한 본문에 덧붙인 뒤 호출. 더 기다리는 연결이 있으면 깨움
+void coalesce_notify(coalesce_flight *f);
+
+// 대기하던 연결: 공개된 본문을 다 보냄. 다음에 덧붙이면 깨워 달라고 표시 (표시한 뒤 길이를 다시 확인해야 함)
+void coalesce_want(coalesce_flight *f);
+
+static inline coalesce_body *coalesce_published(coalesce_flight *f) {
+    return atomic_load_explicit(&f->body, memory_order_acquire);
+}
+
+// 대기하던 연결이 결과를 받았거나 포기함
+void coalesce_leave(coalesce_flight *f, int timed_out);
+
+static inline int coalesce_done(const coalesce_flight *f) {
+    return atomic_load_explicit(&f->done, memory_order_acquire);
+}
+
+// 빈 본문 (참조 1). expected 는 미리 잡을 크기 (모르면 0). 메모리가 없으면 NULL
+coalesce_body *coalesce_body_create(size_t expected);
+
+// 리더만 호출. 메모리가 없으면 -1
+int coalesce_body_append(coalesce_body *b, const char *data, size_t len);
+
+// 리더만 호출. 아직 받는 중일 때만 COMPLETE 나 ABORTED 로 바꿈
+void coalesce_body_end(coalesce_body *b, int state);
+
+void coalesce_body_release(coalesce_body *b);
+
+static inline int coalesce_body_state(coalesce_body *b) {
+    return atomic_load_explicit(&b->state, memory_order_acquire);
+}
+
+// 공개된 바이트 수와 그만큼 읽을 수 있는 포인터. 상태를 먼저 읽었으면 그 상태 이후의 길이
+static inline size_t coalesce_body_read(coalesce_body *b, const char **data) {
+    size_t len = atomic_load_explicit(&b->len, memory_order_acquire);
+    *data = atomic_load_explicit(&b->data, memory_order_acquire);
+    return len;
+}
+
+static inline size_t coalesce_body_length(coalesce_body *b) {
+    return atomic_load_explicit(&b->len, memory_order_acquire);
+}
+
+void coalesce_print_stats(void);
+
+#endif
@@ -0,0 +1,389 @@
+#include "disk_tier.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DISK_MAGIC "RPCACHE3"
+#define DISK_ALIGN 64           // 레코드 시작 정렬
+#define DISK_BYTES_PER_SLOT 8192 // 데이터 영역 이만큼마다 인덱스 슬롯 하나
+#define DISK_MIN_SLOTS 1024
+#define DISK_PROBE 8            // 해시 위치에서 이어서 살펴볼 슬롯 수
+
+// 파일 구조: [슈퍼블록][인덱스 슬롯 배열][데이터 링]
+// 데이터 링은 가상 위치(vpos)로 계속 이어서 쓰고, 실제 위치는 vpos % data_size
+// head - data_size 보다 앞의 vpos 는 덮어쓰였으므로 무효 (따로 지우지 않음)
+// 쓰는 쪽은 disk_lock 을 쥐고 head 를 먼저 옮긴 뒤 쓰므로, 읽는 쪽은 락 없이 복사하고
+// 복사 전후로 head 를 보아 그사이 덮어쓰이기 시작했는지 확인 (seqlock 과 같은 방식)
+typedef struct {
+    char magic[8];
+    uint64_t file_size;
+    uint64_t slot_count;
+    uint64_t data_offset;
+    uint64_t data_size;
+    _Atomic uint64_t head;      // 다음 레코드를 쓸 가상 위치
+} disk_super;
+
+typedef struct {
+    _Atomic uint64_t hash;
+    _Atomic uint64_t vpos;      // 0 이면 빈 슬롯. 레코드를 다 쓴 뒤에 바꿈
+} disk_slot;
+
+// 데이터 링의 레코드 머리. 뒤에 키, 헤더, 본문, 검증자가 이어짐
+typedef struct {
+    uint64_t hash;
+    uint64_t vpos;              // 자기 위치. 슬롯과 다르면 다른 레코드가 덮어쓴 것
+    uint64_t checksum;          // 키와 헤더, 본문, 검증자의 해시. 전원이 나가 일부 페이지만 기록된 레코드를 걸러냄
+    int64_t stored_at;
+    int64_t expires;
+    int64_t initial_age;
+    int64_t stale_while_revalidate;
+    int64_t stale_if_error;
+    uint32_t key_len;
+    uint32_t lens[CACHE_IOV_COUNT];
+} disk_record;
+
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER; // 쓰는 쪽끼리만
+static char *map = NULL;
+static size_t map_size = 0;
+static disk_super *super = NULL;
+static disk_slot *slots = NULL;
+static char *data = NULL;
+static atomic_int index_ready; // 인덱스 페이지가 모두 메모리에 있는지 (disk_tier_prefault)
+
+static atomic_ulong stat_hits;
+static atomic_ulong stat_misses;
+static atomic_ulong stat_writes;
+static atomic_ulong stat_skipped;
+
+static size_t align_up(size_t n, size_t a) {
+    return (n + a - 1) & ~(a - 1);
+}
+
+// 파일 크기로 정해지는 배치 (슬롯 수, 데이터 영역 위치와 크기)
+static void geometry(size_t size, uint64_t *slot_count, uint64_t *data_offset, uint64_t *data_size) {
+    *slot_count = DISK_MIN_SLOTS;
+    while (*slot_count * DISK_BYTES_PER_SLOT < size / 2) {
+        *slot_count <<= 1;
+    }
+    *data_offset = align_up(sizeof(disk_super) + *slot_count * sizeof(disk_slot), 4096);
+    *data_size = (size - *data_offset) & ~(uint64_t)(DISK_ALIGN - 1);
+}
+
+static void format(size_t size) {
+    uint64_t slot_count, data_offset, data_size;
+    geometry(size, &slot_count, &data_offset, &data_size);
+
+    memset(map, 0, data_offset);
+    super->file_size = size;
+    super->slot_count = slot_count;
+    super->data_offset = data_offset;
+    super->data_size = data_size;
+    super->head = DISK_ALIGN; // vpos 0 은 빈 슬롯 표시로 씀
+    memcpy(super->magic, DISK_MAGIC, sizeof(super->magic));
+}
+
+int disk_tier_open(const char *path, size_t size) {
+    size = align_up(size, 4096);
+    if (size < 16 * 1024 * 1024) {
+        fprintf(stderr, "Disk cache tier needs at least 16 MB\n");
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("Failed to open disk cache file");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size != size && ftruncate(fd, size) < 0)) {
+        perror("Failed to size disk cache file");
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map disk cache file");
+        map = NULL;
+        return -1;
+    }
+    map_size = size;
+    madvise(map, size, MADV_RANDOM);
+    super = (disk_super *)map;
+
+    // 같은 크기로 만든 파일이면 인덱스와 데이터를 그대로 사용. 슈퍼블록만 읽고 나머지는 접근할 때 페이지 폴트로
+    // 배치는 크기로 정해지므로 파일에 적힌 값을 믿지 않고 다시 계산해 모두 같을 때만 (손상된 값으로 인덱스 밖을 읽지 않도록)
+    uint64_t slot_count, data_offset, data_size;
+    geometry(size, &slot_count, &data_offset, &data_size);
+    int reused = memcmp(super->magic, DISK_MAGIC, sizeof(super->magic)) == 0 && super->file_size == size &&
+                 super->slot_count == slot_count && super->data_offset == data_offset &&
+                 super->data_size == data_size && super->head >= DISK_ALIGN;
+    if (!reused) {
+        format(size);
+    }
+    slots = (disk_slot *)(map + sizeof(disk_super));
+    data = map + super->data_offset;
+    // 다시 연 파일의 인덱스는 미리 읽어 두기 시작하고, 다 올라왔는지는 I/O 스레드가 확인 (새로 만든 인덱스는 이미 메모리에)
+    madvise(map, super->data_offset, MADV_WILLNEED);
+    atomic_store(&index_ready, !reused);
+    printf("Disk cache tier %s: %zu bytes, %s\n", path, size, reused ? "reopened" : "formatted");
+    return 0;
+}
+
+void disk_tier_close(void) {
+    if (map != NULL) {
+        msync(map, map_size, MS_ASYNC);
+        munmap(map, map_size);
+        map = NULL;
+    }
+}
+
+int disk_tier_enabled(void) {
+    return map != NULL;
+}
+
+static size_t record_size(const disk_record *r) {
+    size_t size = sizeof(disk_record) + r->key_len;
+    for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+        size += r->lens[i];
+    }
+    return size;
+}
+
+// 항목의 키와 헤더, 본문, 검증자에 대한 64비트 FNV-1a
+static uint64_t entry_checksum(const cache_entry *e) {
+    uint64_t h = 14695981039346656037ULL;
+    const unsigned char *p = (const unsigned char *)e->key;
+    for (size_t i = 0; i < e->key_len; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    for (int part = 0; part < CACHE_IOV_COUNT; part++) {
+        p = e->iov[part].iov_base;
+        for (size_t i = 0; i < e->iov[part].iov_len; i++) {
+            h = (h ^ p[i]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+// vpos 의 레코드 자리를 다른 레코드가 덮어쓰기 시작했는지
+static int overwritten(uint64_t vpos) {
+    return vpos + super->data_size < atomic_load_explicit(&super->head, memory_order_acquire);
+}
+
+// 슬롯이 가리키는 레코드의 머리를 out 에 복사하고, 아직 덮어쓰이지 않았으면 레코드 위치를 반환
+// 머리는 복사본으로만 검사하므로 다른 스레드가 도중에 덮어써도 데이터 영역 밖을 읽지 않음
+static const char *slot_record(disk_slot *s, disk_record *out) {
+    uint64_t vpos = atomic_load_explicit(&s->vpos, memory_order_acquire);
+    uint64_t hash = atomic_load_explicit(&s->hash, memory_order_relaxed);
+    if (vpos == 0 || overwritten(vpos)) {
+        return NULL;
+    }
+    uint64_t offset = vpos % super->data_size;
+    if (offset + sizeof(disk_record) > super->data_size) {
+        return NULL;
+    }
+    const char *p = data + offset;
+    memcpy(out, p, sizeof(disk_record));
+    if (out->vpos != vpos || out->hash != hash || offset + record_size(out) > super->data_size) {
+        return NULL;
+    }
+    return p;
+}
+
+static int record_matches(const disk_record *r, const char *p, const char *key, size_t key_len) {
+    return r->key_len == key_len && memcmp(p + sizeof(disk_record), key, key_len) == 0;
+}
+
+// key 의 슬롯, 없으면 NULL. 레코드 머리는 record 에, 위치는 *at 에
+static disk_slot *find_slot(uint64_t hash, const char *key, size_t key_len, disk_record *record, const char **at) {
+    for (int i = 0; i < DISK_PROBE; i++) {
+        disk_slot *s = &slots[(hash + i) & (super->slot_count - 1)];
+        if (atomic_load_explicit(&s->hash, memory_order_relaxed) != hash) {
+            continue;
+        }
+        const char *p = slot_record(s, record);
+        if (p != NULL && record_matches(record, p, key, key_len)) {
+            *at = p;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// 새 레코드를 둘 슬롯: 빈 슬롯이나 덮어쓰인 슬롯, 없으면 가장 오래된 레코드의 슬롯 (disk_lock 을 쥐고)
+static disk_slot *victim_slot(uint64_t hash) {
+    disk_slot *oldest = NULL;
+    disk_record r;
+    for (int i = 0; i < DISK_PROBE; i++) {
+        disk_slot *s = &slots[(hash + i) & (super->slot_count - 1)];
+        if (slot_record(s, &r) == NULL) {
+            return s;
+        }
+        if (oldest == NULL || atomic_load_explicit(&s->vpos, memory_order_relaxed) <
+                                  atomic_load_explicit(&oldest->vpos, memory_order_relaxed)) {
+            oldest = s;
+        }
+    }
+    return oldest;
+}
+
+void disk_tier_put(const cache_entry *e) {
+    if (map == NULL) {
+        return;
+    }
+
+    disk_record header;
+    memset(&header, 0, sizeof(header));
+    header.hash = e->hash;
+    header.checksum = entry_checksum(e);
+    header.stored_at = e->stored_at;
+    header.expires = e->expires;
+    header.initial_age = e->initial_age;
+    header.stale_while_revalidate = e->stale_while_revalidate;
+    header.stale_if_error = e->stale_if_error;
+    header.key_len = e->key_len;
+    for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+        header.lens[i] = e->iov[i].iov_len;
+    }
+    size_t size = align_up(record_size(&header), DISK_ALIGN);
+    if (size > super->data_size / 4) {
+        return;
+    }
+
+    pthread_mutex_lock(&disk_lock);
+    // RAM 으로 올렸다가 다시 밀려난 항목이면 디스크에 이미 같은 것이 있음
+    disk_record existing;
+    const char *at;
+    disk_slot *slot = find_slot(e->hash, e->key, e->key_len, &existing, &at);
+    if (slot != NULL && existing.stored_at == e->stored_at) {
+        pthread_mutex_unlock(&disk_lock);
+        atomic_fetch_add_explicit(&stat_skipped, 1, memory_order_relaxed);
+        return;
+    }
+    if (slot == NULL) {
+        slot = victim_slot(e->hash);
+    }
+
+    // 링 끝에 다 들어가지 않으면 다음 바퀴의 처음부터
+    uint64_t vpos = atomic_load_explicit(&super->head, memory_order_relaxed);
+    uint64_t offset = vpos % super->data_size;
+    if (offset + size > super->data_size) {
+        vpos += super->data_size - offset;
+        offset = 0;
+    }
+    // 자리를 먼저 확보해 두면 쓰는 도중에 종료돼도 이 자리를 가리키는 슬롯은 없고,
+    // 이 자리에 있던 레코드를 읽는 중인 스레드는 복사한 뒤 head 를 보고 버림
+    atomic_store_explicit(&super->head, vpos + size, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    char *out = data + offset;
+    header.vpos = vpos;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, e->key, e->key_len);
+    out += e->key_len;
+    for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+        memcpy(out, e->iov[i].iov_base, e->iov[i].iov_len);
+        out += e->iov[i].iov_len;
+    }
+
+    atomic_store_explicit(&slot->hash, e->hash, memory_order_relaxed);
+    atomic_store_explicit(&slot->vpos, vpos, memory_order_release);
+    pthread_mutex_unlock(&disk_lock);
+    atomic_fetch_add_explicit(&stat_writes, 1, memory_order_relaxed);
+}
+
+// 락 없이 RAM 항목으로 복사. 복사하는 사이 쓰는 쪽이 이 자리를 차지했으면 사본을 버리고 없는 것으로
+cache_entry *disk_tier_get(const char *key, size_t key_len, disk_tier_loader load) {
+    if (map == NULL) {
+        return NULL;
+    }
+
+    uint64_t hash = cache_hash(key, key_len);
+    cache_entry *e = NULL;
+    disk_record r;
+    const char *at;
+    if (find_slot(hash, key, key_len, &r, &at) != NULL) {
+        const char *parts[CACHE_IOV_COUNT];
+        const char *p = at + sizeof(disk_record) + r.key_len;
+        for (int i = 0; i < CACHE_IOV_COUNT; i++) {
+            parts[i] = p;
+            p += r.lens[i];
+        }
+
+        cache_freshness f;
+        f.stored_at = r.stored_at;
+        f.expires = r.expires;
+        f.initial_age = r.initial_age;
+        f.stale_while_revalidate = r.stale_while_revalidate;
+        f.stale_if_error = r.stale_if_error;
+        f.etag = parts[CACHE_IOV_ETAG];
+        f.etag_len = r.lens[CACHE_IOV_ETAG];
+        f.last_modified = parts[CACHE_IOV_LAST_MODIFIED];
+        f.last_modified_len = r.lens[CACHE_IOV_LAST_MODIFIED];
+        e = load(key, key_len, parts[CACHE_IOV_HEAD], r.lens[CACHE_IOV_HEAD], parts[CACHE_IOV_BODY],
+                 r.lens[CACHE_IOV_BODY], &f);
+
+        // 복사하는 사이 덮어쓰이기 시작했거나, 비정상 종료로 레코드 일부만 디스크에 남은 경우는 버림
+        atomic_thread_fence(memory_order_acquire);
+        if (e != NULL && (overwritten(r.vpos) || entry_checksum(e) != r.checksum)) {
+            cache_release(e);
+            e = NULL;
+        }
+    }
+
+    atomic_fetch_add_explicit(e != NULL ? &stat_hits : &stat_misses, 1, memory_order_relaxed);
+    return e;
+}
+
+void disk_tier_prefault(void) {
+    if (map == NULL || atomic_load(&index_ready)) {
+        return;
+    }
+    volatile const char *p = map;
+    for (uint64_t offset = 0; offset < super->data_offset; offset += 4096) {
+        (void)p[offset];
+    }
+    atomic_store(&index_ready, 1);
+}
+
+int disk_tier_may_contain(uint64_t hash) {
+    if (map == NULL) {
+        return 0;
+    }
+    // 인덱스를 아직 메모리에 올리지 않았으면 읽다가 멈추지 않도록 확인 없이 I/O 스레드에 맡김
+    if (!atomic_load_explicit(&index_ready, memory_order_acquire)) {
+        return 1;
+    }
+    for (int i = 0; i < DISK_PROBE; i++) {
+        disk_slot *s = &slots[(hash + i) & (super->slot_count - 1)];
+        uint64_t vpos = atomic_load_explicit(&s->vpos, memory_order_relaxed);
+        if (atomic_load_explicit(&s->hash, memory_order_relaxed) == hash && vpos != 0 && !overwritten(vpos)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void disk_tier_print_stats(void) {
+    if (map == NULL) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&super->head, memory_order_relaxed);
+    uint64_t data_size = super->data_size;
+
+    printf("Disk cache laps=%lu hits=%lu misses=%lu writes=%lu skipped=%lu\n",
+           (unsigned long)(head / data_size),
+           atomic_load(&stat_hits), atomic_load(&stat_misses),
+           atomic_load(&stat_writes), atomic_load(&stat_skipped));
+    fflush(stdout);
+}
@@ -0,0 +1,32 @@
+#ifndef DISK_TIER_H
+#define DISK_TIER_H
+
+#include <stddef.h>
+#include "cache.h"
+
+// 디스크 항목을 RAM 항목으로 만드는 함수. 인자는 매핑된 파일 안을 가리키며 호출 중에만 유효
+typedef cache_entry *(*disk_tier_loader)(const char *key, size_t key_len, const char *head, size_t head_len,
+                                         const char *body, size_t body_len, const cache_freshness *freshness);
+
+// path 의 캐시 파일을 매핑. 형식이 맞으면 기존 항목을 그대로 쓰고(파일을 읽지 않고 필요한 페이지만 접근), 아니면 새로 초기화
+int disk_tier_open(const char *path, size_t size);
+void disk_tier_close(void);
+int disk_tier_enabled(void);
+
+// RAM 에서 밀려난 항목을 기록. 같은 내용이 이미 있으면 건너뜀 (캐시 I/O 스레드에서)
+void disk_tier_put(const cache_entry *e);
+
+// key 의 항목을 찾으면 load 로 RAM 항목을 만들어 반환, 없으면 NULL
+// 레코드를 읽느라 페이지 폴트로 멈출 수 있으므로 reactor 스레드가 아닌 캐시 I/O 스레드에서 호출
+cache_entry *disk_tier_get(const char *key, size_t key_len, disk_tier_loader load);
+
+// 인덱스에 hash 의 살아 있는 레코드가 있는지. 레코드는 읽지 않으므로 해시가 같은 다른 키여도 1
+// reactor 스레드에서 호출. 다시 연 파일의 인덱스가 아직 메모리에 없으면(disk_tier_prefault 전) 보지 않고 1
+int disk_tier_may_contain(uint64_t hash);
+
+// 인덱스 페이지를 모두 메모리로 올림. 캐시 I/O 스레드가 시작할 때 호출
+void disk_tier_prefault(void);
+
+void disk_tier_print_stats(void);
+
+#endif
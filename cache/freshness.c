@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "freshness.h"
+
+#define DELTA_SECONDS_MAX 2147483647L // RFC 9111 1.2.2: 이보다 크면 이 값으로 취급
+
+static long default_ttl = 60;
+static long default_stale_while_revalidate = 0;
+static long default_stale_if_error = 0;
+
+void freshness_configure(long ttl, long stale_while_revalidate, long stale_if_error) {
+    default_ttl = ttl < 0 ? 0 : ttl;
+    default_stale_while_revalidate = stale_while_revalidate < 0 ? 0 : stale_while_revalidate;
+    default_stale_if_error = stale_if_error < 0 ? 0 : stale_if_error;
+}
+
+// Cache-Control 지시자 중 프록시가 쓰는 것 (숫자 값이 없으면 -1)
+typedef struct {
+    int no_store;
+    int no_cache;
+    int is_private;
+    int is_public;
+    int must_revalidate;
+    long max_age;
+    long s_maxage;
+    long stale_while_revalidate; // RFC 5861
+    long stale_if_error;
+} cache_control;
+
+// 숫자만으로 된 초 단위 값, 형식이 틀리면 -1
+static long parse_delta_seconds(const char *s, size_t len) {
+    if (len == 0) {
+        return -1;
+    }
+    long n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return -1;
+        }
+        if (n < DELTA_SECONDS_MAX) {
+            n = n * 10 + (s[i] - '0');
+        }
+    }
+    return n < DELTA_SECONDS_MAX ? n : DELTA_SECONDS_MAX;
+}
+
+static void apply_directive(cache_control *cc, const char *name, size_t name_len, const char *value, size_t value_len) {
+#define IS(d) (name_len == sizeof(d) - 1 && strncasecmp(name, d, name_len) == 0)
+    if (IS("no-store")) {
+        cc->no_store = 1;
+    } else if (IS("no-cache")) {
+        // no-cache="필드" 도 항목 전체를 재검증 대상으로 (보수적으로)
+        cc->no_cache = 1;
+    } else if (IS("private")) {
+        cc->is_private = 1;
+    } else if (IS("public")) {
+        cc->is_public = 1;
+    } else if (IS("must-revalidate") || IS("proxy-revalidate")) {
+        cc->must_revalidate = 1;
+    } else if (IS("max-age")) {
+        cc->max_age = parse_delta_seconds(value, value_len);
+    } else if (IS("s-maxage")) {
+        cc->s_maxage = parse_delta_seconds(value, value_len);
+    } else if (IS("stale-while-revalidate")) {
+        cc->stale_while_revalidate = parse_delta_seconds(value, value_len);
+    } else if (IS("stale-if-error")) {
+        cc->stale_if_error = parse_delta_seconds(value, value_len);
+    }
+#undef IS
+}
+
+// 모든 Cache-Control 헤더의 지시자(name[=token|quoted-string])를 모음
+static void parse_cache_control(const http_parser *p, const char *buf, cache_control *cc) {
+    memset(cc, 0, sizeof(*cc));
+    cc->max_age = -1;
+    cc->s_maxage = -1;
+    cc->stale_while_revalidate = -1;
+    cc->stale_if_error = -1;
+
+    for (int i = 0; i < p->header_count; i++) {
+        const http_header *h = &p->headers[i];
+        if (h->name.len != 13 || strncasecmp(buf + h->name.off, "Cache-Control", 13) != 0) {
+            continue;
+        }
+        const char *it = buf + h->value.off;
+        const char *end = it + h->value.len;
+        while (it < end) {
+            while (it < end && (*it == ' ' || *it == '\t' || *it == ',')) {
+                it++;
+            }
+            const char *name = it;
+            while (it < end && *it != '=' && *it != ',' && *it != ' ' && *it != '\t') {
+                it++;
+            }
+            size_t name_len = it - name;
+            const char *value = it;
+            size_t value_len = 0;
+            if (it < end && *it == '=') {
+                it++;
+                if (it < end && *it == '"') {
+                    value = ++it;
+                    while (it < end && *it != '"') {
+                        it += (*it == '\\' && it + 1 < end) ? 2 : 1;
+                    }
+                    value_len = it - value;
+                    if (it < end) {
+                        it++;
+                    }
+                } else {
+                    value = it;
+                    while (it < end && *it != ',' && *it != ' ' && *it != '\t') {
+                        it++;
+                    }
+                    value_len = it - value;
+                }
+            }
+            // 다음 쉼표까지 남은 부분은 무시
+            while (it < end && *it != ',') {
+                it++;
+            }
+            if (name_len > 0) {
+                apply_directive(cc, name, name_len, value, value_len);
+            }
+        }
+    }
+}
+
+// HTTP-date (IMF-fixdate, RFC 850, asctime). 해석할 수 없으면 -1
+static time_t parse_http_date(const char *s, size_t len) {
+    static const char *formats[] = {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y"};
+    char text[64];
+    if (len == 0 || len >= sizeof(text)) {
+        return -1;
+    }
+    memcpy(text, s, len);
+    text[len] = '\0';
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *end = strptime(text, formats[i], &tm);
+        if (end != NULL && *end == '\0') {
+            return timegm(&tm);
+        }
+    }
+    return -1;
+}
+
+static time_t header_date(const http_parser *p, const char *buf, const char *name) {
+    const http_header *h = http_header_find(p, buf, name);
+    return h != NULL ? parse_http_date(buf + h->value.off, h->value.len) : -1;
+}
+
+// 명시적인 유효 시간 없이도 저장할 수 있는 상태 코드 (RFC 9110 15.1, 206 은 Range 를 다루지 않으므로 제외)
+static int status_cacheable(int status) {
+    switch (status) {
+        case 200: case 203: case 204: case 300: case 301: case 308:
+        case 404: case 405: case 410: case 414: case 501:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int freshness_request_no_cache(const http_parser *req, const char *req_buf) {
+    cache_control cc;
+    parse_cache_control(req, req_buf, &cc);
+    if (cc.no_cache || cc.max_age == 0) {
+        return 1;
+    }
+    const http_header *pragma = http_header_find(req, req_buf, "Pragma");
+    return pragma != NULL && http_has_token(req_buf + pragma->value.off, pragma->value.len, "no-cache");
+}
+
+int freshness_evaluate(const http_parser *req, const char *req_buf, const http_parser *resp, const char *resp_buf,
+                       time_t request_time, time_t response_time, cache_freshness *f) {
+    if (!status_cacheable(resp->status)) {
+        return 0;
+    }
+
+    cache_control req_cc;
+    cache_control cc;
+    parse_cache_control(req, req_buf, &req_cc);
+    parse_cache_control(resp, resp_buf, &cc);
+    if (req_cc.no_store || cc.no_store || cc.is_private) {
+        return 0;
+    }
+    // 인증된 요청의 응답은 명시적으로 공유를 허락한 경우에만 (RFC 9111 3.5)
+    if (http_header_find(req, req_buf, "Authorization") != NULL && !cc.is_public && !cc.must_revalidate && cc.s_maxage < 0) {
+        return 0;
+    }
+    // 캐시 키가 URL 뿐이라 요청 헤더마다 달라지는 응답은 구분할 수 없음
+    const http_header *vary = http_header_find(resp, resp_buf, "Vary");
+    if (vary != NULL && vary->value.len > 0) {
+        return 0;
+    }
+
+    time_t date = header_date(resp, resp_buf, "Date");
+    if (date < 0) {
+        date = response_time;
+    }
+
+    // 유효 시간: s-maxage > max-age > Expires - Date > 휴리스틱 (RFC 9111 4.2.1)
+    long lifetime;
+    if (cc.no_cache) {
+        lifetime = 0;
+    } else if (cc.s_maxage >= 0) {
+        lifetime = cc.s_maxage;
+    } else if (cc.max_age >= 0) {
+        lifetime = cc.max_age;
+    } else if (http_header_find(resp, resp_buf, "Expires") != NULL) {
+        // 잘못된 Expires 는 이미 만료된 것으로 취급
+        time_t expires = header_date(resp, resp_buf, "Expires");
+        lifetime = expires > date ? (long)(expires - date) : 0;
+    } else {
+        // Last-Modified 이후 지난 시간의 10% (RFC 9111 4.2.2), default_ttl 을 넘지 않게
+        time_t last_modified = header_date(resp, resp_buf, "Last-Modified");
+        lifetime = default_ttl;
+        if (last_modified >= 0 && date > last_modified && (date - last_modified) / 10 < lifetime) {
+            lifetime = (date - last_modified) / 10;
+        }
+    }
+
+    // 받았을 때 이미 지난 나이 (RFC 9111 4.2.3)
+    long age_value = 0;
+    const http_header *age = http_header_find(resp, resp_buf, "Age");
+    if (age != NULL) {
+        age_value = parse_delta_seconds(resp_buf + age->value.off, age->value.len);
+        if (age_value < 0) {
+            age_value = 0;
+        }
+    }
+    long apparent_age = response_time > date ? (long)(response_time - date) : 0;
+    long corrected_age = age_value + (response_time > request_time ? (long)(response_time - request_time) : 0);
+    f->initial_age = apparent_age > corrected_age ? apparent_age : corrected_age;
+    f->stored_at = response_time;
+    f->expires = lifetime > f->initial_age ? response_time + (lifetime - f->initial_age) : response_time;
+
+    // 만료 뒤 재검증 없이 쓰는 것을 금지한 응답(s-maxage 는 proxy-revalidate 를 포함)에는 stale 기간을 두지 않음
+    if (cc.must_revalidate || cc.no_cache || cc.s_maxage >= 0) {
+        f->stale_while_revalidate = f->expires;
+        f->stale_if_error = f->expires;
+    } else {
+        long swr = cc.stale_while_revalidate >= 0 ? cc.stale_while_revalidate : default_stale_while_revalidate;
+        long sie = cc.stale_if_error >= 0 ? cc.stale_if_error : default_stale_if_error;
+        f->stale_while_revalidate = f->expires + swr;
+        f->stale_if_error = f->expires + sie;
+    }
+
+    const http_header *etag = http_header_find(resp, resp_buf, "ETag");
+    const http_header *last_modified = http_header_find(resp, resp_buf, "Last-Modified");
+    f->etag = etag != NULL ? resp_buf + etag->value.off : NULL;
+    f->etag_len = etag != NULL ? etag->value.len : 0;
+    f->last_modified = last_modified != NULL ? resp_buf + last_modified->value.off : NULL;
+    f->last_modified_len = last_modified != NULL ? last_modified->value.len : 0;
+
+    // 바로 stale 인데 재검증할 방법도 없고 stale 로 쓸 수도 없으면 저장해도 쓸 일이 없음
+    return f->expires > response_time || f->etag_len > 0 || f->last_modified_len > 0 || f->stale_if_error > response_time;
+}
@@ -0,0 +1,21 @@
+#ifndef FRESHNESS_H
+#define FRESHNESS_H
+
+#include <time.h>
+#include "cache.h"
+#include "../http/http_parser.h"
+
+// default_ttl: Cache-Control/Expires 가 없는 응답의 유효 시간(초) 상한
+// stale_while_revalidate, stale_if_error: 응답에 해당 지시자가 없을 때 만료 뒤 stale 항목을 쓸 수 있는 기간(초)
+void freshness_configure(long default_ttl, long stale_while_revalidate, long stale_if_error);
+
+// 공유 캐시 규칙(RFC 9111)으로 응답을 저장할 수 있는지 판단. 저장 가능하면 f 를 채우고 1, 아니면 0
+// request_time: 백엔드로 요청을 보낸 시각, response_time: 응답 헤더를 받은 시각
+// f 의 검증자는 resp_buf 안을 가리키므로 resp_buf 가 그대로인 동안만 유효
+int freshness_evaluate(const http_parser *req, const char *req_buf, const http_parser *resp, const char *resp_buf,
+                       time_t request_time, time_t response_time, cache_freshness *f);
+
+// 요청이 캐시된 응답을 재검증 없이 쓰지 말라고 했는지 (no-cache, max-age=0, Pragma: no-cache)
+int freshness_request_no_cache(const http_parser *req, const char *req_buf);
+
+#endif
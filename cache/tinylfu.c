@@ -0,0 +1,105 @@
+#include "tinylfu.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TINYLFU_MIN_CAPACITY 64
+#define TINYLFU_SAMPLE_FACTOR 10  // 항목 수의 이 배만큼 기록하면 aging
+#define TINYLFU_DEPTH 4
+#define TINYLFU_COUNTER_MAX 15
+
+// 줄마다 다른 씨앗으로 키 해시를 다시 섞어 서로 다른 word/카운터를 고름
+static const uint64_t seeds[TINYLFU_DEPTH] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+};
+
+static size_t table_length(size_t capacity) {
+    size_t length = TINYLFU_MIN_CAPACITY;
+    while (length < capacity) {
+        length <<= 1;
+    }
+    return length;
+}
+
+int tinylfu_init(tinylfu_sketch *sk, size_t capacity) {
+    size_t length = table_length(capacity);
+    sk->table = calloc(length, sizeof(uint64_t));
+    if (sk->table == NULL) {
+        perror("Failed to allocate frequency sketch");
+        return -1;
+    }
+    sk->mask = length - 1;
+    sk->sample_size = length * TINYLFU_SAMPLE_FACTOR;
+    sk->additions = 0;
+    return 0;
+}
+
+void tinylfu_free(tinylfu_sketch *sk) {
+    free(sk->table);
+    sk->table = NULL;
+}
+
+void tinylfu_ensure_capacity(tinylfu_sketch *sk, size_t capacity) {
+    if (capacity <= sk->mask + 1) {
+        return;
+    }
+    size_t length = table_length(capacity);
+    uint64_t *table = malloc(length * sizeof(uint64_t));
+    if (table == NULL) {
+        return;
+    }
+    // 키의 word 위치는 hash & mask 이므로 커진 table 의 j 번째 word 에 있을 카운터는 옛 table 의 j & 옛 mask 번째에 있었음
+    // 두 배가 된 table 의 양쪽 절반에 옛 word 를 복사하면 모든 키의 추정값이 그대로 남음 (aging 처럼 절반으로)
+    for (size_t j = 0; j < length; j++) {
+        table[j] = (sk->table[j & sk->mask] >> 1) & 0x7777777777777777ULL;
+    }
+    free(sk->table);
+    sk->table = table;
+    sk->mask = length - 1;
+    sk->sample_size = length * TINYLFU_SAMPLE_FACTOR;
+    sk->additions /= 2;
+}
+
+// i 번째 줄에서 hash 의 카운터가 있는 word 와 그 안의 비트 위치
+static uint64_t *counter_at(const tinylfu_sketch *sk, uint64_t hash, int i, int *shift) {
+    uint64_t h = (hash + seeds[i]) * seeds[i];
+    h ^= h >> 32;
+    *shift = (int)(h >> 60) * 4;
+    return &sk->table[h & sk->mask];
+}
+
+// 모든 카운터를 절반으로
+static void age(tinylfu_sketch *sk) {
+    for (size_t i = 0; i <= sk->mask; i++) {
+        sk->table[i] = (sk->table[i] >> 1) & 0x7777777777777777ULL;
+    }
+    sk->additions /= 2;
+}
+
+void tinylfu_increment(tinylfu_sketch *sk, uint64_t hash) {
+    int added = 0;
+    for (int i = 0; i < TINYLFU_DEPTH; i++) {
+        int shift;
+        uint64_t *word = counter_at(sk, hash, i, &shift);
+        if (((*word >> shift) & 0xf) < TINYLFU_COUNTER_MAX) {
+            *word += 1ULL << shift;
+            added = 1;
+        }
+    }
+    // 이미 최대인 키는 합에 더하지 않아 인기 항목만으로 aging 이 앞당겨지지 않게
+    if (added && ++sk->additions >= sk->sample_size) {
+        age(sk);
+    }
+}
+
+int tinylfu_frequency(const tinylfu_sketch *sk, uint64_t hash) {
+    int frequency = TINYLFU_COUNTER_MAX;
+    for (int i = 0; i < TINYLFU_DEPTH; i++) {
+        int shift;
+        uint64_t *word = counter_at(sk, hash, i, &shift);
+        int count = (int)((*word >> shift) & 0xf);
+        if (count < frequency) {
+            frequency = count;
+        }
+    }
+    return frequency;
+}
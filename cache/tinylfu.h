@@ -0,0 +1,28 @@
+#ifndef TINYLFU_H
+#define TINYLFU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 캐시 키별 최근 사용 빈도 추정 (count-min sketch, 4비트 카운터 4줄)
+// 카운터 합이 sample_size 에 이르면 모두 절반으로 줄여(aging) 오래전의 인기는 잊음
+// 락은 가지지 않음. 캐시 샤드 락 안에서만 사용
+typedef struct {
+    uint64_t *table;     // 한 word 에 4비트 카운터 16개
+    size_t mask;         // table 길이 - 1 (2의 거듭제곱)
+    size_t sample_size;
+    size_t additions;
+} tinylfu_sketch;
+
+// capacity: 추적할 항목 수 (table 길이를 이 이상의 2의 거듭제곱으로)
+int tinylfu_init(tinylfu_sketch *sk, size_t capacity);
+void tinylfu_free(tinylfu_sketch *sk);
+
+// 항목 수가 늘어 capacity 가 table 보다 커지면 두 배씩 키움. 카운터는 절반으로 줄여 옮기므로
+// 키운 직후에도 인기 항목의 빈도가 남음. 실패하면 그대로
+void tinylfu_ensure_capacity(tinylfu_sketch *sk, size_t capacity);
+
+void tinylfu_increment(tinylfu_sketch *sk, uint64_t hash);
+int tinylfu_frequency(const tinylfu_sketch *sk, uint64_t hash);
+
+#endif
@@ -0,0 +1,2133 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include "connection.h"
+#include "../cache/cache.h"
+#include "../cache/freshness.h"
+#include "../load_balancer/load_balancer.h"
+#include "../upstream/retry_policy.h"
+
+#define REQUEST_READ_MIN 1024   // 요청 버퍼에 이만큼 빈 공간이 없으면 키운 뒤 read
+#define MAX_REQUEST_SIZE 65536
+#define RESPONSE_READ_MIN 4096  // 응답 헤더 버퍼도 마찬가지 (첫 read 부터 16K 슬랩)
+#define MAX_RESPONSE_HEAD 65536
+
+// 백엔드 응답 본문의 끝을 판단하는 방식
+enum {
+    BODY_NONE,      // 본문 없음 (HEAD, 1xx, 204, 304)
+    BODY_LENGTH,    // Content-Length
+    BODY_CHUNKED,   // Transfer-Encoding: chunked
+    BODY_UNTIL_EOF  // 백엔드가 닫을 때까지
+};
+
+extern int CACHE_ENABLED;
+extern int KEEPALIVE_TIMEOUT;
+extern int KEEPALIVE_MAX_REQUESTS;
+extern int SPLICE_ENABLED;
+extern int COALESCE_ENABLED;
+extern int COALESCE_TIMEOUT_MS;
+extern char LB_HASH_KEY[64];
+extern int UPSTREAM_RETRIES;
+extern int HEDGE_ENABLED;
+
+static void on_request_readable(connection *c);
+static void on_backend_connected(connection *c);
+static void on_upstream_writable(connection *c);
+static void on_response_head_readable(connection *c);
+static void on_hedge_event(connection *c);
+static void relay_response(connection *c);
+static size_t relay_space(connection *c);
+static void serve_request(connection *c, int may_coalesce);
+static void cancel_hedge(connection *c, int result);
+static void publish_fill(connection *c);
+static void start_stream(connection *c, coalesce_body *b, int state);
+static void relay_stream(connection *c);
+
+// need 바이트 + 종료 문자를 담을 수 있도록 버퍼 확장. 버퍼는 reactor 의 슬랩 아레나에서 받음
+static int buffer_reserve(connection *c, char **buf, size_t *cap, size_t len, size_t need) {
+    return buffer_pool_grow(&c->reactor->buffers, buf, cap, len, need + 1);
+}
+
+static void buffer_release(connection *c, char **buf, size_t *cap) {
+    buffer_pool_release(&c->reactor->buffers, buf, cap);
+}
+
+static int buffer_append(connection *c, char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (buffer_reserve(c, buf, cap, *len, *len + n) < 0) {
+        return -1;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return 0;
+}
+
+// 프록시 구간마다 새로 정해야 하는 hop-by-hop 헤더
+static int is_hop_header(const char *name, size_t len) {
+    static const char *names[] = {"Connection", "Keep-Alive", "Proxy-Connection"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        size_t n = strlen(names[i]);
+        if (len == n && strncasecmp(name, names[i], n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// copy_end_to_end_headers 에서 hop-by-hop 헤더와 함께 지울 헤더
+enum {
+    DROP_FOR_CACHE = 1,   // 캐시 항목에 저장할 때: 본문 길이와 Age 는 전송할 때 새로 정함
+    DROP_CONDITIONAL = 2  // 프록시가 재검증 조건을 직접 붙일 때: 클라이언트의 조건 헤더
+};
+
+static int header_is(const char *name, size_t len, const char *target) {
+    size_t n = strlen(target);
+    return len == n && strncasecmp(name, target, n) == 0;
+}
+
+static int is_dropped_header(const char *name, size_t len, int drop) {
+    if (is_hop_header(name, len)) {
+        return 1;
+    }
+    if ((drop & DROP_FOR_CACHE) && (header_is(name, len, "Content-Length") || header_is(name, len, "Transfer-Encoding") ||
+                                    header_is(name, len, "Age"))) {
+        return 1;
+    }
+    return (drop & DROP_CONDITIONAL) && (header_is(name, len, "If-None-Match") || header_is(name, len, "If-Modified-Since"));
+}
+
+// 해석한 헤더 중 hop-by-hop 과 drop 에 해당하는 헤더를 제외하고 "이름: 값" 줄로 복사 (시작 줄과 마지막 빈 줄 제외)
+static int copy_end_to_end_headers(connection *c, char **buf, size_t *len, size_t *cap, const char *base, const http_parser *head,
+                                   int drop) {
+    for (int i = 0; i < head->header_count; i++) {
+        const http_header *h = &head->headers[i];
+        if (is_dropped_header(base + h->name.off, h->name.len, drop)) {
+            continue;
+        }
+        if (buffer_append(c, buf, len, cap, base + h->name.off, h->name.len) < 0 ||
+            buffer_append(c, buf, len, cap, ": ", 2) < 0 ||
+            buffer_append(c, buf, len, cap, base + h->value.off, h->value.len) < 0 ||
+            buffer_append(c, buf, len, cap, "\r\n", 2) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 시작 줄(줄바꿈 포함) 복사
+static int copy_start_line(connection *c, char **buf, size_t *len, size_t *cap, const char *base, size_t start, size_t head_len) {
+    const char *eol = memchr(base + start, '\n', head_len - start);
+    size_t line_len = eol != NULL ? (size_t)(eol - base - start + 1) : head_len - start;
+    return buffer_append(c, buf, len, cap, base + start, line_len);
+}
+
+connection *connection_create(reactor *r, int client_sock) {
+    connection *c = calloc(1, sizeof(connection));
+    if (c == NULL) {
+        perror("Failed to allocate connection");
+        return NULL;
+    }
+
+    c->state = CONN_READING_REQUEST;
+    c->reactor = r;
+    c->client.fd = client_sock;
+    c->client.kind = ENDPOINT_CLIENT;
+    c->client.conn = c;
+    c->backend.fd = -1;
+    c->backend.kind = ENDPOINT_BACKEND;
+    c->backend.conn = c;
+    c->hedge.fd = -1;
+    c->hedge.kind = ENDPOINT_BACKEND;
+    c->hedge.conn = c;
+    c->pipe_fds[0] = -1;
+    c->pipe_fds[1] = -1;
+    c->last_active = time(NULL);
+    http_parser_init(&c->request_head, HTTP_REQUEST);
+
+    if (reactor_watch(r, &c->client, EPOLLIN) < 0) {
+        free(c);
+        return NULL;
+    }
+
+    c->next = r->active;
+    if (r->active != NULL) {
+        r->active->prev = c;
+    }
+    r->active = c;
+    r->connection_count++;
+    return c;
+}
+
+// 백엔드 연결을 닫음 (풀의 연결 수도 함께 감소)
+static void close_backend(connection *c) {
+    if (c->backend.fd >= 0) {
+        int fd = c->backend.fd;
+        reactor_unwatch(c->reactor, &c->backend);
+        c->backend.fd = -1;
+        upstream_pool_discard(c->pool, fd);
+    }
+}
+
+// 응답을 끝까지 받은 keep-alive 백엔드 연결을 풀에 반납
+static void release_backend(connection *c) {
+    if (c->backend.fd >= 0) {
+        int fd = c->backend.fd;
+        reactor_unwatch(c->reactor, &c->backend);
+        c->backend.fd = -1;
+        upstream_pool_release(c->pool, fd);
+    }
+}
+
+// 백엔드에 보낸 요청이 끝남 (응답 완료, 오류, 클라이언트 종료 모두). 로드밸런서에 결과(LB_RESULT_*)를 한 번만 알림
+static void end_upstream_request(connection *c, int result) {
+    if (c->server != NULL) {
+        load_balancer_release(c->server, result, c->upstream_trial);
+        c->server = NULL;
+    }
+}
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static long long monotonic_ms(void) {
+    return monotonic_us() / 1000;
+}
+
+// 리더: 캐시에 저장했거나 저장할 수 없음이 확인되면 기다리는 연결을 깨움
+// uncacheable: 백엔드가 캐시할 수 없는 응답을 줌. 한동안 이 URL 의 요청은 기다리지 않고 직접 가져감
+static void finish_flight(connection *c, int uncacheable) {
+    if (c->flight != NULL && c->flight_leader) {
+        coalesce_finish(c->flight, uncacheable);
+        c->flight = NULL;
+    }
+}
+
+// 대기 중인 연결을 reactor 의 대기 목록에서 뺌
+static void unlink_flight_waiter(connection *c) {
+    connection **link = &c->reactor->flight_waiting;
+    while (*link != NULL && *link != c) {
+        link = &(*link)->flight_next;
+    }
+    if (*link == c) {
+        *link = c->flight_next;
+    }
+    c->flight_next = NULL;
+}
+
+// 디스크 읽기를 기다리는 연결을 reactor 의 대기 목록에서 뺌
+static void unlink_disk_waiter(connection *c) {
+    connection **link = &c->reactor->disk_waiting;
+    while (*link != NULL && *link != c) {
+        link = &(*link)->disk_next;
+    }
+    if (*link == c) {
+        *link = c->disk_next;
+    }
+    c->disk_next = NULL;
+}
+
+// 클라이언트가 끊겼거나 보낼 수 없음. 합친 요청의 리더가 공개한 본문을 받는 중이면 대기하던 연결이 함께 중계하고
+// 있으므로 클라이언트 없는 갱신 연결처럼 끝까지 받고 1, 아니면 연결을 닫고 0
+static int client_failed(connection *c) {
+    if (c->flight == NULL || !c->flight_leader || !c->cache_filling || c->backend_done || coalesce_published(c->flight) == NULL) {
+        connection_close(c);
+        return 0;
+    }
+    printf("Client left, finishing coalesced response for URL: %s\n", c->url);
+    reactor_unwatch(c->reactor, &c->client);
+    close(c->client.fd);
+    c->client.fd = -1;
+    c->background = 1;
+    c->keep_alive = 0;
+    return 1;
+}
+
+// fd 는 즉시 닫고, 구조체 해제는 connection_reap 에서
+void connection_close(connection *c) {
+    if (c->state == CONN_CLOSED) {
+        return;
+    }
+    reactor *r = c->reactor;
+
+    if (c->state == CONN_WAITING_UPSTREAM) {
+        upstream_pool_cancel_wait(c->pool, c);
+    }
+    if (c->state == CONN_WAITING_DISK) {
+        unlink_disk_waiter(c);
+        cache_entry *e = cache_disk_read_finish(c->disk_read); // 아직 읽는 중이면 I/O 스레드가 결과를 버림
+        if (e != NULL) {
+            cache_release(e);
+        }
+        c->disk_read = NULL;
+    }
+    if (c->state == CONN_WAITING_FLIGHT || c->state == CONN_RELAYING_FLIGHT) {
+        unlink_flight_waiter(c);
+        coalesce_leave(c->flight, 0);
+        c->flight = NULL;
+        c->stream = NULL;
+    }
+    // 리더가 닫히면 기다리던 연결은 직접 가져옴
+    finish_flight(c, 0);
+    // 백엔드 반납 중 다른 연결이 깨어나도 이 연결은 이미 닫힌 것으로 보이도록 먼저 표시
+    c->state = CONN_CLOSED;
+
+    close_backend(c);
+    end_upstream_request(c, LB_RESULT_CANCELLED);
+    cancel_hedge(c, LB_RESULT_CANCELLED);
+    reactor_unwatch(r, &c->client);
+    if (c->client.fd >= 0) {
+        close(c->client.fd);
+        c->client.fd = -1;
+    }
+
+    if (c->prev != NULL) {
+        c->prev->next = c->next;
+    } else {
+        r->active = c->next;
+    }
+    if (c->next != NULL) {
+        c->next->prev = c->prev;
+    }
+    c->prev = NULL;
+    c->next = r->closed;
+    r->closed = c;
+    r->connection_count--;
+}
+
+void connection_reap(reactor *r) {
+    while (r->closed != NULL) {
+        connection *c = r->closed;
+        r->closed = c->next;
+        buffer_release(c, &c->request, &c->request_cap);
+        buffer_release(c, &c->forward, &c->forward_cap);
+        buffer_release(c, &c->response, &c->response_cap);
+        buffer_release(c, &c->head, &c->head_cap);
+        buffer_release(c, &c->ring.data, &c->ring.cap);
+        if (c->cache_fill != NULL) {
+            coalesce_body_release(c->cache_fill);
+        }
+        if (c->cached != NULL) {
+            cache_release(c->cached);
+        }
+        if (c->stale != NULL) {
+            cache_release(c->stale);
+        }
+        if (c->pipe_fds[0] >= 0) {
+            close(c->pipe_fds[0]);
+            close(c->pipe_fds[1]);
+        }
+        free(c);
+    }
+}
+
+void connection_sweep(reactor *r, time_t now) {
+    connection *c = r->active;
+    while (c != NULL) {
+        connection *next = c->next;
+
+        // 요청 사이에 대기 중인 keep-alive 연결은 더 짧은 유휴 시간 적용
+        int idle_between_requests = c->state == CONN_READING_REQUEST && c->request_len == 0 && c->request_count > 0;
+        int timeout = idle_between_requests ? KEEPALIVE_TIMEOUT : CONN_IDLE_TIMEOUT;
+
+        if (now - c->last_active >= timeout) {
+            if (!idle_between_requests) {
+                fprintf(stderr, "Connection timed out (state %d)\n", c->state);
+            }
+            // 백엔드를 기다리다 시간이 지났으면 백엔드 실패. 중계 중 링(파이프)이 가득 차 백엔드 읽기를 멈춘 것은
+            // 클라이언트가 받지 않은 것이므로 백엔드 탓으로 세지 않음
+            if (c->state >= CONN_CONNECTING && c->state <= CONN_RELAYING_RESPONSE) {
+                int client_stalled = c->state == CONN_RELAYING_RESPONSE && relay_space(c) == 0;
+                end_upstream_request(c, client_stalled ? LB_RESULT_CANCELLED : LB_RESULT_FAILURE);
+            }
+            connection_close(c);
+        }
+        c = next;
+    }
+}
+
+void connection_handle(connection *c, endpoint *ep, uint32_t events) {
+    c->last_active = time(NULL);
+
+    if (ep == &c->hedge) {
+        if (c->hedge.fd >= 0) {
+            on_hedge_event(c);
+        }
+    } else if (ep->kind == ENDPOINT_CLIENT) {
+        // 응답을 기다리는 동안 클라이언트가 끊으면 백엔드 작업도 중단 (본문을 함께 받는 연결이 있으면 계속)
+        if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+            if (client_failed(c)) {
+                relay_response(c);
+            }
+            return;
+        }
+        switch (c->state) {
+            case CONN_READING_REQUEST:
+                on_request_readable(c);
+                break;
+            case CONN_RELAYING_RESPONSE:
+            case CONN_WRITING_CLIENT:
+                relay_response(c);
+                break;
+            case CONN_RELAYING_FLIGHT:
+                relay_stream(c);
+                break;
+            default:
+                break;
+        }
+    } else {
+        // 링이 가득 차 읽기를 멈춘 동안의 HUP/ERR 는 링이 비워진 뒤 read 에서 처리
+        if ((events & (EPOLLERR | EPOLLHUP)) && c->state == CONN_RELAYING_RESPONSE && relay_space(c) == 0) {
+            reactor_unwatch(c->reactor, &c->backend);
+            return;
+        }
+        switch (c->state) {
+            case CONN_CONNECTING:
+                on_backend_connected(c);
+                break;
+            case CONN_WRITING_UPSTREAM:
+                on_upstream_writable(c);
+                break;
+            case CONN_READING_RESPONSE:
+                on_response_head_readable(c);
+                break;
+            case CONN_RELAYING_RESPONSE:
+                relay_response(c);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static int ring_init(connection *c, ring_buffer *ring) {
+    if (ring->data == NULL) {
+        ring->data = buffer_pool_alloc(&c->reactor->buffers, RELAY_BUFFER_SIZE, &ring->cap);
+        if (ring->data == NULL) {
+            return -1;
+        }
+    }
+    ring->start = 0;
+    ring->len = 0;
+    return 0;
+}
+
+// 링의 빈 공간(최대 limit 바이트)을 iovec 최대 두 조각으로
+static int ring_space_iov(ring_buffer *ring, struct iovec *iov, size_t limit) {
+    size_t space = ring->cap - ring->len;
+    if (space > limit) {
+        space = limit;
+    }
+    if (space == 0) {
+        return 0;
+    }
+
+    size_t tail = (ring->start + ring->len) % ring->cap;
+    size_t first = ring->cap - tail < space ? ring->cap - tail : space;
+    iov[0].iov_base = ring->data + tail;
+    iov[0].iov_len = first;
+    if (first == space) {
+        return 1;
+    }
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = space - first;
+    return 2;
+}
+
+// 링에 쌓인 데이터를 iovec 최대 두 조각으로
+static int ring_data_iov(ring_buffer *ring, struct iovec *iov) {
+    if (ring->len == 0) {
+        return 0;
+    }
+
+    size_t first = ring->cap - ring->start < ring->len ? ring->cap - ring->start : ring->len;
+    iov[0].iov_base = ring->data + ring->start;
+    iov[0].iov_len = first;
+    if (first == ring->len) {
+        return 1;
+    }
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = ring->len - first;
+    return 2;
+}
+
+static void ring_consume(ring_buffer *ring, size_t n) {
+    ring->len -= n;
+    ring->start = ring->len == 0 ? 0 : (ring->start + n) % ring->cap;
+}
+
+// 클라이언트 연결 기준의 Connection 헤더와 헤더 끝 빈 줄
+static int append_connection_headers(connection *c) {
+    char line[128];
+    int n;
+    if (c->keep_alive) {
+        n = snprintf(line, sizeof(line), "Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n\r\n",
+                     KEEPALIVE_TIMEOUT, KEEPALIVE_MAX_REQUESTS - c->request_count - 1);
+    } else {
+        n = snprintf(line, sizeof(line), "Connection: close\r\n\r\n");
+    }
+    return buffer_append(c, &c->head, &c->head_len, &c->head_cap, line, n);
+}
+
+// 응답 원문의 Connection 헤더를 클라이언트 연결 기준으로 다시 작성
+static int build_client_head(connection *c) {
+    const http_parser *head = &c->response_head;
+    c->head_len = 0;
+
+    if (!head->done) {
+        // 헤더 구분이 안 되는 응답은 그대로 보내고 연결 종료
+        c->body_offset = 0;
+        c->keep_alive = 0;
+        return 0;
+    }
+    c->body_offset = head->head_len;
+
+    // 응답 길이를 클라이언트가 알 수 있어야 연결을 유지할 수 있음
+    int status = head->status;
+    int delimited = c->is_head || status / 100 == 1 || status == 204 || status == 304 || head->has_content_length ||
+                    (head->chunked && strcmp(c->protocol, "HTTP/1.1") == 0);
+    if (!delimited) {
+        c->keep_alive = 0;
+    }
+
+    if (copy_start_line(c, &c->head, &c->head_len, &c->head_cap, c->response, 0, c->body_offset) < 0 ||
+        copy_end_to_end_headers(c, &c->head, &c->head_len, &c->head_cap, c->response, head, 0) < 0) {
+        return -1;
+    }
+
+    return append_connection_headers(c);
+}
+
+// splice 중계용 파이프 준비. 실패하면 링 버퍼 복사로 대신함
+static void splice_pipe_init(connection *c) {
+    if (c->pipe_fds[0] < 0) {
+        if (pipe2(c->pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+            perror("pipe2 failed");
+            c->pipe_fds[0] = c->pipe_fds[1] = -1;
+            c->splicing = 0;
+            return;
+        }
+        fcntl(c->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        int size = fcntl(c->pipe_fds[1], F_GETPIPE_SZ);
+        c->pipe_cap = size > 0 ? (size_t)size : 4096;
+    }
+    c->pipe_len = 0;
+}
+
+// 클라이언트 응답 전송 시작. 백엔드 본문이 남아있으면 링 버퍼(또는 파이프)로 이어서 중계
+static void start_client_response(connection *c) {
+    if (build_client_head(c) < 0 || ring_init(c, &c->ring) < 0) {
+        connection_close(c);
+        return;
+    }
+    if (c->splicing) {
+        splice_pipe_init(c);
+    }
+
+    // HEAD 요청이면 헤더까지만 전송
+    if (c->is_head && c->body_offset > 0) {
+        c->response_len = c->body_offset;
+    }
+
+    c->response_sent = 0;
+    c->state = c->backend_done ? CONN_WRITING_CLIENT : CONN_RELAYING_RESPONSE;
+    // 대부분 소켓 버퍼에 바로 들어가므로 EPOLLOUT 을 기다리지 않고 먼저 시도
+    relay_response(c);
+}
+
+// 캐시 항목 전송 시작. 항목은 복사하지 않고 [항목 헤더][Connection 헤더][항목 본문] 을 writev 로 보냄
+static void start_cached_response(connection *c) {
+    // 캐시 항목에는 항상 Content-Length (또는 본문이 없는 상태 코드) 가 있어 연결을 유지할 수 있음
+    char age[48];
+    int n = snprintf(age, sizeof(age), "Age: %ld\r\n", cache_entry_age(c->cached, time(NULL)));
+    c->head_len = 0;
+    if (buffer_append(c, &c->head, &c->head_len, &c->head_cap, age, n) < 0 || append_connection_headers(c) < 0) {
+        connection_close(c);
+        return;
+    }
+    c->response_sent = 0;
+    c->backend_done = 1;
+    c->state = CONN_WRITING_CLIENT;
+    relay_response(c);
+}
+
+// 만료 항목의 검증자로 조건 헤더를 붙임. 304 가 오면 본문 없이 항목을 갱신
+static int append_validators(connection *c) {
+    const struct iovec *etag = &c->stale->iov[CACHE_IOV_ETAG];
+    const struct iovec *last_modified = &c->stale->iov[CACHE_IOV_LAST_MODIFIED];
+    if (etag->iov_len > 0 &&
+        (buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, "If-None-Match: ", 15) < 0 ||
+         buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, etag->iov_base, etag->iov_len) < 0 ||
+         buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, "\r\n", 2) < 0)) {
+        return -1;
+    }
+    if (last_modified->iov_len > 0 &&
+        (buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, "If-Modified-Since: ", 19) < 0 ||
+         buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, last_modified->iov_base, last_modified->iov_len) < 0 ||
+         buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, "\r\n", 2) < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+// 백엔드로 보낼 요청 작성: hop-by-hop 헤더를 지우고 풀에서 재사용할 수 있도록 keep-alive 요청
+// 만료 항목을 재검증할 때는 클라이언트의 조건 헤더 대신 항목의 검증자를 보냄 (304 는 프록시가 받아 처리)
+static int build_forward_request(connection *c) {
+    const char *req = c->request;
+    const http_parser *head = &c->request_head;
+    int drop = c->stale != NULL ? DROP_CONDITIONAL : 0;
+
+    c->forward_len = 0;
+    c->forward_sent = 0;
+    if (copy_start_line(c, &c->forward, &c->forward_len, &c->forward_cap, req, head->method.off, head->head_len) < 0 ||
+        copy_end_to_end_headers(c, &c->forward, &c->forward_len, &c->forward_cap, req, head, drop) < 0 ||
+        (c->stale != NULL && append_validators(c) < 0) ||
+        buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, "Connection: keep-alive\r\n\r\n", 26) < 0 ||
+        buffer_append(c, &c->forward, &c->forward_len, &c->forward_cap, req + head->head_len, c->request_end - head->head_len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 백엔드 오류: stale-if-error 기간 안의 만료 항목을 가지고 있으면 그것으로 응답
+static int serve_stale_on_error(connection *c) {
+    if (c->background || c->stale == NULL || time(NULL) >= c->stale->stale_if_error) {
+        return 0;
+    }
+    printf("Serving stale response for URL: %s\n", c->url);
+    close_backend(c);
+    end_upstream_request(c, LB_RESULT_FAILURE);
+    cancel_hedge(c, LB_RESULT_CANCELLED);
+    c->cached = c->stale;
+    c->stale = NULL;
+    finish_flight(c, 0);
+    start_cached_response(c);
+    return 1;
+}
+
+static int retry_upstream(connection *c, httpserver *failed);
+static void promote_hedge(connection *c);
+
+// 클라이언트에 응답을 보내기 전의 백엔드 실패. 아직 응답 바이트를 받지 않았으면 보낸 hedge 로 바꾸거나
+// 다른 백엔드로 재시도하고, 그럴 수 없으면 stale 항목으로 응답. 그것도 없으면 연결 종료
+static void upstream_failed(connection *c) {
+    httpserver *failed = c->server;
+    end_upstream_request(c, LB_RESULT_FAILURE);
+    if (c->response_len == 0) {
+        if (c->hedge.fd >= 0) {
+            promote_hedge(c);
+            return;
+        }
+        if (failed != NULL && retry_upstream(c, failed)) {
+            return;
+        }
+    }
+    if (!serve_stale_on_error(c)) {
+        connection_close(c);
+    }
+}
+
+// 풀에서 백엔드 연결을 얻음. 최대 연결 수에 도달했으면 반납될 때까지 대기
+static void acquire_backend(connection *c, int allow_reuse) {
+    int reused = 0;
+    int in_progress = 0;
+    int fd = upstream_pool_acquire(c->pool, allow_reuse, &reused, &in_progress);
+    if (fd == UPSTREAM_POOL_FULL) {
+        c->state = CONN_WAITING_UPSTREAM;
+        upstream_pool_wait(c->pool, c);
+        return;
+    }
+    if (fd < 0) {
+        upstream_failed(c);
+        return;
+    }
+
+    c->backend.fd = fd;
+    c->backend_reused = reused;
+    c->forward_sent = 0;
+    c->state = in_progress ? CONN_CONNECTING : CONN_WRITING_UPSTREAM;
+    if (reactor_watch(c->reactor, &c->backend, EPOLLOUT) < 0) {
+        connection_close(c);
+    }
+}
+
+void connection_resume_upstream(connection *c) {
+    acquire_backend(c, !c->upstream_retried);
+}
+
+// consistent_hash 의 키: LB_HASH_KEY 가 url 이면 URL 전체, path 면 쿼리를 뺀 경로,
+// 그 밖의 값은 그 이름의 요청 헤더 값 (헤더가 없으면 URL)
+static const char *balance_key(connection *c, size_t *len) {
+    if (strcmp(LB_HASH_KEY, "path") == 0) {
+        *len = strcspn(c->url, "?");
+        return c->url;
+    }
+    if (strcmp(LB_HASH_KEY, "url") != 0) {
+        const http_header *h = http_header_find(&c->request_head, c->request, LB_HASH_KEY);
+        if (h != NULL) {
+            *len = h->value.len;
+            return c->request + h->value.off;
+        }
+    }
+    *len = strlen(c->url);
+    return c->url;
+}
+
+// hedge 대기 목록에서 뺌
+static void hedge_unlink(connection *c) {
+    if (c->hedge_at_us == 0) {
+        return;
+    }
+    reactor *r = c->reactor;
+    if (c->hedge_prev != NULL) {
+        c->hedge_prev->hedge_next = c->hedge_next;
+    } else {
+        r->hedge_waiting = c->hedge_next;
+    }
+    if (c->hedge_next != NULL) {
+        c->hedge_next->hedge_prev = c->hedge_prev;
+    } else {
+        r->hedge_tail = c->hedge_prev;
+    }
+    c->hedge_prev = NULL;
+    c->hedge_next = NULL;
+    c->hedge_at_us = 0;
+}
+
+// 첫 시도의 첫 바이트가 최근 분포의 percentile 보다 늦으면 hedge 하도록 대기 목록에 hedge 시각 순으로 넣음
+// 지연 값은 분포를 다시 계산할 때만 바뀌므로 보통 꼬리에 붙고, 지연이 줄었을 때만 앞으로 몇 칸 거슬러 감
+static void arm_hedge(connection *c) {
+    long long delay = HEDGE_ENABLED && !c->background ? hedge_delay_us() : -1;
+    if (delay < 0) {
+        return;
+    }
+    reactor *r = c->reactor;
+    c->hedge_at_us = c->upstream_started_us + delay;
+    connection *prev = r->hedge_tail;
+    while (prev != NULL && prev->hedge_at_us > c->hedge_at_us) {
+        prev = prev->hedge_prev;
+    }
+    c->hedge_prev = prev;
+    c->hedge_next = prev != NULL ? prev->hedge_next : r->hedge_waiting;
+    if (prev != NULL) {
+        prev->hedge_next = c;
+    } else {
+        r->hedge_waiting = c;
+    }
+    if (c->hedge_next != NULL) {
+        c->hedge_next->hedge_prev = c;
+    } else {
+        r->hedge_tail = c;
+    }
+}
+
+// 시각이 잡혔거나 보낸 hedge 를 버림 (원래 요청이 먼저 응답했거나 요청이 끝남)
+static void cancel_hedge(connection *c, int result) {
+    hedge_unlink(c);
+    if (c->hedge.fd >= 0) {
+        int fd = c->hedge.fd;
+        reactor_unwatch(c->reactor, &c->hedge);
+        c->hedge.fd = -1;
+        upstream_pool_discard(c->hedge_pool, fd);
+    }
+    if (c->hedge_server != NULL) {
+        load_balancer_release(c->hedge_server, result, c->hedge_trial);
+        c->hedge_server = NULL;
+    }
+}
+
+// hedge 를 원래 요청 자리로 옮기고 원래 요청은 버림. hedge 가 진행하던 단계부터 이어감
+static void promote_hedge(connection *c) {
+    if (c->state == CONN_WAITING_UPSTREAM) {
+        upstream_pool_cancel_wait(c->pool, c);
+    }
+    close_backend(c);
+    end_upstream_request(c, LB_RESULT_CANCELLED);
+
+    int fd = c->hedge.fd;
+    uint32_t events = c->hedge.events;
+    reactor_unwatch(c->reactor, &c->hedge);
+    c->hedge.fd = -1;
+    c->backend.fd = fd;
+    c->pool = c->hedge_pool;
+    c->server = c->hedge_server;
+    c->upstream_trial = c->hedge_trial;
+    c->hedge_server = NULL;
+    c->hedge_origin_us = c->upstream_started_us;
+    c->upstream_started_us = c->hedge_started_us;
+    c->backend_reused = c->hedge_reused;
+    c->upstream_retried = 0;
+    c->forward_sent = c->hedge_sent;
+    c->state = c->hedge_state;
+    if (c->state == CONN_READING_RESPONSE) {
+        c->response_len = 0;
+        http_parser_init(&c->response_head, HTTP_RESPONSE);
+        c->upstream_keep_alive = 0;
+    }
+    if (reactor_watch(c->reactor, &c->backend, events) < 0) {
+        connection_close(c);
+    }
+}
+
+// 고른 백엔드로 요청을 보내기 시작 (첫 시도와 다른 백엔드로의 재시도)
+static void use_backend(connection *c, httpserver *server, int trial) {
+    c->server = server;
+    c->upstream_trial = trial;
+    c->upstream_started_us = monotonic_us();
+    c->hedge_origin_us = 0;
+    c->upstream_attempts++;
+    printf("Forwarding to server: %s:%d\n", server->ip, server->port);
+
+    c->pool = upstream_pool_find(c->reactor, server);
+    if (c->pool == NULL) {
+        fprintf(stderr, "No upstream pool for %s:%d\n", server->ip, server->port);
+        upstream_failed(c);
+        return;
+    }
+    c->upstream_retried = 0;
+    c->request_time = time(NULL);
+    if (c->upstream_attempts == 1) {
+        arm_hedge(c);
+    }
+    acquire_backend(c, 1);
+}
+
+static void connect_backend(connection *c) {
+    c->upstream_attempts = 0;
+    size_t key_len;
+    const char *key = balance_key(c, &key_len);
+    int trial;
+    httpserver *server = load_balancer_pick(key, key_len, &trial); // 설정한 모드의 로드밸런서 호출
+    if (server == NULL) {
+        fprintf(stderr, "No healthy servers available\n");
+        upstream_failed(c);
+        return;
+    }
+    retry_budget_deposit();
+
+    // 백엔드 응답이 올 때까지 클라이언트 쪽 이벤트는 끊김(HUP/ERR)만 받음
+    reactor_watch(c->reactor, &c->client, 0);
+    use_backend(c, server, trial);
+}
+
+// 연결 실패나 첫 바이트 전에 끊긴 요청을 다른 백엔드로 다시 보냄 (GET/HEAD 만 받으므로 항상 멱등)
+// 요청당 UPSTREAM_RETRIES 번, 재시도 예산이 남아 있을 때만. hedge 는 세지 않으므로 hedge 한 요청이
+// 양쪽 모두 첫 바이트 전에 실패해도 재시도할 수 있음
+static int retry_upstream(connection *c, httpserver *failed) {
+    if (c->upstream_attempts > UPSTREAM_RETRIES) {
+        return 0;
+    }
+    size_t key_len;
+    const char *key = balance_key(c, &key_len);
+    int trial;
+    httpserver *server = load_balancer_pick_other(key, key_len, failed, &trial);
+    if (server == NULL) {
+        return 0;
+    }
+    if (!retry_budget_withdraw()) {
+        load_balancer_release(server, LB_RESULT_CANCELLED, trial);
+        return 0;
+    }
+    close_backend(c);
+    hedge_unlink(c);
+    printf("Retrying URL %s on another server\n", c->url);
+    use_backend(c, server, trial);
+    return 1;
+}
+
+// 아직 첫 바이트가 없는 요청을 다른 백엔드로도 보냄. 예산이 없거나 그 백엔드의 풀이 가득 찼으면 보내지 않음
+static void start_hedge(connection *c) {
+    if (c->response_len > 0 || c->state < CONN_WAITING_UPSTREAM || c->state > CONN_READING_RESPONSE) {
+        return;
+    }
+    size_t key_len;
+    const char *key = balance_key(c, &key_len);
+    int trial;
+    httpserver *server = load_balancer_pick_other(key, key_len, c->server, &trial);
+    if (server == NULL) {
+        return;
+    }
+    upstream_pool *pool = upstream_pool_find(c->reactor, server);
+    if (pool == NULL || !retry_budget_withdraw()) {
+        load_balancer_release(server, LB_RESULT_CANCELLED, trial);
+        return;
+    }
+    int reused = 0;
+    int in_progress = 0;
+    int fd = upstream_pool_acquire(pool, 1, &reused, &in_progress);
+    if (fd < 0) {
+        load_balancer_release(server, fd == UPSTREAM_POOL_FULL ? LB_RESULT_CANCELLED : LB_RESULT_FAILURE, trial);
+        return;
+    }
+
+    c->hedge.fd = fd;
+    c->hedge_pool = pool;
+    c->hedge_server = server;
+    c->hedge_trial = trial;
+    c->hedge_reused = reused;
+    c->hedge_sent = 0;
+    c->hedge_started_us = monotonic_us();
+    c->hedge_state = in_progress ? CONN_CONNECTING : CONN_WRITING_UPSTREAM;
+    printf("Hedging URL %s to server %s:%d\n", c->url, server->ip, server->port);
+    if (reactor_watch(c->reactor, &c->hedge, EPOLLOUT) < 0) {
+        cancel_hedge(c, LB_RESULT_CANCELLED);
+    }
+}
+
+int connection_check_hedges(reactor *r) {
+    long long now = monotonic_us();
+    while (r->hedge_waiting != NULL && r->hedge_waiting->hedge_at_us <= now) {
+        connection *c = r->hedge_waiting;
+        hedge_unlink(c);
+        start_hedge(c);
+    }
+    if (r->hedge_waiting == NULL) {
+        return -1;
+    }
+    return (int)((r->hedge_waiting->hedge_at_us - now + 999) / 1000);
+}
+
+// hedge 연결 진행: 연결, 요청 전송, 그리고 응답 바이트가 오면 원래 요청보다 먼저 왔으므로 이쪽을 씀
+// 응답 없이 끊기거나 오류면 hedge 만 버리고 원래 요청을 계속 기다림
+static void on_hedge_event(connection *c) {
+    if (c->hedge_state == CONN_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(c->hedge.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            cancel_hedge(c, LB_RESULT_FAILURE);
+            return;
+        }
+        c->hedge_state = CONN_WRITING_UPSTREAM;
+    }
+
+    if (c->hedge_state == CONN_WRITING_UPSTREAM) {
+        while (c->hedge_sent < c->forward_len) {
+            ssize_t n = write(c->hedge.fd, c->forward + c->hedge_sent, c->forward_len - c->hedge_sent);
+            if (n > 0) {
+                c->hedge_sent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                cancel_hedge(c, c->hedge_reused ? LB_RESULT_CANCELLED : LB_RESULT_FAILURE);
+                return;
+            }
+        }
+        c->hedge_state = CONN_READING_RESPONSE;
+        if (reactor_watch(c->reactor, &c->hedge, EPOLLIN) < 0) {
+            cancel_hedge(c, LB_RESULT_CANCELLED);
+        }
+        return;
+    }
+
+    char byte;
+    ssize_t n = recv(c->hedge.fd, &byte, 1, MSG_PEEK);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        // 재사용한 유휴 연결이 이미 끊겨 있던 경우는 백엔드 실패로 보지 않음
+        cancel_hedge(c, c->hedge_reused && n == 0 ? LB_RESULT_CANCELLED : LB_RESULT_FAILURE);
+        return;
+    }
+    printf("Hedged request answered first for URL: %s\n", c->url);
+    // 버리는 원래 요청은 적어도 지금까지 기다렸으므로 그 시간을 하한으로 기록
+    // (이긴 쪽만 기록하면 분포가 빠른 쪽으로만 줄어 hedge 가 점점 일찍 나가고, 느린 백엔드도 빠르게 보임)
+    if (c->server != NULL) {
+        long long waited = monotonic_us() - c->upstream_started_us;
+        load_balancer_observe(c->server, waited);
+        hedge_record(waited);
+    }
+    promote_hedge(c);
+    if (c->state == CONN_READING_RESPONSE) {
+        on_response_head_readable(c);
+    }
+}
+
+// 재사용한 유휴 연결이 이미 끊겨 있었으면 새 연결로 한 번만 다시 시도
+static int retry_stale_backend(connection *c) {
+    if (!c->backend_reused || c->upstream_retried) {
+        return 0;
+    }
+    close_backend(c);
+    c->upstream_retried = 1;
+    c->response_len = 0;
+    acquire_backend(c, 0);
+    return 1;
+}
+
+// 버퍼에 요청 헤더가 모두 있으면 처리 시작, 아니면 0 반환
+static int start_request(connection *c) {
+    http_parser *head = &c->request_head;
+    int rc = http_parse(head, c->request, c->request_len);
+    if (rc == HTTP_PARSE_AGAIN) {
+        return 0;
+    }
+    if (rc == HTTP_PARSE_ERROR) {
+        fprintf(stderr, "Failed to parse the request header\n");
+        connection_close(c);
+        return 1;
+    }
+
+    // 메서드 및 URL, 프로토콜 추출
+    if (head->method.len >= sizeof(c->method) || head->target.len >= sizeof(c->url)) {
+        fprintf(stderr, "Request line too long\n");
+        connection_close(c);
+        return 1;
+    }
+    memcpy(c->method, c->request + head->method.off, head->method.len);
+    c->method[head->method.len] = '\0';
+    memcpy(c->url, c->request + head->target.off, head->target.len);
+    c->url[head->target.len] = '\0';
+    snprintf(c->protocol, sizeof(c->protocol), "HTTP/1.%d", head->minor_version);
+
+    // URL 유효성 검사
+    if ((strcmp(c->method, "GET") != 0) && (strcmp(c->method, "HEAD") != 0)) {
+        fprintf(stderr, "Invalid request method: %s\n", c->method);
+        connection_close(c);
+        return 1;
+    }
+    c->is_head = strcmp(c->method, "HEAD") == 0;
+
+    // chunked 요청 본문은 지원하지 않음 (경계를 모르면 다음 요청과 섞임)
+    if (head->has_transfer_encoding) {
+        fprintf(stderr, "Request Transfer-Encoding not supported\n");
+        connection_close(c);
+        return 1;
+    }
+
+    // 본문이 있으면 다 받을 때까지 대기
+    size_t head_len = head->head_len;
+    if (head->content_length > MAX_REQUEST_SIZE || head_len + head->content_length > MAX_REQUEST_SIZE) {
+        fprintf(stderr, "Request too large\n");
+        connection_close(c);
+        return 1;
+    }
+    size_t body_len = head->content_length;
+    if (c->request_len < head_len + body_len) {
+        return 0;
+    }
+    c->request_end = head_len + body_len;
+
+    // HTTP/1.1 은 기본 유지, HTTP/1.0 은 keep-alive 요청 시에만 유지
+    if (head->minor_version >= 1) {
+        c->keep_alive = !head->conn_close;
+    } else {
+        c->keep_alive = head->conn_keep_alive;
+    }
+    if (c->request_count + 1 >= KEEPALIVE_MAX_REQUESTS) {
+        c->keep_alive = 0;
+    }
+
+    // 다음 요청은 현재 응답을 다 보낸 뒤에 읽음
+    reactor_watch(c->reactor, &c->client, 0);
+    serve_request(c, COALESCE_ENABLED);
+    return 1;
+}
+
+// 같은 URL 을 이미 가져오는 연결이 있으면 대기 목록에 들어가 1 반환. 없으면 이 연결이 리더가 되어 0
+static int join_flight(connection *c) {
+    coalesce_flight *f;
+    int role = coalesce_join(c->url, c->reactor->waker.fd, &f);
+    if (role == COALESCE_BYPASS) {
+        return 0;
+    }
+    c->flight = f;
+    c->flight_leader = role == COALESCE_LEADER;
+    if (c->flight_leader) {
+        return 0;
+    }
+
+    printf("Cache miss coalesced for URL: %s\n", c->url);
+    c->state = CONN_WAITING_FLIGHT;
+    c->flight_deadline = monotonic_ms() + COALESCE_TIMEOUT_MS;
+    c->flight_next = c->reactor->flight_waiting;
+    c->reactor->flight_waiting = c;
+    return 1;
+}
+
+void connection_check_flights(reactor *r) {
+    long long now = monotonic_ms();
+    connection **link = &r->flight_waiting;
+
+    while (*link != NULL) {
+        connection *c = *link;
+        // 함께 중계하다 보낼 것이 없어 기다리던 연결: 리더가 더 받았거나 끝났으면 이어서 중계
+        if (c->state == CONN_RELAYING_FLIGHT) {
+            if (coalesce_body_state(c->stream) == COALESCE_BODY_FILLING && coalesce_body_length(c->stream) == c->stream_sent) {
+                link = &c->flight_next;
+                continue;
+            }
+            *link = c->flight_next;
+            c->flight_next = NULL;
+            c->last_active = time(NULL);
+            relay_stream(c);
+            continue;
+        }
+
+        // 리더가 본문을 공개했으면 받는 대로 함께 중계. 길이를 모르는 본문은 chunked 를 받을 수 없는 HTTP/1.0 이면
+        // 다 받을 때까지 기다림 (끝난 것을 먼저 봐야 그 뒤의 본문 상태가 최종)
+        int done = coalesce_done(c->flight);
+        coalesce_body *b = coalesce_published(c->flight);
+        int state = b != NULL ? coalesce_body_state(b) : COALESCE_BODY_ABORTED;
+        if (state != COALESCE_BODY_ABORTED &&
+            (b->sized || state == COALESCE_BODY_COMPLETE || strcmp(c->protocol, "HTTP/1.1") == 0)) {
+            *link = c->flight_next;
+            c->flight_next = NULL;
+            c->last_active = time(NULL);
+            start_stream(c, b, state);
+            continue;
+        }
+        if (!done && now < c->flight_deadline) {
+            link = &c->flight_next;
+            continue;
+        }
+
+        // 공개된 본문 없이 끝났으면(캐시할 수 없는 응답, 재검증, 리더 실패) 캐시를 보고, 없거나 시간이 지났으면
+        // 직접 가져옴 (다시 기다리지 않음)
+        *link = c->flight_next;
+        c->flight_next = NULL;
+        coalesce_leave(c->flight, !done);
+        c->flight = NULL;
+        c->state = CONN_READING_REQUEST;
+        c->last_active = time(NULL);
+        serve_request(c, 0);
+    }
+}
+
+// 만료 항목 e 를 새로 가져오는 클라이언트 없는 연결을 시작. 같은 URL 을 이미 가져오는 중이면 생략
+static void start_background_refresh(connection *origin, cache_entry *e) {
+    coalesce_flight *f;
+    int role = coalesce_join(origin->url, origin->reactor->waker.fd, &f);
+    if (role == COALESCE_FOLLOWER) {
+        coalesce_leave(f, 0);
+        return;
+    }
+
+    connection *c = connection_create(origin->reactor, -1);
+    if (c == NULL) {
+        if (role == COALESCE_LEADER) {
+            coalesce_finish(f, 0);
+        }
+        return;
+    }
+    c->background = 1;
+    if (role == COALESCE_LEADER) {
+        c->flight = f;
+        c->flight_leader = 1;
+    }
+
+    // 원래 요청을 복사해 그대로 다시 해석 (클라이언트의 조건 헤더는 build_forward_request 에서 검증자로 바뀜)
+    if (buffer_append(c, &c->request, &c->request_len, &c->request_cap, origin->request, origin->request_end) < 0 ||
+        http_parse(&c->request_head, c->request, c->request_len) != HTTP_PARSE_DONE) {
+        connection_close(c);
+        return;
+    }
+    c->request_end = c->request_len;
+    memcpy(c->method, origin->method, sizeof(c->method));
+    memcpy(c->url, origin->url, sizeof(c->url));
+    memcpy(c->protocol, origin->protocol, sizeof(c->protocol));
+    cache_retain(e);
+    c->stale = e;
+
+    printf("Background refresh for URL: %s\n", c->url);
+    if (build_forward_request(c) < 0) {
+        connection_close(c);
+        return;
+    }
+    connect_backend(c);
+}
+
+// 찾은 캐시 항목(e, 없으면 NULL)으로 응답하거나, 없거나 만료됐으면 백엔드로 전달
+// may_coalesce 면 같은 URL 을 이미 가져오는 연결의 결과를 기다리거나, 다른 연결이 기다릴 리더가 됨
+static void serve_entry(connection *c, cache_entry *e, int may_coalesce) {
+    if (CACHE_ENABLED) {
+        time_t now = time(NULL);
+        int no_cache = freshness_request_no_cache(&c->request_head, c->request);
+        if (e != NULL && cache_entry_fresh(e, now) && !no_cache) {
+            printf("Cache hit for URL: %s\n", c->url);
+            c->cached = e;
+            start_cached_response(c);
+            return;
+        }
+        // stale-while-revalidate: 만료 항목을 바로 보내고 갱신은 클라이언트 없는 연결이 뒤에서
+        if (e != NULL && now < e->stale_while_revalidate && !no_cache) {
+            printf("Cache stale hit for URL: %s\n", c->url);
+            if (!c->is_head) {
+                start_background_refresh(c, e); // 응답을 보내면 요청 버퍼가 다음 요청으로 바뀌므로 먼저
+            }
+            c->cached = e;
+            start_cached_response(c);
+            return;
+        }
+        // HEAD 응답은 캐시에 저장하지 않으므로 리더가 될 수 없음
+        if (may_coalesce && !c->is_head && join_flight(c)) {
+            if (e != NULL) {
+                cache_release(e);
+            }
+            return;
+        }
+        // 재검증할 수 있거나 백엔드 오류 때 대신 보낼 수 있는 만료 항목은 응답을 받을 때까지 가지고 있음
+        if (e != NULL && (cache_entry_has_validator(e) || now < e->stale_if_error)) {
+            printf("Cache %s for URL: %s\n", cache_entry_has_validator(e) ? "revalidate" : "stale", c->url);
+            c->stale = e;
+        } else {
+            if (e != NULL) {
+                cache_release(e);
+            }
+            printf("Cache miss for URL: %s\n", c->url);
+        }
+    }
+
+    if (build_forward_request(c) < 0) {
+        connection_close(c);
+        return;
+    }
+    connect_backend(c);
+}
+
+// 캐시에서 응답을 찾아 보내고, 없거나 만료됐으면 백엔드로 전달
+// RAM 에 없고 디스크 계층에 있을 수 있으면 캐시 I/O 스레드가 RAM 으로 올려 이 reactor 를 깨울 때까지 기다림
+static void serve_request(connection *c, int may_coalesce) {
+    cache_entry *e = NULL;
+    if (CACHE_ENABLED) {
+        cache_disk_read *read;
+        e = cache_lookup_async(c->url, c->reactor->waker.fd, &read);
+        if (read != NULL) {
+            c->state = CONN_WAITING_DISK;
+            c->disk_read = read;
+            c->disk_may_coalesce = may_coalesce;
+            c->disk_next = c->reactor->disk_waiting;
+            c->reactor->disk_waiting = c;
+            return;
+        }
+    }
+    serve_entry(c, e, may_coalesce);
+}
+
+void connection_check_disk_reads(reactor *r) {
+    connection **link = &r->disk_waiting;
+
+    while (*link != NULL) {
+        connection *c = *link;
+        if (!cache_disk_read_done(c->disk_read)) {
+            link = &c->disk_next;
+            continue;
+        }
+
+        *link = c->disk_next;
+        c->disk_next = NULL;
+        cache_entry *e = cache_disk_read_finish(c->disk_read);
+        c->disk_read = NULL;
+        c->state = CONN_READING_REQUEST;
+        c->last_active = time(NULL);
+        serve_entry(c, e, c->disk_may_coalesce);
+    }
+}
+
+static void on_request_readable(connection *c) {
+    while (1) {
+        if (buffer_reserve(c, &c->request, &c->request_cap, c->request_len, c->request_len + REQUEST_READ_MIN) < 0) {
+            connection_close(c);
+            return;
+        }
+
+        ssize_t n = read(c->client.fd, c->request + c->request_len, c->request_cap - c->request_len - 1);
+        if (n > 0) {
+            c->request_len += n;
+            c->request[c->request_len] = '\0';
+            if (start_request(c)) {
+                return;
+            }
+            if (c->request_len > MAX_REQUEST_SIZE) {
+                fprintf(stderr, "Request header too large\n");
+                connection_close(c);
+                return;
+            }
+        } else if (n == 0) {
+            connection_close(c);
+            return;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else if (errno != EINTR) {
+            perror("Failed to read client request");
+            connection_close(c);
+            return;
+        }
+    }
+}
+
+static void on_backend_connected(connection *c) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(c->backend.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        fprintf(stderr, "Connection failed: %s\n", strerror(err ? err : errno));
+        upstream_failed(c);
+        return;
+    }
+
+    c->state = CONN_WRITING_UPSTREAM;
+    on_upstream_writable(c);
+}
+
+static void on_upstream_writable(connection *c) {
+    // 요청 전달
+    while (c->forward_sent < c->forward_len) {
+        ssize_t n = write(c->backend.fd, c->forward + c->forward_sent, c->forward_len - c->forward_sent);
+        if (n > 0) {
+            c->forward_sent += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (retry_stale_backend(c)) {
+                return;
+            }
+            perror("Failed to forward request");
+            upstream_failed(c);
+            return;
+        }
+    }
+
+    c->state = CONN_READING_RESPONSE;
+    c->response_len = 0;
+    http_parser_init(&c->response_head, HTTP_RESPONSE);
+    c->upstream_keep_alive = 0;
+    if (reactor_watch(c->reactor, &c->backend, EPOLLIN) < 0) {
+        connection_close(c);
+    }
+}
+
+// 캐시 저장용 본문에 추가. 캐시 항목 한도를 넘으면 이 응답은 캐시하지 않음
+// 합친 요청의 리더면 본문을 함께 중계하며 더 기다리는 연결을 깨움
+static void cache_fill_append(connection *c, const char *data, size_t len) {
+    if (!c->cache_filling) {
+        return;
+    }
+    if (c->body_offset + coalesce_body_length(c->cache_fill) + len > cache_max_object_size() ||
+        coalesce_body_append(c->cache_fill, data, len) < 0) {
+        c->cache_filling = 0;
+        finish_flight(c, 1);
+        return;
+    }
+    if (c->flight != NULL && c->flight_leader) {
+        coalesce_notify(c->flight);
+    }
+}
+
+// chunked 디코더가 넘겨주는 청크 데이터
+static void cache_fill_sink(void *ctx, const char *data, size_t len) {
+    cache_fill_append(ctx, data, len);
+}
+
+// 백엔드에서 받은 본문 바이트를 해석. 응답에 속한 바이트 수를 반환하고 끝나면 backend_done 설정
+static size_t body_accept(connection *c, const char *data, size_t len) {
+    size_t used = len;
+
+    switch (c->body_mode) {
+        case BODY_LENGTH:
+            if (used > c->body_remaining) {
+                used = c->body_remaining;
+            }
+            c->body_remaining -= used;
+            c->backend_done = c->body_remaining == 0;
+            break;
+        case BODY_CHUNKED:
+            // 원문은 그대로 중계하고, 캐시할 때만 청크 데이터를 따로 모음
+            used = chunked_feed(&c->chunked, data, len, c->cache_filling ? cache_fill_sink : NULL, c);
+            c->backend_done = chunked_done(&c->chunked);
+            if (chunked_failed(&c->chunked)) {
+                // 경계를 잃었으므로 여기까지만 보내고 양쪽 연결을 닫아 클라이언트가 잘렸음을 알게 함
+                fprintf(stderr, "Malformed chunked response body\n");
+                c->keep_alive = 0;
+                c->upstream_keep_alive = 0;
+                c->cache_filling = 0;
+                c->backend_done = 1;
+                used = len;
+            }
+            break;
+        case BODY_UNTIL_EOF:
+            break;
+        default:
+            used = 0;
+            c->backend_done = 1;
+            break;
+    }
+
+    // 요청하지 않은 데이터가 더 왔으면 그 연결은 재사용하지 않음
+    if (used < len) {
+        c->upstream_keep_alive = 0;
+    }
+    if (c->body_mode != BODY_CHUNKED) {
+        cache_fill_append(c, data, used);
+    }
+    return used;
+}
+
+// 만료 항목을 재검증한 결과가 304 인지 (항목 갱신은 serve_revalidated 에서)
+static int is_revalidated(connection *c) {
+    return c->stale != NULL && c->response_head.done && c->response_head.status == 304;
+}
+
+// 백엔드 응답 헤더를 해석해 본문 끝 판단 방식을 정함. 헤더가 아직 다 오지 않았으면 0, 형식 오류면 -1
+static int parse_response_head(connection *c) {
+    http_parser *head = &c->response_head;
+    int rc = http_parse(head, c->response, c->response_len);
+    if (rc != HTTP_PARSE_DONE) {
+        return rc;
+    }
+    size_t head_len = head->head_len;
+    int status = head->status;
+
+    // 백엔드가 연결을 유지하겠다고 했는지
+    if (head->minor_version >= 1) {
+        c->upstream_keep_alive = !head->conn_close;
+    } else {
+        c->upstream_keep_alive = head->conn_keep_alive;
+    }
+
+    chunked_init(&c->chunked);
+    if (c->is_head || status / 100 == 1 || status == 204 || status == 304) {
+        c->body_mode = BODY_NONE;
+    } else if (head->chunked) {
+        c->body_mode = BODY_CHUNKED;
+    } else if (head->has_content_length) {
+        c->body_mode = BODY_LENGTH;
+        c->body_remaining = head->content_length;
+    } else {
+        // 길이 정보가 없으면 백엔드가 닫을 때까지 읽음
+        c->body_mode = BODY_UNTIL_EOF;
+        c->upstream_keep_alive = 0;
+    }
+
+    // 캐시에 넣을 본문은 중계하면서 따로 모음. 저장할 수 없는 응답이나 캐시 항목보다 큰 것이 확실하면 처음부터 제외
+    c->body_offset = head_len;
+    c->response_time = time(NULL);
+    c->cache_filling = CACHE_ENABLED && !c->is_head &&
+                       freshness_evaluate(&c->request_head, c->request, head, c->response, c->request_time, c->response_time,
+                                          &c->freshness);
+    if (c->body_mode == BODY_LENGTH && head_len + c->body_remaining > cache_max_object_size()) {
+        c->cache_filling = 0;
+    }
+    if (c->cache_fill != NULL) {
+        coalesce_body_release(c->cache_fill);
+        c->cache_fill = NULL;
+    }
+    if (c->cache_filling) {
+        c->cache_fill = coalesce_body_create(c->body_mode == BODY_LENGTH ? c->body_remaining : 0);
+        c->cache_filling = c->cache_fill != NULL;
+    }
+    // 합친 요청의 리더면 모을 본문을 공개해 대기 중인 연결이 받는 대로 함께 중계하게 함
+    // 304 는 리더 요청의 조건에 따른 것이고 5xx 는 리더가 stale 항목으로 대신할 수 있어 공개하지 않음
+    if (c->cache_filling && c->flight != NULL && c->flight_leader && status < 500 && status != 304) {
+        publish_fill(c);
+    }
+    // 저장하지 않을 응답이면 기다리는 연결이 본문을 기다리지 않고 바로 직접 가져가도록 (304 는 갱신한 뒤에)
+    // 5xx 는 백엔드 장애일 수 있고 304 는 리더 요청의 조건에 따른 것이므로 캐시할 수 없는 URL 로 기억하지 않음
+    if (!c->cache_filling && !is_revalidated(c)) {
+        finish_flight(c, status < 500 && status != 304);
+    }
+
+    // 헤더와 함께 읽힌 본문 앞부분
+    c->backend_done = 0;
+    c->response_len = head_len + body_accept(c, c->response + head_len, c->response_len - head_len);
+
+    // 캐시하지 않고 본문을 훑을 필요도 없으면(chunked 제외) 본문은 splice 로 중계
+    c->splicing = SPLICE_ENABLED && !c->background && !c->cache_filling && !c->backend_done &&
+                  (c->body_mode == BODY_LENGTH || c->body_mode == BODY_UNTIL_EOF);
+    return 1;
+}
+
+// 응답 헤더로 캐시 항목 헤더 작성: 시작 줄, end-to-end 헤더, 본문 길이 (빈 줄 제외)
+// 본문이 없는 응답이나 body_len 이 음수(아직 모름)면 길이를 붙이지 않음
+static int build_entry_head(connection *c, char **buf, size_t *len, size_t *cap, long long body_len) {
+    char line[64];
+    int n = c->body_mode == BODY_NONE || body_len < 0 ? 0 : snprintf(line, sizeof(line), "Content-Length: %lld\r\n", body_len);
+    if (copy_start_line(c, buf, len, cap, c->response, 0, c->body_offset) < 0 ||
+        copy_end_to_end_headers(c, buf, len, cap, c->response, &c->response_head, DROP_FOR_CACHE) < 0) {
+        return -1;
+    }
+    return buffer_append(c, buf, len, cap, line, n);
+}
+
+// 리더: 모을 본문을 항목 헤더와 함께 flight 에 공개. 실패하면 대기 중인 연결은 리더가 끝날 때까지 기다림
+static void publish_fill(connection *c) {
+    char *entry_head = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    long long body_len = c->body_mode == BODY_LENGTH ? (long long)c->body_remaining : -1;
+
+    if (build_entry_head(c, &entry_head, &len, &cap, body_len) == 0) {
+        coalesce_publish(c->flight, c->cache_fill, entry_head, len, c->body_mode == BODY_LENGTH || c->body_mode == BODY_NONE);
+    }
+    buffer_release(c, &entry_head, &cap);
+}
+
+// 모은 본문을 항목 헤더와 함께 저장. chunked 응답도 Content-Length 응답으로 바꿔 저장
+static void store_cache_entry(connection *c) {
+    char *entry_head = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    const char *body;
+    size_t body_len = coalesce_body_read(c->cache_fill, &body);
+
+    if (build_entry_head(c, &entry_head, &len, &cap, (long long)body_len) == 0 && len + body_len <= cache_max_object_size()) {
+        printf("Store response for URL: %s into cache\n", c->url);
+        cache_store(c->url, entry_head, len, body, body_len, &c->freshness);
+    }
+    buffer_release(c, &entry_head, &cap);
+}
+
+// 304 에 실린 헤더 중 저장된 헤더를 대신할 것이 있는지
+static int is_updated_header(connection *c, const char *name, size_t len) {
+    const http_parser *head = &c->response_head;
+    if (is_dropped_header(name, len, DROP_FOR_CACHE)) {
+        return 0;
+    }
+    for (int i = 0; i < head->header_count; i++) {
+        const http_header *h = &head->headers[i];
+        if (h->name.len == len && strncasecmp(c->response + h->name.off, name, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 저장된 헤더를 304 의 헤더로 갱신한 새 항목 헤더 작성 (RFC 9111 3.2). 저장된 Content-Length 는 유지
+static int build_refreshed_head(connection *c, char **buf, size_t *len, size_t *cap) {
+    const char *old = c->stale->iov[CACHE_IOV_HEAD].iov_base;
+    size_t old_len = c->stale->iov[CACHE_IOV_HEAD].iov_len;
+    const char *end = old + old_len;
+
+    // 시작 줄은 저장된 응답의 것 (304 가 아님)
+    const char *line = memchr(old, '\n', old_len);
+    line = line != NULL ? line + 1 : end;
+    if (buffer_append(c, buf, len, cap, old, line - old) < 0) {
+        return -1;
+    }
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        const char *next = eol != NULL ? eol + 1 : end;
+        const char *colon = memchr(line, ':', next - line);
+        if (colon == NULL || !is_updated_header(c, line, colon - line)) {
+            if (buffer_append(c, buf, len, cap, line, next - line) < 0) {
+                return -1;
+            }
+        }
+        line = next;
+    }
+    return copy_end_to_end_headers(c, buf, len, cap, c->response, &c->response_head, DROP_FOR_CACHE);
+}
+
+// 재검증 결과 304: 만료 항목의 헤더와 신선도만 갱신하고 본문은 그대로 클라이언트에 보냄
+static void serve_revalidated(connection *c) {
+    char *head = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    http_parser parsed;
+    cache_freshness freshness;
+    cache_entry *fresh = NULL;
+
+    // 갱신한 헤더를 다시 해석해 신선도 계산 (해석할 수 있도록 빈 줄을 붙였다가 저장할 때는 뺌)
+    if (build_refreshed_head(c, &head, &len, &cap) == 0 && buffer_append(c, &head, &len, &cap, "\r\n", 2) == 0) {
+        http_parser_init(&parsed, HTTP_RESPONSE);
+        if (http_parse(&parsed, head, len) == HTTP_PARSE_DONE &&
+            freshness_evaluate(&c->request_head, c->request, &parsed, head, c->request_time, c->response_time, &freshness)) {
+            fresh = cache_refresh(c->stale, head, len - 2, &freshness);
+        }
+    }
+    buffer_release(c, &head, &cap);
+
+    // 갱신하지 못해도 304 로 내용이 그대로임을 확인했으므로 기존 항목을 보냄
+    if (fresh != NULL) {
+        cache_release(c->stale);
+        c->cached = fresh;
+    } else {
+        c->cached = c->stale;
+    }
+    c->stale = NULL;
+    finish_flight(c, 0);
+    printf("Revalidated cached response for URL: %s\n", c->url);
+    start_cached_response(c);
+}
+
+// 백엔드 응답 수신 완료: 연결을 풀에 반납하고 모은 응답을 캐시에 저장
+static void finish_backend(connection *c) {
+    c->backend_done = 1;
+    end_upstream_request(c, c->response_head.status >= 500 ? LB_RESULT_FAILURE : LB_RESULT_SUCCESS);
+    if (c->upstream_keep_alive) {
+        release_backend(c);
+    } else {
+        close_backend(c);
+    }
+
+    if (c->cache_filling) {
+        coalesce_body_end(c->cache_fill, COALESCE_BODY_COMPLETE);
+        store_cache_entry(c);
+        c->cache_filling = 0;
+    }
+    if (!is_revalidated(c)) {
+        finish_flight(c, 0);
+    }
+}
+
+static void on_response_head_readable(connection *c) {
+    while (1) {
+        if (buffer_reserve(c, &c->response, &c->response_cap, c->response_len, c->response_len + RESPONSE_READ_MIN) < 0) {
+            connection_close(c);
+            return;
+        }
+
+        ssize_t n = read(c->backend.fd, c->response + c->response_len, c->response_cap - c->response_len - 1);
+        if (n > 0) {
+            // 연결, 요청 전송, 백엔드 처리를 모두 포함한 첫 바이트까지의 시간
+            // 백엔드 지연은 이 백엔드에 보낸 시각부터, hedge 분포는 클라이언트가 기다린 시간(hedge 가 이겼으면
+            // 원래 요청을 보낸 시각부터)
+            if (c->response_len == 0 && c->server != NULL) {
+                long long now = monotonic_us();
+                load_balancer_observe(c->server, now - c->upstream_started_us);
+                hedge_record(now - (c->hedge_origin_us != 0 ? c->hedge_origin_us : c->upstream_started_us));
+                cancel_hedge(c, LB_RESULT_CANCELLED);
+            }
+            c->response_len += n;
+            c->response[c->response_len] = '\0';
+            int rc = parse_response_head(c);
+            if (rc < 0) {
+                fprintf(stderr, "Failed to parse the backend response header\n");
+                upstream_failed(c);
+                return;
+            }
+            if (rc > 0) {
+                break;
+            }
+            if (c->response_len > MAX_RESPONSE_HEAD) {
+                fprintf(stderr, "Backend response header too large\n");
+                upstream_failed(c);
+                return;
+            }
+        } else if (n == 0) {
+            if (c->response_len == 0) {
+                if (!retry_stale_backend(c)) {
+                    fprintf(stderr, "Backend closed connection without a response\n");
+                    upstream_failed(c);
+                }
+                return;
+            }
+            // 헤더 구분 없이 끝난 응답은 받은 그대로 전달
+            c->body_mode = BODY_UNTIL_EOF;
+            c->upstream_keep_alive = 0;
+            c->backend_done = 1;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else if (errno != EINTR) {
+            if (c->response_len == 0 && retry_stale_backend(c)) {
+                return;
+            }
+            perror("Failed to receive response from backend server");
+            upstream_failed(c);
+            return;
+        }
+    }
+
+    // 백엔드 자체의 오류 응답도 stale-if-error 대상
+    if (c->response_head.done && c->response_head.status >= 500 && serve_stale_on_error(c)) {
+        return;
+    }
+    // 클라이언트 없는 갱신 연결은 저장할 수 없는 응답이면 더 받을 필요가 없음
+    if (c->background && !c->cache_filling && !is_revalidated(c)) {
+        end_upstream_request(c, c->response_head.status >= 500 ? LB_RESULT_FAILURE : LB_RESULT_SUCCESS);
+        connection_close(c);
+        return;
+    }
+    if (c->backend_done) {
+        finish_backend(c);
+    }
+    if (is_revalidated(c)) {
+        serve_revalidated(c);
+        return;
+    }
+    start_client_response(c);
+}
+
+// 링(또는 파이프)에 쌓여 클라이언트로 나갈 본문 바이트 수
+static size_t relay_buffered(connection *c) {
+    return c->splicing ? c->pipe_len : c->ring.len;
+}
+
+// 링(또는 파이프)에 더 받을 수 있는 바이트 수
+static size_t relay_space(connection *c) {
+    return c->splicing ? c->pipe_cap - c->pipe_len : c->ring.cap - c->ring.len;
+}
+
+// 캐시 적중 응답의 전체 바이트 수 (HEAD 면 본문 제외)
+static size_t cached_length(connection *c) {
+    size_t len = c->cached->iov[CACHE_IOV_HEAD].iov_len + c->head_len;
+    return c->is_head ? len : len + c->cached->iov[CACHE_IOV_BODY].iov_len;
+}
+
+// 클라이언트에 아직 보내지 않은 바이트 수
+static size_t client_pending(connection *c) {
+    if (c->cached != NULL) {
+        return cached_length(c) - c->response_sent;
+    }
+    size_t prefix = c->head_len + (c->response_len - c->body_offset);
+    return prefix - c->response_sent + relay_buffered(c);
+}
+
+// 본문을 중계하다 백엔드 쪽에서 끊기거나 오류: 이미 클라이언트로 일부를 보냈으므로 stale 로 대신할 수 없음
+static void relay_failed(connection *c) {
+    end_upstream_request(c, LB_RESULT_FAILURE);
+    connection_close(c);
+}
+
+// 백엔드 소켓 → 파이프. 본문은 사용자 공간으로 복사되지 않음
+static int splice_read_backend(connection *c) {
+    size_t len = relay_space(c);
+    if (c->body_mode == BODY_LENGTH && len > c->body_remaining) {
+        len = c->body_remaining;
+    }
+
+    ssize_t n = splice(c->backend.fd, NULL, c->pipe_fds[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+        c->pipe_len += n;
+        if (c->body_mode == BODY_LENGTH) {
+            c->body_remaining -= n;
+            if (c->body_remaining == 0) {
+                finish_backend(c);
+            }
+        }
+        return 1;
+    }
+    if (n == 0) {
+        if (c->body_mode != BODY_UNTIL_EOF) {
+            fprintf(stderr, "Backend closed connection before the response completed\n");
+            relay_failed(c);
+            return -1;
+        }
+        c->upstream_keep_alive = 0;
+        finish_backend(c);
+        return 1;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+    }
+    if (errno == EINTR) {
+        return 1;
+    }
+    perror("Failed to splice response from backend server");
+    relay_failed(c);
+    return -1;
+}
+
+// 파이프 → 클라이언트 소켓
+static int splice_write_client(connection *c) {
+    ssize_t n = splice(c->pipe_fds[0], NULL, c->client.fd, NULL, c->pipe_len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+        c->pipe_len -= n;
+        return 1;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (n < 0 && errno == EINTR) {
+        return 1;
+    }
+    perror("Failed to splice response to client");
+    connection_close(c);
+    return -1;
+}
+
+// 백엔드 → 링 버퍼. 읽었으면 1, 읽을 것이 없으면 0, 연결을 닫았으면 -1
+static int relay_read_backend(connection *c) {
+    if (c->splicing) {
+        return splice_read_backend(c);
+    }
+
+    struct iovec iov[2];
+    size_t limit = c->body_mode == BODY_LENGTH ? c->body_remaining : (size_t)-1;
+    int iovcnt = ring_space_iov(&c->ring, iov, limit);
+
+    ssize_t n = readv(c->backend.fd, iov, iovcnt);
+    if (n > 0) {
+        size_t first = (size_t)n < iov[0].iov_len ? (size_t)n : iov[0].iov_len;
+        size_t used = body_accept(c, iov[0].iov_base, first);
+        if (used == first && (size_t)n > first) {
+            used += body_accept(c, iov[1].iov_base, n - first);
+        }
+        c->ring.len += used;
+        if (c->backend_done) {
+            finish_backend(c);
+        }
+        return 1;
+    }
+    if (n == 0) {
+        // 길이를 알려준 응답이 중간에 끊기면 클라이언트 연결도 닫아 잘렸음을 알림
+        if (c->body_mode != BODY_UNTIL_EOF) {
+            fprintf(stderr, "Backend closed connection before the response completed\n");
+            relay_failed(c);
+            return -1;
+        }
+        c->upstream_keep_alive = 0;
+        finish_backend(c);
+        return 1;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+    }
+    if (errno == EINTR) {
+        return 1;
+    }
+    perror("Failed to receive response from backend server");
+    relay_failed(c);
+    return -1;
+}
+
+// parts 를 이어 붙인 바이트 중 response_sent 부터 → 클라이언트 (writev 한 번)
+static int write_parts(connection *c, const struct iovec *parts, int count) {
+    struct iovec iov[3];
+    int iovcnt = 0;
+    size_t skip = c->response_sent;
+    for (int i = 0; i < count; i++) {
+        if (skip >= parts[i].iov_len) {
+            skip -= parts[i].iov_len;
+            continue;
+        }
+        iov[iovcnt].iov_base = (char *)parts[i].iov_base + skip;
+        iov[iovcnt].iov_len = parts[i].iov_len - skip;
+        iovcnt++;
+        skip = 0;
+    }
+
+    ssize_t n = writev(c->client.fd, iov, iovcnt);
+    if (n > 0) {
+        c->response_sent += n;
+        return 1;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (n < 0 && errno == EINTR) {
+        return 1;
+    }
+    perror("Failed to send response");
+    connection_close(c);
+    return -1;
+}
+
+// 캐시 항목 헤더, Connection 헤더, 항목 본문 → 클라이언트 (이미 보낸 부분은 건너뜀)
+static int write_cached(connection *c) {
+    struct iovec parts[3];
+    parts[0] = c->cached->iov[CACHE_IOV_HEAD];
+    parts[1].iov_base = c->head;
+    parts[1].iov_len = c->head_len;
+    parts[2] = c->cached->iov[CACHE_IOV_BODY];
+    return write_parts(c, parts, c->is_head ? 2 : 3);
+}
+
+// 재작성한 헤더, 헤더와 함께 읽힌 본문, 링 버퍼 → 클라이언트 (writev 한 번)
+static int relay_write_client(connection *c) {
+    struct iovec iov[4];
+    int iovcnt = 0;
+    size_t leftover = c->response_len - c->body_offset;
+    size_t prefix = c->head_len + leftover;
+
+    // 클라이언트 없는 갱신 연결: 보낼 데이터는 버림
+    if (c->background) {
+        c->response_sent = c->cached != NULL ? cached_length(c) : prefix;
+        ring_consume(&c->ring, c->ring.len);
+        return 1;
+    }
+    if (c->cached != NULL) {
+        return write_cached(c);
+    }
+    // splice 중이면 헤더와 본문 앞부분을 먼저 다 보낸 뒤 파이프를 비움
+    if (c->splicing && c->response_sent == prefix) {
+        return splice_write_client(c);
+    }
+
+    if (c->response_sent < c->head_len) {
+        iov[iovcnt].iov_base = c->head + c->response_sent;
+        iov[iovcnt].iov_len = c->head_len - c->response_sent;
+        iovcnt++;
+        if (leftover > 0) {
+            iov[iovcnt].iov_base = c->response + c->body_offset;
+            iov[iovcnt].iov_len = leftover;
+            iovcnt++;
+        }
+    } else if (c->response_sent < prefix) {
+        size_t done = c->response_sent - c->head_len;
+        iov[iovcnt].iov_base = c->response + c->body_offset + done;
+        iov[iovcnt].iov_len = leftover - done;
+        iovcnt++;
+    }
+    if (!c->splicing) {
+        iovcnt += ring_data_iov(&c->ring, iov + iovcnt);
+    }
+
+    ssize_t n = writev(c->client.fd, iov, iovcnt);
+    if (n > 0) {
+        size_t from_prefix = prefix - c->response_sent;
+        if (from_prefix > (size_t)n) {
+            from_prefix = n;
+        }
+        c->response_sent += from_prefix;
+        ring_consume(&c->ring, n - from_prefix);
+        return 1;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (n < 0 && errno == EINTR) {
+        return 1;
+    }
+    perror("Failed to send response");
+    return client_failed(c) ? 1 : -1;
+}
+
+// 응답을 다 보낸 뒤 다음 요청을 받을 준비. 파이프라인된 요청이 있으면 바로 처리
+static void finish_request(connection *c) {
+    c->request_count++;
+
+    memmove(c->request, c->request + c->request_end, c->request_len - c->request_end);
+    c->request_len -= c->request_end;
+    c->request[c->request_len] = '\0';
+    c->request_end = 0;
+    http_parser_init(&c->request_head, HTTP_REQUEST);
+    c->response_len = 0;
+    c->response_sent = 0;
+    c->head_len = 0;
+    c->forward_len = 0;
+    c->body_offset = 0;
+    c->backend_done = 0;
+    c->splicing = 0;
+    c->ring.start = 0;
+    c->ring.len = 0;
+
+    // 요청 사이에 쉬는 keep-alive 연결은 버퍼를 들고 있지 않도록 아레나에 반납
+    buffer_release(c, &c->forward, &c->forward_cap);
+    buffer_release(c, &c->response, &c->response_cap);
+    buffer_release(c, &c->head, &c->head_cap);
+    buffer_release(c, &c->ring.data, &c->ring.cap);
+    if (c->cache_fill != NULL) {
+        coalesce_body_release(c->cache_fill);
+        c->cache_fill = NULL;
+    }
+    if (c->request_len == 0) {
+        buffer_release(c, &c->request, &c->request_cap);
+    }
+    if (c->cached != NULL) {
+        cache_release(c->cached);
+        c->cached = NULL;
+    }
+    if (c->stale != NULL) {
+        cache_release(c->stale);
+        c->stale = NULL;
+    }
+
+    c->state = CONN_READING_REQUEST;
+    if (reactor_watch(c->reactor, &c->client, EPOLLIN) < 0) {
+        connection_close(c);
+        return;
+    }
+    if (c->request_len > 0) {
+        start_request(c);
+    }
+}
+
+// 함께 중계하며 보내는 중인 조각의 바이트 수: head(응답 헤더나 청크 길이 줄), 본문, chunked 면 청크 끝 CRLF
+static size_t frame_size(connection *c) {
+    int crlf = c->stream_chunked && (c->frame_len > 0 || c->stream_last);
+    return c->head_len + c->frame_len + (crlf ? 2 : 0);
+}
+
+static int append_chunk_line(connection *c, size_t len) {
+    char line[24];
+    int n = snprintf(line, sizeof(line), "%zx\r\n", len);
+    return buffer_append(c, &c->head, &c->head_len, &c->head_cap, line, n);
+}
+
+// 보내는 중인 조각 → 클라이언트. 본문은 리더의 버퍼에서 복사하지 않고 보냄
+static int write_stream(connection *c) {
+    const char *data;
+    coalesce_body_read(c->stream, &data);
+    struct iovec parts[3];
+    parts[0].iov_base = c->head;
+    parts[0].iov_len = c->head_len;
+    parts[1].iov_base = c->frame_len > 0 ? (char *)data + c->stream_sent : NULL;
+    parts[1].iov_len = c->frame_len;
+    parts[2].iov_base = (char *)"\r\n";
+    parts[2].iov_len = frame_size(c) - c->head_len - c->frame_len;
+    return write_parts(c, parts, 3);
+}
+
+// 함께 중계를 마침: flight 를 놓고 다음 요청을 받거나 연결 종료
+static void finish_stream(connection *c) {
+    if (!c->keep_alive) {
+        connection_close(c);
+        return;
+    }
+    coalesce_leave(c->flight, 0);
+    c->flight = NULL;
+    c->stream = NULL;
+    finish_request(c);
+}
+
+// 리더가 공개한 본문 b 를 함께 중계 시작. 길이를 모르면 chunked 로 (이미 다 받았으면 Content-Length)
+static void start_stream(connection *c, coalesce_body *b, int state) {
+    char line[64];
+    int n = 0;
+    c->stream = b;
+    c->stream_sent = 0;
+    c->frame_len = 0;
+    c->stream_last = 0;
+    c->stream_chunked = !b->sized && state != COALESCE_BODY_COMPLETE;
+    if (!b->sized) {
+        n = c->stream_chunked ? snprintf(line, sizeof(line), "Transfer-Encoding: chunked\r\n")
+                              : snprintf(line, sizeof(line), "Content-Length: %zu\r\n", coalesce_body_length(b));
+    }
+
+    c->head_len = 0;
+    if (buffer_append(c, &c->head, &c->head_len, &c->head_cap, b->head, b->head_len) < 0 ||
+        buffer_append(c, &c->head, &c->head_len, &c->head_cap, line, n) < 0 || append_connection_headers(c) < 0) {
+        connection_close(c);
+        return;
+    }
+    printf("Streaming coalesced response for URL: %s\n", c->url);
+    c->response_sent = 0;
+    c->state = CONN_RELAYING_FLIGHT;
+    relay_stream(c);
+}
+
+// 리더가 공개한 본문 → 클라이언트. 공개된 것을 다 보냈으면 리더가 더 받을 때까지 reactor 의 대기 목록에서 기다림
+static void relay_stream(connection *c) {
+    while (1) {
+        if (c->response_sent == frame_size(c)) {
+            if (c->stream_last) {
+                finish_stream(c);
+                return;
+            }
+            // 다 보낸 조각을 넘기고 공개된 만큼으로 다음 조각을 잡음 (상태를 먼저 읽어야 끝난 뒤의 길이를 봄)
+            c->stream_sent += c->frame_len;
+            c->frame_len = 0;
+            c->head_len = 0;
+            c->response_sent = 0;
+            int state = coalesce_body_state(c->stream);
+            size_t published = coalesce_body_length(c->stream);
+            if (state == COALESCE_BODY_ABORTED) {
+                // 응답을 이미 보내기 시작했으므로 연결을 닫아 클라이언트가 잘렸음을 알게 함
+                fprintf(stderr, "Coalesced response aborted for URL: %s\n", c->url);
+                connection_close(c);
+                return;
+            }
+            if (published > c->stream_sent) {
+                c->frame_len = published - c->stream_sent;
+                if (c->stream_chunked && append_chunk_line(c, c->frame_len) < 0) {
+                    connection_close(c);
+                    return;
+                }
+            } else if (state == COALESCE_BODY_COMPLETE) {
+                if (!c->stream_chunked) {
+                    finish_stream(c);
+                    return;
+                }
+                c->stream_last = 1;
+                if (append_chunk_line(c, 0) < 0) {
+                    connection_close(c);
+                    return;
+                }
+            } else {
+                // 표시한 뒤 다시 확인해야 그 사이에 덧붙인 것을 놓치지 않음
+                coalesce_want(c->flight);
+                if (coalesce_body_state(c->stream) != COALESCE_BODY_FILLING || coalesce_body_length(c->stream) > c->stream_sent) {
+                    continue;
+                }
+                c->flight_next = c->reactor->flight_waiting;
+                c->reactor->flight_waiting = c;
+                if (reactor_watch(c->reactor, &c->client, 0) < 0) {
+                    connection_close(c);
+                }
+                return;
+            }
+        }
+
+        int w = write_stream(c);
+        if (w < 0) {
+            return;
+        }
+        if (w == 0) {
+            if (reactor_watch(c->reactor, &c->client, EPOLLOUT) < 0) {
+                connection_close(c);
+            }
+            return;
+        }
+    }
+}
+
+// 백엔드 → 링 버퍼 → 클라이언트 중계. 링이 차면 백엔드 읽기를, 보낼 것이 없으면 클라이언트 쓰기를 멈춤
+static void relay_response(connection *c) {
+    int backend_blocked = c->backend_done;
+    int client_blocked = 0;
+
+    while (1) {
+        int progress = 0;
+
+        if (!backend_blocked && relay_space(c) > 0) {
+            int r = relay_read_backend(c);
+            if (r < 0) {
+                return;
+            }
+            progress |= r;
+            backend_blocked = r == 0 || c->backend_done;
+        }
+        if (!client_blocked && client_pending(c) > 0) {
+            int w = relay_write_client(c);
+            if (w < 0) {
+                return;
+            }
+            progress |= w;
+            client_blocked = w == 0;
+        }
+        if (!progress) {
+            break;
+        }
+    }
+
+    if (c->backend_done && client_pending(c) == 0) {
+        if (c->keep_alive) {
+            finish_request(c);
+        } else {
+            connection_close(c);
+        }
+        return;
+    }
+
+    if (c->backend_done) {
+        c->state = CONN_WRITING_CLIENT;
+    } else if (relay_space(c) > 0) {
+        if (reactor_watch(c->reactor, &c->backend, EPOLLIN) < 0) {
+            connection_close(c);
+            return;
+        }
+    } else if (c->backend.registered) {
+        reactor_watch(c->reactor, &c->backend, 0);
+    }
+
+    if (reactor_watch(c->reactor, &c->client, client_pending(c) > 0 ? EPOLLOUT : 0) < 0) {
+        connection_close(c);
+    }
+}
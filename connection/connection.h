@@ -0,0 +1,158 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "../reactor/reactor.h"
+#include "../upstream/upstream_pool.h"
+#include "../http/http_parser.h"
+#include "../http/chunked.h"
+#include "../cache/cache.h"
+#include "../cache/coalesce.h"
+
+#define CONN_IDLE_TIMEOUT 30     // 이벤트 없이 이 시간(초)이 지나면 연결 종료
+#define RELAY_BUFFER_SIZE 16384  // 연결마다 응답 본문을 중계하는 링 버퍼 크기
+#define SPLICE_PIPE_SIZE 65536   // splice 중계용 파이프 크기
+
+// 클라이언트-백엔드 한 쌍의 처리 단계
+typedef enum {
+    CONN_READING_REQUEST,   // 클라이언트 요청 수신 중
+    CONN_WAITING_DISK,      // 캐시 I/O 스레드가 디스크 계층의 항목을 RAM 으로 올리기를 기다리는 중
+    CONN_WAITING_FLIGHT,    // 같은 URL 을 가져오는 다른 연결이 응답 헤더를 받기(또는 끝나기)를 기다리는 중
+    CONN_RELAYING_FLIGHT,   // 같은 URL 을 가져오는 다른 연결이 받는 본문을 받는 대로 함께 중계 중
+    CONN_WAITING_UPSTREAM,  // 백엔드 최대 연결 수 초과로 풀 반납 대기 중
+    CONN_CONNECTING,        // 백엔드 non-blocking connect 진행 중
+    CONN_WRITING_UPSTREAM,  // 백엔드로 요청 전달 중
+    CONN_READING_RESPONSE,  // 백엔드 응답 헤더 수신 중
+    CONN_RELAYING_RESPONSE, // 백엔드 본문을 받는 대로 클라이언트로 중계 중
+    CONN_WRITING_CLIENT,    // 백엔드 응답은 끝났고 남은 데이터를 클라이언트로 전송 중
+    CONN_CLOSED             // 닫힘, reactor 배치 종료 후 해제 대기
+} conn_state;
+
+// 고정 크기 링 버퍼: 백엔드에서 읽은 본문을 클라이언트가 가져갈 때까지 보관
+typedef struct {
+    char *data;
+    size_t cap;
+    size_t start;           // 다음에 보낼 위치
+    size_t len;             // 저장된 바이트 수
+} ring_buffer;
+
+typedef struct connection {
+    conn_state state;
+    reactor *reactor;
+    endpoint client;
+    endpoint backend;
+    upstream_pool *pool;    // 현재 요청의 백엔드 풀
+    httpserver *server;     // 로드밸런서가 고른 백엔드. 요청이 끝나면 진행 중 요청 수를 돌려놓고 NULL
+    int upstream_trial;     // server 의 HALF_OPEN circuit breaker 시험 요청인지 (load_balancer_release 에 넘김)
+    long long upstream_started_us; // 백엔드를 고른 시각 (첫 바이트까지의 지연 측정용)
+    int backend_reused;     // 풀의 유휴 연결을 재사용했는지
+    int upstream_retried;   // 끊긴 유휴 연결 때문에 새 연결로 재시도했는지
+    int upstream_attempts;  // 이번 요청의 첫 시도와 다른 백엔드로의 재시도 수 (hedge 는 따로, 재시도 횟수에 세지 않음)
+    struct connection *wait_next; // 풀 대기열 링크
+
+    // hedge: 첫 바이트가 늦으면 다른 백엔드로 같은 요청을 보내고 먼저 응답한 쪽을 씀
+    endpoint hedge;         // fd 가 -1 이면 보낸 hedge 없음
+    conn_state hedge_state; // CONN_CONNECTING, CONN_WRITING_UPSTREAM, CONN_READING_RESPONSE
+    upstream_pool *hedge_pool;
+    httpserver *hedge_server;
+    int hedge_trial;        // upstream_trial 과 같음 (hedge_server 의 시험 요청인지)
+    int hedge_reused;
+    size_t hedge_sent;
+    long long hedge_started_us;
+    long long hedge_origin_us; // hedge 가 원래 요청 자리로 옮겨졌으면 원래 요청을 보낸 시각 (아니면 0)
+    long long hedge_at_us;  // 이 시각까지 첫 바이트가 없으면 hedge (0 이면 대기 목록에 없음)
+    struct connection *hedge_prev; // reactor 의 hedge 대기 목록 링크
+    struct connection *hedge_next;
+
+    char method[10];
+    char url[256];
+    char protocol[10];
+    int is_head;
+    int keep_alive;         // 이번 응답 후 클라이언트 연결 유지 여부
+    int request_count;      // 이 연결에서 응답을 마친 요청 수
+
+    char *request;          // 클라이언트에서 받은 바이트 (파이프라인된 다음 요청 포함)
+    size_t request_len;
+    size_t request_cap;
+    size_t request_end;     // 현재 요청의 끝 위치
+    http_parser request_head; // 현재 요청 헤더 (request 안의 오프셋)
+
+    char *forward;          // 백엔드로 보낼 요청 (hop-by-hop 헤더 정리)
+    size_t forward_len;
+    size_t forward_cap;
+    size_t forward_sent;
+
+    char *response;         // 백엔드 응답 헤더(+ 함께 읽힌 본문 앞부분) 또는 캐시 데이터 원문
+    size_t response_len;
+    size_t response_cap;
+    http_parser response_head; // 백엔드(또는 캐시) 응답 헤더 (response 안의 오프셋)
+    size_t body_offset;     // 원문에서 본문 시작 위치
+    size_t body_remaining;  // Content-Length 응답에서 아직 받지 않은 본문 바이트
+    int body_mode;          // 본문 끝을 판단하는 방식 (BODY_*)
+    chunked_decoder chunked; // chunked 본문의 청크 경계 추적
+    int backend_done;       // 백엔드 응답을 끝까지 받았는지
+    int upstream_keep_alive; // 응답 후 백엔드 연결을 풀에 반납할 수 있는지
+
+    ring_buffer ring;       // 본문 중계용 링 버퍼
+    int splicing;           // 본문을 사용자 공간을 거치지 않고 파이프로 splice 중계하는지
+    int pipe_fds[2];        // splice 중계용 파이프 (처음 필요할 때 생성, -1 이면 없음)
+    size_t pipe_len;        // 파이프에 들어있는 바이트 수
+    size_t pipe_cap;
+
+    coalesce_body *cache_fill; // 중계하면서 함께 모으는 캐시 저장용 본문, chunked 는 디코딩해서 (한도 초과 시 포기)
+                            // 합친 요청의 리더면 대기 중인 연결도 이것을 읽어 중계
+    int cache_filling;
+    struct cache_entry *cached; // 캐시 적중 시 전송 중인 항목 (참조 보유, 복사하지 않음)
+    struct cache_entry *stale;  // 재검증 중이거나 백엔드 오류 때 대신 보낼 만료 항목 (참조 보유)
+    int background;         // 클라이언트 없이 만료 항목을 갱신하는 연결 (client.fd 가 -1)
+    cache_freshness freshness;  // 저장할 응답의 신선도 (검증자는 response 안을 가리킴)
+    time_t request_time;    // 백엔드로 요청을 보내기 시작한 시각
+    time_t response_time;   // 백엔드 응답 헤더를 받은 시각
+
+    coalesce_flight *flight; // 같은 URL 의 캐시 미스를 합친 요청 (리더이거나 대기 중)
+    int flight_leader;      // 이 연결이 백엔드에서 가져오는 리더인지
+    long long flight_deadline; // 대기를 포기하고 직접 가져올 시각 (단조 시계 ms)
+    struct connection *flight_next; // reactor 의 대기 목록 링크
+    coalesce_body *stream;  // 리더가 공개해 함께 중계 중인 본문 (참조는 flight 가 보유)
+    size_t stream_sent;     // 클라이언트로 다 보낸 본문 바이트 수
+    size_t frame_len;       // 보내는 중인 조각(head 다음)의 본문 바이트 수
+    int stream_chunked;     // 길이를 모르는 본문을 chunked 로 나눠 보내는지 (조각마다 청크 하나)
+    int stream_last;        // chunked 의 마지막 빈 청크를 보내는 중
+
+    cache_disk_read *disk_read; // 기다리는 디스크 계층 읽기
+    int disk_may_coalesce;  // 읽기가 끝나면 이 값으로 요청 처리를 이어감
+    struct connection *disk_next; // reactor 의 디스크 대기 목록 링크
+
+    char *head;             // 클라이언트로 보낼 응답 헤더 (Connection 헤더 재작성), 함께 중계할 때는 청크 길이 줄
+    size_t head_len;
+    size_t head_cap;
+    size_t response_sent;   // 클라이언트로 보낸 헤더 + 원문 본문 앞부분 바이트 수
+
+    time_t last_active;
+    struct connection *prev;
+    struct connection *next;
+} connection;
+
+connection *connection_create(reactor *r, int client_sock);
+void connection_handle(connection *c, endpoint *ep, uint32_t events);
+void connection_close(connection *c);
+
+// 풀 대기 중이던 연결에 백엔드 연결/자리가 생겼을 때 upstream 풀이 호출
+void connection_resume_upstream(connection *c);
+
+// 기다리던 요청이 끝났거나 대기 시간이 지난 연결을 이어서 처리 (reactor 루프에서 호출)
+void connection_check_flights(reactor *r);
+
+// 디스크 계층 읽기가 끝난 연결을 이어서 처리 (reactor 루프에서 호출)
+void connection_check_disk_reads(reactor *r);
+
+// hedge 시각이 된 요청을 다른 백엔드로도 보냄. 다음 hedge 시각까지 남은 ms 반환 (없으면 -1)
+int connection_check_hedges(reactor *r);
+
+// reactor 루프에서 호출: 닫힌 연결 해제, 유휴 연결 정리
+void connection_reap(reactor *r);
+void connection_sweep(reactor *r, time_t now);
+
+#endif
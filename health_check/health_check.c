@@ -2,46 +2,339 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include "health_check.h"
+#include "../http/http_parser.h"
 
-#define HEALTH_CHECK_INTERVAL 5
+#define PROBE_RESPONSE_MAX 1024 // 상태 줄만 보면 되므로 이 안에 없으면 실패
 
-void *health_check(void *args) {
-    health_check_args *check_args = (health_check_args *)args;
-    httpserver *servers = check_args->servers;
-    int server_count = check_args->server_count;
-    while (1) {
-        for (int i = 0; i < server_count; i++) {
-            int sock = socket(AF_INET, SOCK_STREAM, 0);
-            if (sock < 0) {
-                perror("Socket creation failed for health check");
+typedef enum {
+    PROBE_IDLE,       // 다음 검사 시각을 기다리는 중
+    PROBE_CONNECTING, // non-blocking connect 진행 중
+    PROBE_WRITING,    // HTTP 검사 요청 전송 중
+    PROBE_READING     // 응답 상태 줄 수신 중
+} probe_state;
+
+// 서버 하나의 검사 상태
+typedef struct {
+    httpserver *server;
+    probe_state state;
+    int fd;
+    long long due_ms;      // IDLE: 다음 검사를 시작할 시각
+    long long deadline_ms; // 진행 중: 이 시각까지 끝나지 않으면 실패
+    int successes;         // 연속 성공 수
+    int failures;          // 연속 실패 수
+    char request[512];
+    size_t request_len;
+    size_t sent;
+    char response[PROBE_RESPONSE_MAX];
+    size_t response_len;
+    http_parser head;
+} probe;
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static uint32_t random_state = 0x9e3779b9;
+
+static uint32_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// interval ± jitter%. 서버들의 검사 시각이 한 순간에 몰리지 않도록
+static long long jittered(const health_check_args *args) {
+    long spread = args->interval_ms * args->jitter_percent / 100;
+    if (spread <= 0) {
+        return args->interval_ms;
+    }
+    return args->interval_ms - spread + (long long)(next_random() % (uint32_t)(2 * spread + 1));
+}
+
+// 연속 결과가 rise/fall 에 닿을 때만 is_healthy 를 바꿈. 로드밸런서는 atomic 으로 읽으므로 락 없이 바로 반영
+// (되살아난 서버는 로드밸런서의 slow start 로 받는 몫을 늘려 감)
+static void probe_done(probe *p, int ok, const health_check_args *args, const char *reason) {
+    if (p->fd >= 0) {
+        close(p->fd);
+        p->fd = -1;
+    }
+    p->state = PROBE_IDLE;
+    p->due_ms = monotonic_ms() + jittered(args);
+
+    httpserver *server = p->server;
+    int healthy = atomic_load(&server->is_healthy);
+    if (ok) {
+        p->failures = 0;
+        if (++p->successes >= args->rise && !healthy) {
+            load_balancer_set_healthy(server, 1);
+            printf("Server %s:%d is healthy\n", server->ip, server->port);
+        }
+    } else {
+        p->successes = 0;
+        if (++p->failures >= args->fall && healthy) {
+            load_balancer_set_healthy(server, 0);
+            printf("Server %s:%d is unhealthy (%s)\n", server->ip, server->port, reason);
+        }
+    }
+    fflush(stdout);
+}
+
+// 서버 하나의 검사를 만듦. 검사가 있는 동안 서버의 refs 를 쥠 (설정에서 빠져도 해제되지 않도록)
+static probe *probe_create(httpserver *server, const health_check_args *args, long long due_ms) {
+    probe *p = calloc(1, sizeof(probe));
+    if (p == NULL) {
+        perror("Failed to allocate health check");
+        return NULL;
+    }
+    p->server = server;
+    p->fd = -1;
+    p->due_ms = due_ms;
+    if (args->path != NULL && args->path[0] != '\0') {
+        int n = snprintf(p->request, sizeof(p->request),
+                         "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: reverse-proxy-health-check\r\nConnection: close\r\n\r\n",
+                         args->path, server->ip, server->port);
+        p->request_len = n > 0 && (size_t)n < sizeof(p->request) ? (size_t)n : 0;
+    }
+    atomic_fetch_add(&server->refs, 1);
+    return p;
+}
+
+static void probe_destroy(probe *p) {
+    if (p->fd >= 0) {
+        close(p->fd); // epoll 에서도 빠짐
+    }
+    atomic_fetch_sub(&p->server->refs, 1);
+    free(p);
+}
+
+static void probe_start(probe *p, int epfd, const health_check_args *args) {
+    httpserver *server = p->server;
+    p->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (p->fd < 0) {
+        perror("Socket creation failed for health check");
+        probe_done(p, 0, args, "socket");
+        return;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server->port);
+    inet_pton(AF_INET, server->ip, &addr.sin_addr);
+
+    p->deadline_ms = monotonic_ms() + args->timeout_ms;
+    p->sent = 0;
+    p->response_len = 0;
+    if (connect(p->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        probe_done(p, 0, args, strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = p};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, p->fd, &ev) < 0) {
+        perror("Failed to watch health check socket");
+        probe_done(p, 0, args, "epoll");
+        return;
+    }
+    p->state = PROBE_CONNECTING;
+}
+
+static int status_expected(int status, const health_check_args *args) {
+    return args->expect_status > 0 ? status == args->expect_status : status >= 200 && status < 400;
+}
+
+// 소켓 이벤트에 따라 검사를 진행. TCP 검사는 연결되면 성공, HTTP 검사는 상태 줄까지 읽고 판단
+static void probe_event(probe *p, int epfd, const health_check_args *args) {
+    if (p->state == PROBE_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            probe_done(p, 0, args, strerror(err ? err : errno));
+            return;
+        }
+        if (p->request_len == 0) {
+            probe_done(p, 1, args, NULL);
+            return;
+        }
+        p->state = PROBE_WRITING;
+    }
+
+    if (p->state == PROBE_WRITING) {
+        while (p->sent < p->request_len) {
+            ssize_t n = write(p->fd, p->request + p->sent, p->request_len - p->sent);
+            if (n > 0) {
+                p->sent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else if (n < 0 && errno == EINTR) {
                 continue;
+            } else {
+                probe_done(p, 0, args, "write");
+                return;
+            }
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = p};
+        epoll_ctl(epfd, EPOLL_CTL_MOD, p->fd, &ev);
+        http_parser_init(&p->head, HTTP_RESPONSE);
+        p->state = PROBE_READING;
+        return;
+    }
+
+    while (p->response_len < sizeof(p->response) - 1) {
+        ssize_t n = read(p->fd, p->response + p->response_len, sizeof(p->response) - 1 - p->response_len);
+        if (n > 0) {
+            p->response_len += n;
+            if (http_parse(&p->head, p->response, p->response_len) == HTTP_PARSE_ERROR) {
+                probe_done(p, 0, args, "bad response");
+                return;
+            }
+            if (p->head.started) {
+                char reason[32];
+                snprintf(reason, sizeof(reason), "status %d", p->head.status);
+                probe_done(p, status_expected(p->head.status, args), args, reason);
+                return;
             }
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            probe_done(p, 0, args, n == 0 ? "closed" : "read");
+            return;
+        }
+    }
+    probe_done(p, 0, args, "bad response");
+}
 
-            struct sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(servers[i].port);
-            inet_pton(AF_INET, servers[i].ip, &addr.sin_addr);
+// 검사 목록을 로드밸런서의 현재 백엔드 목록에 맞춤. 남은 서버의 검사는 진행 중인 것도 그대로 옮기고,
+// 빠진 서버의 검사는 닫고, 새 서버는 jitter 범위 안에서 곧 첫 검사
+static int sync_probes(probe ***probes, int *probe_count, const health_check_args *args) {
+    int count;
+    httpserver *const *servers = load_balancer_servers(&count, NULL);
+    probe **synced = calloc(count > 0 ? count : 1, sizeof(probe *));
+    if (synced == NULL) {
+        perror("Failed to allocate health checks");
+        return -1;
+    }
+    probe **old = *probes;
 
-            // 서버 연결 확인
-            if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
-                servers[i].is_healthy = 1;
-                printf("Server %s:%d is healthy\n", servers[i].ip, servers[i].port);
-            } else {
-                servers[i].is_healthy = 0;
-                printf("Server %s:%d is unhealthy\n", servers[i].ip, servers[i].port);
+    long spread = args->interval_ms * args->jitter_percent / 100;
+    long long now = monotonic_ms();
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < *probe_count; j++) {
+            if (old[j] != NULL && old[j]->server == servers[i]) {
+                synced[i] = old[j];
+                old[j] = NULL;
+                break;
+            }
+        }
+        if (synced[i] == NULL) {
+            synced[i] = probe_create(servers[i], args, now + (spread > 0 ? next_random() % (uint32_t)(spread + 1) : 0));
+        }
+    }
+    for (int j = 0; j < *probe_count; j++) {
+        if (old[j] != NULL) {
+            probe_destroy(old[j]);
+        }
+    }
+    free(old);
+
+    // 만들지 못한 검사는 빼고 모음 (다음에 목록이 바뀔 때 다시 시도)
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (synced[i] != NULL) {
+            synced[n++] = synced[i];
+        }
+    }
+    *probes = synced;
+    *probe_count = n;
+    return 0;
+}
+
+void *health_check(void *args) {
+    health_check_args *check_args = (health_check_args *)args;
+    if (check_args->interval_ms <= 0) {
+        check_args->interval_ms = 1000;
+    }
+    if (check_args->timeout_ms <= 0 || check_args->timeout_ms > check_args->interval_ms) {
+        check_args->timeout_ms = check_args->interval_ms;
+    }
+    if (check_args->rise < 1) {
+        check_args->rise = 1;
+    }
+    if (check_args->fall < 1) {
+        check_args->fall = 1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("Failed to start health check");
+        return NULL;
+    }
+
+    // 처음 검사는 jitter 범위 안에서 흩어 시작
+    random_state ^= (uint32_t)time(NULL);
+    probe **probes = NULL;
+    int probe_count = 0;
+    unsigned generation = 0;
+
+    struct epoll_event events[16];
+    while (1) {
+        // 지난 바퀴에서 읽은 백엔드 목록은 더 쓰지 않음. 목록이 바뀌었으면 검사 대상을 맞춤
+        load_balancer_quiescent();
+        unsigned current;
+        int count;
+        load_balancer_servers(&count, &current);
+        if (current != generation && sync_probes(&probes, &probe_count, check_args) == 0) {
+            generation = current;
+        }
+
+        // 때가 된 검사를 시작하고, 다음에 깨어날 시각(검사 시작 또는 제한 시간) 계산
+        long long now = monotonic_ms();
+        long long wake = now + check_args->interval_ms;
+        for (int i = 0; i < probe_count; i++) {
+            probe *p = probes[i];
+            if (p->state == PROBE_IDLE && p->due_ms <= now) {
+                probe_start(p, epfd, check_args);
             }
+            long long at = p->state == PROBE_IDLE ? p->due_ms : p->deadline_ms;
+            if (at < wake) {
+                wake = at;
+            }
+        }
 
-            close(sock);
+        int timeout = wake > now ? (int)(wake - now) : 0;
+        int n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), timeout);
+        if (n < 0 && errno != EINTR) {
+            perror("Health check epoll_wait failed");
+            sleep(1);
+        }
+        for (int i = 0; i < n; i++) {
+            probe *p = events[i].data.ptr;
+            if (p->state != PROBE_IDLE) {
+                probe_event(p, epfd, check_args);
+            }
         }
 
-        // HEALTH_CHECK_INTERVAL 초 동안 대기
-        sleep(HEALTH_CHECK_INTERVAL);
+        // 응답 없는 서버(패킷을 버리는 서버 포함)는 제한 시간에 실패로 끝냄
+        now = monotonic_ms();
+        for (int i = 0; i < probe_count; i++) {
+            if (probes[i]->state != PROBE_IDLE && probes[i]->deadline_ms <= now) {
+                probe_done(probes[i], 0, check_args, "timeout");
+            }
+        }
     }
 
     return NULL;
-}
\ No newline at end of file
+}
@@ -4,10 +4,17 @@
 #include "../load_balancer/load_balancer.h"
 
 typedef struct {
-    httpserver *servers;
-    int server_count;
+    long interval_ms;   // 서버마다의 검사 간격, ± jitter_percent 만큼 무작위로 흩뜨림
+    int jitter_percent;
+    long timeout_ms;    // 검사 하나의 연결부터 응답까지 제한 시간
+    int rise;           // 비정상 서버를 정상으로 되돌리는 연속 성공 수
+    int fall;           // 정상 서버를 비정상으로 만드는 연속 실패 수
+    const char *path;   // 비어 있으면 TCP 연결만 확인, 있으면 이 경로로 HTTP GET
+    int expect_status;  // HTTP 검사의 기대 상태 코드, 0 이면 2xx/3xx
 } health_check_args;
 
+// 로드밸런서의 백엔드 목록 전체를 epoll 하나로 동시에 검사하는 스레드. 상태가 바뀔 때만 is_healthy 를 바꾸고 로그를 남김
+// 설정을 다시 읽어 목록이 바뀌면 검사 대상도 따라 바뀜
 void *health_check(void *args);
 
-#endif
\ No newline at end of file
+#endif
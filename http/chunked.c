@@ -0,0 +1,121 @@
+#include <string.h>
+#include "chunked.h"
+
+#define CHUNKED_MAX_SIZE_DIGITS 15 // 16진수 15자리면 uint64_t 를 넘지 않음
+
+void chunked_init(chunked_decoder *d) {
+    memset(d, 0, sizeof(*d));
+    d->state = CHUNKED_SIZE;
+}
+
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    ch |= 0x20;
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    return -1;
+}
+
+// 크기 줄이 끝났을 때: 0 이면 트레일러, 아니면 데이터
+static void end_size_line(chunked_decoder *d) {
+    d->state = d->remaining > 0 ? CHUNKED_DATA : CHUNKED_TRAILER;
+}
+
+size_t chunked_feed(chunked_decoder *d, const char *data, size_t len, chunked_sink sink, void *ctx) {
+    size_t i = 0;
+
+    while (i < len && d->state != CHUNKED_DONE && d->state != CHUNKED_ERROR) {
+        char ch = data[i];
+        switch (d->state) {
+            case CHUNKED_SIZE: {
+                int v = hex_value(ch);
+                if (v >= 0) {
+                    if (++d->size_digits > CHUNKED_MAX_SIZE_DIGITS) {
+                        d->state = CHUNKED_ERROR;
+                        break;
+                    }
+                    d->remaining = d->remaining * 16 + v;
+                } else if (d->size_digits == 0) {
+                    d->state = CHUNKED_ERROR;
+                    break;
+                } else if (ch == '\r') {
+                    d->state = CHUNKED_SIZE_LF;
+                } else if (ch == '\n') {
+                    end_size_line(d);
+                } else if (ch == ';' || ch == ' ' || ch == '\t') {
+                    d->state = CHUNKED_SIZE_EXT;
+                } else {
+                    d->state = CHUNKED_ERROR;
+                    break;
+                }
+                i++;
+                break;
+            }
+            case CHUNKED_SIZE_EXT:
+                if (ch == '\n') {
+                    end_size_line(d);
+                }
+                i++;
+                break;
+            case CHUNKED_SIZE_LF:
+                if (ch != '\n') {
+                    d->state = CHUNKED_ERROR;
+                    break;
+                }
+                end_size_line(d);
+                i++;
+                break;
+            case CHUNKED_DATA: {
+                // 청크 데이터는 한 번에 넘김
+                size_t take = len - i < d->remaining ? len - i : d->remaining;
+                if (sink != NULL) {
+                    sink(ctx, data + i, take);
+                }
+                i += take;
+                d->remaining -= take;
+                d->body_len += take;
+                if (d->remaining == 0) {
+                    d->state = CHUNKED_DATA_CR;
+                }
+                break;
+            }
+            case CHUNKED_DATA_CR:
+                if (ch == '\r') {
+                    d->state = CHUNKED_DATA_LF;
+                    i++;
+                    break;
+                }
+                // '\r' 없이 '\n' 만 오는 경우
+                // fall through
+            case CHUNKED_DATA_LF:
+                if (ch != '\n') {
+                    d->state = CHUNKED_ERROR;
+                    break;
+                }
+                d->state = CHUNKED_SIZE;
+                d->size_digits = 0;
+                i++;
+                break;
+            case CHUNKED_TRAILER:
+                d->state = ch == '\n' ? CHUNKED_DONE : ch == '\r' ? CHUNKED_TRAILER_CR : CHUNKED_TRAILER_LINE;
+                i++;
+                break;
+            case CHUNKED_TRAILER_CR:
+                d->state = ch == '\n' ? CHUNKED_DONE : CHUNKED_TRAILER_LINE;
+                i++;
+                break;
+            case CHUNKED_TRAILER_LINE:
+                if (ch == '\n') {
+                    d->state = CHUNKED_TRAILER;
+                }
+                i++;
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
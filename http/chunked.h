@@ -0,0 +1,46 @@
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// chunked 본문 해석 단계 (read 경계와 무관하게 이어서 진행)
+typedef enum {
+    CHUNKED_SIZE,         // 청크 크기 (16진수)
+    CHUNKED_SIZE_EXT,     // 크기 뒤 확장(;name=value)은 무시
+    CHUNKED_SIZE_LF,      // 크기 줄의 '\r' 뒤 '\n'
+    CHUNKED_DATA,
+    CHUNKED_DATA_CR,      // 데이터 뒤 줄바꿈
+    CHUNKED_DATA_LF,
+    CHUNKED_TRAILER,      // 마지막 청크 뒤 트레일러 줄의 시작 (빈 줄이면 끝)
+    CHUNKED_TRAILER_CR,
+    CHUNKED_TRAILER_LINE,
+    CHUNKED_DONE,
+    CHUNKED_ERROR
+} chunked_state;
+
+// 디코딩한 데이터 조각을 받는 함수 (입력 버퍼 안을 가리키므로 복사 없음)
+typedef void (*chunked_sink)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+    chunked_state state;
+    uint64_t remaining;   // 현재 청크에서 남은 데이터 바이트 (크기를 읽는 중이면 누적 값)
+    int size_digits;
+    uint64_t body_len;    // 지금까지 디코딩한 데이터 바이트 합
+} chunked_decoder;
+
+void chunked_init(chunked_decoder *d);
+
+// data 를 이어서 해석해 이 본문에 속한 바이트 수를 반환 (마지막 청크 뒤의 바이트는 남김)
+// sink 가 있으면 청크 데이터만 전달해 본문을 de-chunk 함. 원문은 손대지 않으므로 그대로 중계 가능
+size_t chunked_feed(chunked_decoder *d, const char *data, size_t len, chunked_sink sink, void *ctx);
+
+static inline int chunked_done(const chunked_decoder *d) {
+    return d->state == CHUNKED_DONE;
+}
+
+static inline int chunked_failed(const chunked_decoder *d) {
+    return d->state == CHUNKED_ERROR;
+}
+
+#endif
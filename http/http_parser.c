@@ -0,0 +1,319 @@
+#include <string.h>
+#include <strings.h>
+#include "http_parser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86 1
+#endif
+
+static const char *find_newline_scalar(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#ifdef HTTP_PARSER_X86
+// 16 바이트씩 비교해 '\n' 위치를 비트마스크로
+__attribute__((target("sse2")))
+static const char *find_newline_sse2(const char *p, const char *end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return find_newline_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *p, const char *end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return find_newline_sse2(p, end);
+}
+#endif
+
+static const char *(*find_newline_impl)(const char *, const char *) = find_newline_scalar;
+static int simd_level = HTTP_SIMD_SCALAR;
+
+int http_parser_use_simd(int level) {
+#ifdef HTTP_PARSER_X86
+    __builtin_cpu_init();
+    if (level >= HTTP_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+        find_newline_impl = find_newline_avx2;
+        simd_level = HTTP_SIMD_AVX2;
+        return simd_level;
+    }
+    if (level >= HTTP_SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+        find_newline_impl = find_newline_sse2;
+        simd_level = HTTP_SIMD_SSE2;
+        return simd_level;
+    }
+#else
+    (void)level;
+#endif
+    find_newline_impl = find_newline_scalar;
+    simd_level = HTTP_SIMD_SCALAR;
+    return simd_level;
+}
+
+int http_parser_simd_level(void) {
+    return simd_level;
+}
+
+// 스레드가 만들어지기 전에 CPU 가 지원하는 가장 넓은 구현을 고름
+__attribute__((constructor))
+static void select_newline_impl(void) {
+    http_parser_use_simd(HTTP_SIMD_AVX2);
+}
+
+const char *http_find_newline(const char *p, const char *end) {
+    return find_newline_impl(p, end);
+}
+
+void http_parser_init(http_parser *p, http_message_kind kind) {
+    memset(p, 0, offsetof(http_parser, headers));
+    p->kind = kind;
+}
+
+static http_slice slice(const char *buf, const char *start, const char *end) {
+    http_slice s;
+    s.off = start - buf;
+    s.len = end - start;
+    return s;
+}
+
+int http_has_token(const char *value, size_t value_len, const char *token) {
+    size_t token_len = strlen(token);
+    const char *end = value + value_len;
+
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t' || *value == ',')) {
+            value++;
+        }
+        const char *item = value;
+        while (value < end && *value != ',') {
+            value++;
+        }
+        const char *item_end = value;
+        while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t')) {
+            item_end--;
+        }
+        if ((size_t)(item_end - item) == token_len && strncasecmp(item, token, token_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// RFC 9110 tchar: 메서드와 헤더 이름에 쓸 수 있는 문자
+static const unsigned char token_chars[256] = {
+    ['!'] = 1, ['#'] = 1, ['$'] = 1, ['%'] = 1, ['&'] = 1, ['\''] = 1, ['*'] = 1, ['+'] = 1,
+    ['-'] = 1, ['.'] = 1, ['^'] = 1, ['_'] = 1, ['`'] = 1, ['|'] = 1, ['~'] = 1,
+    ['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1, ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+    ['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1, ['G'] = 1, ['H'] = 1, ['I'] = 1,
+    ['J'] = 1, ['K'] = 1, ['L'] = 1, ['M'] = 1, ['N'] = 1, ['O'] = 1, ['P'] = 1, ['Q'] = 1, ['R'] = 1,
+    ['S'] = 1, ['T'] = 1, ['U'] = 1, ['V'] = 1, ['W'] = 1, ['X'] = 1, ['Y'] = 1, ['Z'] = 1,
+    ['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1, ['g'] = 1, ['h'] = 1, ['i'] = 1,
+    ['j'] = 1, ['k'] = 1, ['l'] = 1, ['m'] = 1, ['n'] = 1, ['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1,
+    ['s'] = 1, ['t'] = 1, ['u'] = 1, ['v'] = 1, ['w'] = 1, ['x'] = 1, ['y'] = 1, ['z'] = 1,
+};
+
+static int is_token_char(unsigned char ch) {
+    return token_chars[ch];
+}
+
+// "HTTP/1.x" 확인 후 x 반환, 아니면 -1
+static int parse_version(const char *p, const char *end) {
+    if (end - p != 8 || memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9') {
+        return -1;
+    }
+    return p[7] - '0';
+}
+
+// METHOD SP target SP HTTP/1.x
+static int parse_request_line(http_parser *p, const char *buf, const char *line, const char *end) {
+    const char *sp1 = memchr(line, ' ', end - line);
+    if (sp1 == NULL || sp1 == line) {
+        return -1;
+    }
+    for (const char *it = line; it < sp1; it++) {
+        if (!is_token_char(*it)) {
+            return -1;
+        }
+    }
+    const char *target = sp1 + 1;
+    const char *sp2 = memchr(target, ' ', end - target);
+    if (sp2 == NULL || sp2 == target) {
+        return -1;
+    }
+
+    p->minor_version = parse_version(sp2 + 1, end);
+    if (p->minor_version < 0) {
+        return -1;
+    }
+    p->method = slice(buf, line, sp1);
+    p->target = slice(buf, target, sp2);
+    return 0;
+}
+
+// HTTP/1.x SP 3자리 상태 코드 [SP 사유]
+static int parse_status_line(http_parser *p, const char *buf, const char *line, const char *end) {
+    if (end - line < 12 || line[8] != ' ') {
+        return -1;
+    }
+    p->minor_version = parse_version(line, line + 8);
+    if (p->minor_version < 0) {
+        return -1;
+    }
+
+    const char *code = line + 9;
+    int status = 0;
+    for (int i = 0; i < 3; i++) {
+        if (code[i] < '0' || code[i] > '9') {
+            return -1;
+        }
+        status = status * 10 + (code[i] - '0');
+    }
+    if (code + 3 < end && code[3] != ' ') {
+        return -1;
+    }
+    p->status = status;
+    p->reason = code + 3 < end ? slice(buf, code + 4, end) : slice(buf, end, end);
+    return 0;
+}
+
+static int parse_content_length(http_parser *p, const char *value, size_t len) {
+    if (len == 0) {
+        return -1;
+    }
+    uint64_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] < '0' || value[i] > '9' || n > (UINT64_MAX - 9) / 10) {
+            return -1;
+        }
+        n = n * 10 + (value[i] - '0');
+    }
+    // 값이 다른 Content-Length 가 여럿이면 본문 경계를 믿을 수 없음
+    if (p->has_content_length && p->content_length != n) {
+        return -1;
+    }
+    p->has_content_length = 1;
+    p->content_length = n;
+    return 0;
+}
+
+// name: OWS value OWS
+static int parse_header_line(http_parser *p, const char *buf, const char *line, const char *end) {
+    if (p->header_count >= HTTP_MAX_HEADERS) {
+        return -1;
+    }
+
+    const char *colon = memchr(line, ':', end - line);
+    if (colon == NULL || colon == line) {
+        return -1;
+    }
+    // 이름 안의 공백, 줄 이어쓰기(obs-fold)는 거부
+    for (const char *it = line; it < colon; it++) {
+        if (!is_token_char(*it)) {
+            return -1;
+        }
+    }
+
+    const char *value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    const char *value_end = end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        value_end--;
+    }
+
+    http_header *h = &p->headers[p->header_count++];
+    h->name = slice(buf, line, colon);
+    h->value = slice(buf, value, value_end);
+
+    size_t name_len = colon - line;
+    size_t value_len = value_end - value;
+    if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+        return parse_content_length(p, value, value_len);
+    }
+    if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+        p->has_transfer_encoding = 1;
+        p->chunked |= http_has_token(value, value_len, "chunked");
+    } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+        p->has_connection = 1;
+        p->conn_close |= http_has_token(value, value_len, "close");
+        p->conn_keep_alive |= http_has_token(value, value_len, "keep-alive");
+    }
+    return 0;
+}
+
+int http_parse(http_parser *p, const char *buf, size_t len) {
+    if (p->done) {
+        return HTTP_PARSE_DONE;
+    }
+
+    const char *end = buf + len;
+    while (1) {
+        const char *nl = http_find_newline(buf + p->scanned, end);
+        if (nl == NULL) {
+            p->scanned = len;
+            return HTTP_PARSE_AGAIN;
+        }
+
+        const char *line = buf + p->line_start;
+        const char *line_end = nl > line && nl[-1] == '\r' ? nl - 1 : nl;
+        p->line_start = p->scanned = nl + 1 - buf;
+
+        if (line_end == line) {
+            if (!p->started) {
+                // 시작 줄 앞의 빈 줄은 무시 (RFC 9112 2.2)
+                if (p->kind == HTTP_REQUEST) {
+                    continue;
+                }
+                return HTTP_PARSE_ERROR;
+            }
+            p->head_len = p->line_start;
+            p->done = 1;
+            return HTTP_PARSE_DONE;
+        }
+
+        int rc;
+        if (!p->started) {
+            rc = p->kind == HTTP_REQUEST ? parse_request_line(p, buf, line, line_end)
+                                         : parse_status_line(p, buf, line, line_end);
+            p->started = 1;
+        } else {
+            rc = parse_header_line(p, buf, line, line_end);
+        }
+        if (rc < 0) {
+            return HTTP_PARSE_ERROR;
+        }
+    }
+}
+
+const http_header *http_header_find(const http_parser *p, const char *buf, const char *name) {
+    size_t name_len = strlen(name);
+    for (int i = 0; i < p->header_count; i++) {
+        const http_header *h = &p->headers[i];
+        if (h->name.len == name_len && strncasecmp(buf + h->name.off, name, name_len) == 0) {
+            return h;
+        }
+    }
+    return NULL;
+}
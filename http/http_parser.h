@@ -0,0 +1,84 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_MAX_HEADERS 64
+
+// http_parse 반환값
+#define HTTP_PARSE_ERROR (-1) // 형식 오류
+#define HTTP_PARSE_AGAIN 0    // 헤더가 아직 다 오지 않음, 더 받은 뒤 같은 파서로 다시 호출
+#define HTTP_PARSE_DONE 1     // 헤더 끝(빈 줄)까지 해석 완료
+
+// 줄바꿈 검색 구현
+enum {
+    HTTP_SIMD_SCALAR,
+    HTTP_SIMD_SSE2,
+    HTTP_SIMD_AVX2
+};
+
+// 버퍼 안의 위치. 버퍼가 커지면서 옮겨져도 유효하도록 포인터 대신 오프셋
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} http_slice;
+
+typedef struct {
+    http_slice name;
+    http_slice value;
+} http_header;
+
+typedef enum {
+    HTTP_REQUEST,
+    HTTP_RESPONSE
+} http_message_kind;
+
+// 요청/응답 헤더 파서. 바이트가 어디서 끊겨 들어와도 이어서 해석하고, 이미 훑은 바이트는 다시 보지 않음
+typedef struct {
+    http_message_kind kind;
+    int done;
+    int started;            // 시작 줄을 읽었는지
+    uint32_t line_start;    // 아직 끝나지 않은 줄의 시작
+    uint32_t scanned;       // 줄바꿈을 찾아 이미 훑은 위치
+    uint32_t head_len;      // 빈 줄까지 포함한 헤더 길이 (done 일 때)
+
+    // 시작 줄
+    http_slice method;      // 요청
+    http_slice target;
+    int minor_version;      // HTTP/1.x 의 x
+    int status;             // 응답
+    http_slice reason;
+
+    // 프록시가 직접 쓰는 헤더
+    int has_content_length;
+    uint64_t content_length;
+    int has_transfer_encoding;
+    int chunked;            // Transfer-Encoding 에 chunked 가 있음
+    int has_connection;
+    int conn_close;         // Connection: close
+    int conn_keep_alive;    // Connection: keep-alive
+
+    int header_count;
+    http_header headers[HTTP_MAX_HEADERS]; // header_count 까지만 유효 (초기화하지 않음)
+} http_parser;
+
+void http_parser_init(http_parser *p, http_message_kind kind);
+
+// buf[0..len) 을 이어서 해석. 호출마다 같은 버퍼의 앞부분은 그대로여야 함 (뒤에 덧붙이기만 가능)
+int http_parse(http_parser *p, const char *buf, size_t len);
+
+// 이름으로 헤더 검색 (대소문자 무시), 없으면 NULL
+const http_header *http_header_find(const http_parser *p, const char *buf, const char *name);
+
+// 쉼표로 구분된 헤더 값에 token 이 있는지 (대소문자 무시)
+int http_has_token(const char *value, size_t value_len, const char *token);
+
+// [p, end) 에서 첫 '\n' 위치, 없으면 NULL
+const char *http_find_newline(const char *p, const char *end);
+
+// 줄바꿈 검색 구현 선택 (CPU 가 지원하는 수준으로 제한). 실제 적용된 수준을 반환
+int http_parser_use_simd(int level);
+int http_parser_simd_level(void);
+
+#endif
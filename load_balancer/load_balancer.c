@@ -1,104 +1,857 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
 #include "load_balancer.h"
 
-#define MAX_HTTP_SERVERS 10
+#define RAMP_FULL 1000 // slow start 몫의 단위 (천분율)
+#define EWMA_PENALTY_US 10000000.0 // peak-EWMA: 측정값이 없는데 진행 중 요청이 있는 서버의 비용
 
-static httpserver http_servers[MAX_HTTP_SERVERS];
-static int http_server_count = 0;
-static int current_index = 0;
+static atomic_uint current_index;
+static httpserver *(*selected)(const char *, size_t) = weighted_round_robin;
+static double ewma_decay_us = 10e6;
+static lb_breaker_config breaker = {5, 50, 20, 10000, 1000, 60000};
+static long long slow_start_us = 0;
+static double slow_start_min = 0.1;
+static int slow_start_exponential = 0;
+
+// consistent_hash 의 링: 서버마다 가중치 x hash_vnodes 개의 가상 노드를 해시 순으로 정렬
+typedef struct {
+    uint64_t hash;
+    int server; // backend_set.servers 의 번호
+} ring_point;
+
+// 백엔드 목록 하나. 만든 뒤에는 바꾸지 않고, 목록이 바뀌면 새로 만들어 current_set 포인터만 바꿈 (RCU)
+typedef struct backend_set {
+    httpserver **servers;
+    int count;
+    ring_point *ring;
+    int ring_size;
+    unsigned generation;
+    unsigned long long free_epoch; // 밀려난 뒤: 모든 reader 가 이 epoch 를 지나면 해제
+    struct backend_set *retired_next;
+} backend_set;
+
+static _Atomic(backend_set *) current_set;
+static unsigned set_generation = 0;
+static int hash_vnodes = LB_DEFAULT_HASH_VNODES;
+
+// 목록을 읽는 스레드. 루프를 돌 때마다(load_balancer_quiescent) 그때의 epoch 를 기록
+// 해제할 것에 epoch 를 올려 붙여 두고, 모든 reader 가 그 epoch 를 지나면 옛 포인터를 쥔 reader 가 없음
+typedef struct lb_reader {
+    atomic_ullong seen;
+    struct lb_reader *next;
+} lb_reader;
+
+static atomic_ullong epoch = 1;
+static lb_reader *readers = NULL;
+static pthread_mutex_t readers_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread lb_reader *self_reader;
+
+// 해제를 기다리는 옛 목록과 빠진 서버 (load_balancer_update/reclaim 을 부르는 스레드만 사용)
+static backend_set *retired_sets = NULL;
+static httpserver *retired_servers = NULL;
+
+// smooth weighted round robin 의 current_weight 는 스레드마다 따로 가짐
+// 스레드 하나의 선택 순서가 가중치 비율을 지키므로 모든 스레드를 합쳐도 비율이 같음. 목록이 바뀌면 0 부터 다시
+static __thread int *current_weights;
+static __thread unsigned current_weights_generation;
+
+// power_of_two_choices 의 난수도 스레드마다 (xorshift32, 0 이 아닌 값으로 시작)
+static __thread uint32_t random_state;
+
+static backend_set *snapshot(void) {
+    return atomic_load_explicit(&current_set, memory_order_acquire);
+}
+
+static long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// 선택 대상: 능동 health check 로 건강하고, circuit breaker 가 닫혀 있거나 차단 시간이 끝나 시험 요청을 받을 수 있는 서버
+// 닫힌 상태(대부분)에서는 시계를 읽지 않음
+static int is_available(httpserver *server) {
+    if (!atomic_load_explicit(&server->is_healthy, memory_order_relaxed)) {
+        return 0;
+    }
+    int state = atomic_load_explicit(&server->breaker_state, memory_order_relaxed);
+    if (state == LB_BREAKER_CLOSED) {
+        return 1;
+    }
+    return state == LB_BREAKER_OPEN && monotonic_us() >= atomic_load_explicit(&server->open_until_us, memory_order_relaxed);
+}
+
+static uint32_t next_random(void) {
+    if (random_state == 0) {
+        random_state = (uint32_t)(uintptr_t)pthread_self() | 1;
+    }
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// slow start 중인 서버가 받을 몫 (천분율). 대부분의 서버는 시계를 읽지 않고 바로 RAMP_FULL
+// 직선: min + (1 - min) x t, 지수: min^(1 - t)  (t 는 0 에서 1 로 가는 경과 비율)
+static int ramp_permille(httpserver *server) {
+    long long until = atomic_load_explicit(&server->slow_start_until_us, memory_order_relaxed);
+    if (until == 0) {
+        return RAMP_FULL;
+    }
+    long long now = monotonic_us();
+    if (now >= until || slow_start_us <= 0) {
+        atomic_compare_exchange_strong(&server->slow_start_until_us, &until, 0);
+        return RAMP_FULL;
+    }
+    double t = 1.0 - (double)(until - now) / slow_start_us;
+    double share = slow_start_exponential ? pow(slow_start_min, 1.0 - t) : slow_start_min + (1.0 - slow_start_min) * t;
+    int permille = (int)(share * RAMP_FULL);
+    return permille < 1 ? 1 : permille > RAMP_FULL ? RAMP_FULL : permille;
+}
+
+static void start_slow_start(httpserver *server) {
+    if (slow_start_us > 0) {
+        atomic_store(&server->slow_start_until_us, monotonic_us() + slow_start_us);
+    }
+}
+
+// 64비트 FNV-1a 뒤에 murmur3 finalizer 로 섞음 ("ip:port#n" 처럼 끝만 다른 키도 고르게 퍼지도록)
+static uint64_t hash_bytes(const char *data, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int compare_points(const void *a, const void *b) {
+    uint64_t ha = ((const ring_point *)a)->hash;
+    uint64_t hb = ((const ring_point *)b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+// 링은 서버 목록이 정해질 때 한 번 만들고 건강 상태가 바뀌어도 그대로 둠. 조회할 때 선택할 수 없는 서버의 점을 건너뛰므로
+// 서버 하나가 빠지면 그 서버의 키만 링의 다음 서버로 옮겨가고 나머지 키는 그대로
+static int build_ring(backend_set *set) {
+    int total = 0;
+    int *vnodes = malloc((set->count > 0 ? set->count : 1) * sizeof(int));
+    if (vnodes == NULL) {
+        perror("Failed to allocate hash ring");
+        return -1;
+    }
+    for (int i = 0; i < set->count; i++) {
+        int weight = atomic_load(&set->servers[i]->weight);
+        vnodes[i] = (weight > 0 ? weight : 1) * hash_vnodes;
+        total += vnodes[i];
+    }
+    ring_point *points = malloc((total > 0 ? total : 1) * sizeof(ring_point));
+    if (points == NULL) {
+        perror("Failed to allocate hash ring");
+        free(vnodes);
+        return -1;
+    }
+
+    int n = 0;
+    for (int i = 0; i < set->count; i++) {
+        httpserver *server = set->servers[i];
+        for (int v = 0; v < vnodes[i]; v++) {
+            char name[48];
+            int len = snprintf(name, sizeof(name), "%s:%d#%d", server->ip, server->port, v);
+            points[n].hash = hash_bytes(name, len);
+            points[n].server = i;
+            n++;
+        }
+    }
+    qsort(points, n, sizeof(ring_point), compare_points);
+    free(vnodes);
+
+    free(set->ring);
+    set->ring = points;
+    set->ring_size = n;
+    return 0;
+}
+
+static void init_server(httpserver *server) {
+    atomic_init(&server->active_connections, 0);
+    atomic_init(&server->is_healthy, 1);
+    atomic_init(&server->latency_us, 0);
+    atomic_init(&server->latency_stamp_us, 0);
+    atomic_init(&server->breaker_state, LB_BREAKER_CLOSED);
+    atomic_init(&server->consecutive_failures, 0);
+    atomic_init(&server->window_requests, 0);
+    atomic_init(&server->window_failures, 0);
+    atomic_init(&server->window_start_us, 0);
+    atomic_init(&server->open_until_us, 0);
+    atomic_init(&server->ejections, 0);
+    atomic_init(&server->slow_start_until_us, 0);
+    atomic_init(&server->pool_hits, 0);
+    atomic_init(&server->pool_misses, 0);
+    atomic_init(&server->pool_evictions, 0);
+    atomic_init(&server->pool_waits, 0);
+    atomic_init(&server->retired, 0);
+    atomic_init(&server->refs, 0);
+}
+
+static backend_set *new_set(int count) {
+    backend_set *set = calloc(1, sizeof(backend_set));
+    if (set == NULL || (set->servers = calloc(count > 0 ? count : 1, sizeof(httpserver *))) == NULL) {
+        perror("Failed to allocate backend set");
+        free(set);
+        return NULL;
+    }
+    set->count = count;
+    set->generation = ++set_generation;
+    return set;
+}
+
+static void free_set(backend_set *set) {
+    free(set->servers);
+    free(set->ring);
+    free(set);
+}
 
 void init_http_servers(httpserver servers[], int count) {
-    if (count > MAX_HTTP_SERVERS) {
-        fprintf(stderr, "Error: 최대 %d개의 서버만 사용 가능합니다.\n", MAX_HTTP_SERVERS);
+    backend_set *set = new_set(count);
+    if (set == NULL) {
         return;
     }
-    
     for (int i = 0; i < count; i++) {
-        strcpy(http_servers[i].ip, servers[i].ip);
-        http_servers[i].port = servers[i].port;
-        http_servers[i].weight = servers[i].weight;
-        http_servers[i].is_healthy = 1;
-        http_servers[i].current_weight = 0;
+        init_server(&servers[i]);
+        set->servers[i] = &servers[i];
+    }
+    build_ring(set);
+
+    backend_set *old = atomic_exchange(&current_set, set);
+    if (old != NULL) {
+        free_set(old);
     }
+    atomic_init(&current_index, 0);
+}
 
-    http_server_count = count;
-    current_index = 0;
+static httpserver *find_server(backend_set *set, const char *ip, int port) {
+    for (int i = 0; set != NULL && i < set->count; i++) {
+        if (set->servers[i]->port == port && strcmp(set->servers[i]->ip, ip) == 0) {
+            return set->servers[i];
+        }
+    }
+    return NULL;
 }
 
-httpserver round_robin() {
-    if(http_server_count == 0) {
+static int contains(backend_set *set, httpserver *server) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->servers[i] == server) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned long long advance_epoch(void) {
+    return atomic_fetch_add(&epoch, 1) + 1;
+}
+
+int load_balancer_update(const lb_backend *backends, int count) {
+    backend_set *old = atomic_load(&current_set);
+    backend_set *set = new_set(count);
+    if (set == NULL) {
+        return -1;
+    }
+
+    int added = 0;
+    int i = 0;
+    for (; i < count; i++) {
+        httpserver *server = find_server(old, backends[i].ip, backends[i].port);
+        if (server == NULL) {
+            server = calloc(1, sizeof(httpserver));
+            if (server == NULL) {
+                break;
+            }
+            snprintf(server->ip, sizeof(server->ip), "%s", backends[i].ip);
+            server->port = backends[i].port;
+            init_server(server);
+            // 처음 목록이 아니면 새 서버도 되살아난 서버처럼 몫을 늘려 가며 받음
+            if (old != NULL) {
+                start_slow_start(server);
+            }
+            added++;
+        }
+        atomic_store(&server->weight, backends[i].weight > 0 ? backends[i].weight : 1);
+        set->servers[i] = server;
+    }
+    if (i < count) {
+        perror("Failed to allocate backend");
+        for (int j = 0; j < i; j++) {
+            if (old == NULL || !contains(old, set->servers[j])) {
+                free(set->servers[j]);
+            }
+        }
+        free_set(set);
+        return -1;
+    }
+    build_ring(set);
+
+    atomic_store_explicit(&current_set, set, memory_order_release);
+    if (old == NULL) {
+        return 0;
+    }
+
+    // 빠진 서버는 새로 고르지 않으므로 풀과 검사가 놓고 진행 중 요청이 끝나기를 기다림
+    int removed = 0;
+    for (int i = 0; i < old->count; i++) {
+        httpserver *server = old->servers[i];
+        if (!contains(set, server)) {
+            atomic_store(&server->retired, 1);
+            server->free_epoch = 0;
+            server->retired_next = retired_servers;
+            retired_servers = server;
+            removed++;
+        }
+    }
+    old->free_epoch = advance_epoch();
+    old->retired_next = retired_sets;
+    retired_sets = old;
+    printf("Backends updated: %d servers (%d added, %d removed)\n", count, added, removed);
+    fflush(stdout);
+    return 0;
+}
+
+// 등록된 reader 가 모두 지난 epoch (reader 가 없으면 지금 epoch)
+static unsigned long long oldest_seen(void) {
+    unsigned long long oldest = atomic_load(&epoch);
+    pthread_mutex_lock(&readers_lock);
+    for (lb_reader *r = readers; r != NULL; r = r->next) {
+        unsigned long long seen = atomic_load(&r->seen);
+        if (seen < oldest) {
+            oldest = seen;
+        }
+    }
+    pthread_mutex_unlock(&readers_lock);
+    return oldest;
+}
+
+void load_balancer_reclaim(void) {
+    if (retired_sets == NULL && retired_servers == NULL) {
+        return;
+    }
+    unsigned long long safe = oldest_seen();
+
+    backend_set **link = &retired_sets;
+    while (*link != NULL) {
+        backend_set *set = *link;
+        if (set->free_epoch <= safe) {
+            *link = set->retired_next;
+            free_set(set);
+        } else {
+            link = &set->retired_next;
+        }
+    }
+
+    // 빠진 서버는 옛 목록이 모두 해제되어 새로 쥘 수 없게 된 뒤, 진행 중 요청과 풀, 검사가 없으면
+    // (load_balancer_release 가 아직 이 서버를 만지는 중일 수 있으므로) 한 번 더 모든 reader 가 지나간 뒤 해제
+    httpserver **server_link = &retired_servers;
+    while (*server_link != NULL) {
+        httpserver *server = *server_link;
+        if (server->free_epoch == 0) {
+            if (retired_sets == NULL && atomic_load(&server->refs) == 0 &&
+                atomic_load(&server->active_connections) == 0) {
+                server->free_epoch = advance_epoch();
+            }
+        } else if (server->free_epoch <= safe) {
+            *server_link = server->retired_next;
+            printf("Server %s:%d removed\n", server->ip, server->port);
+            free(server);
+            continue;
+        }
+        server_link = &server->retired_next;
+    }
+    fflush(stdout);
+}
+
+void load_balancer_quiescent(void) {
+    lb_reader *r = self_reader;
+    if (r == NULL) {
+        r = calloc(1, sizeof(lb_reader));
+        if (r == NULL) {
+            perror("Failed to register load balancer reader");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_lock(&readers_lock);
+        atomic_init(&r->seen, atomic_load(&epoch));
+        r->next = readers;
+        readers = r;
+        pthread_mutex_unlock(&readers_lock);
+        self_reader = r;
+        return;
+    }
+    atomic_store_explicit(&r->seen, atomic_load(&epoch), memory_order_release);
+}
+
+httpserver *const *load_balancer_servers(int *count, unsigned *generation) {
+    backend_set *set = snapshot();
+    *count = set != NULL ? set->count : 0;
+    if (generation != NULL) {
+        *generation = set != NULL ? set->generation : 0;
+    }
+    return set != NULL ? set->servers : NULL;
+}
+
+httpserver *round_robin(const char *key, size_t key_len) {
+    (void)key;
+    (void)key_len;
+    backend_set *set = snapshot();
+    if (set == NULL || set->count == 0) {
         fprintf(stderr, "사용 가능한 http 서버가 없습니다.\n");
-        httpserver empty = {"", 0, 0};
-        return empty;
+        return NULL;
     }
 
-    httpserver server = http_servers[current_index];
-    current_index = (current_index + 1) % http_server_count;
-    return server;
+    // 순번만 atomic 으로 가져가고, 비정상 서버는 건너뜀
+    // slow start 중인 서버는 몫만큼의 확률로만 받고 나머지는 다음 서버로 (모두 넘기면 처음 만난 서버)
+    unsigned start = atomic_fetch_add_explicit(&current_index, 1, memory_order_relaxed);
+    httpserver *fallback = NULL;
+    for (int i = 0; i < set->count; i++) {
+        httpserver *server = set->servers[(start + i) % set->count];
+        if (!is_available(server)) {
+            continue;
+        }
+        int ramp = ramp_permille(server);
+        if (ramp == RAMP_FULL || (int)(next_random() % RAMP_FULL) < ramp) {
+            return server;
+        }
+        if (fallback == NULL) {
+            fallback = server;
+        }
+    }
+    return fallback;
 }
 
-httpserver weighted_round_robin() {
+httpserver *weighted_round_robin(const char *key, size_t key_len) {
+    (void)key;
+    (void)key_len;
+    backend_set *set = snapshot();
+    if (set == NULL) {
+        return NULL;
+    }
+    if (current_weights_generation != set->generation) {
+        int *weights = realloc(current_weights, (set->count > 0 ? set->count : 1) * sizeof(int));
+        if (weights == NULL) {
+            return round_robin(key, key_len);
+        }
+        memset(weights, 0, (set->count > 0 ? set->count : 1) * sizeof(int));
+        current_weights = weights;
+        current_weights_generation = set->generation;
+    }
+
     int total_weight = 0;
-    httpserver *selected_server = NULL;
+    int selected_index = -1;
 
-    for (int i = 0; i < http_server_count; i++) {
-        if (http_servers[i].is_healthy) {
-            total_weight += http_servers[i].weight;
-            http_servers[i].current_weight += http_servers[i].weight;
+    for (int i = 0; i < set->count; i++) {
+        httpserver *server = set->servers[i];
+        if (is_available(server)) {
+            // 가중치 x 몫(천분율). 모든 서버에 같은 배수를 곱하므로 slow start 가 없으면 순서는 그대로
+            int weight = atomic_load_explicit(&server->weight, memory_order_relaxed) * ramp_permille(server);
+            total_weight += weight;
+            current_weights[i] += weight;
 
-            if (selected_server == NULL || http_servers[i].current_weight > selected_server->current_weight) {
-                selected_server = &http_servers[i];
+            if (selected_index < 0 || current_weights[i] > current_weights[selected_index]) {
+                selected_index = i;
             }
         }
     }
 
-    if (selected_server == NULL) {
-        fprintf(stderr, "No healthy servers available\n");
-        exit(EXIT_FAILURE);
+    if (selected_index < 0) {
+        return NULL;
     }
 
     // 선택된 서버의 가중치를 감소
-    selected_server->current_weight -= total_weight;
+    current_weights[selected_index] -= total_weight;
 
-    return *selected_server;
+    return set->servers[selected_index];
 }
 
-httpserver least_connection() {
-    if(http_server_count == 0) {
-        fprintf(stderr, "사용 가능한 http 서버가 없습니다.\n");
-        httpserver empty = {"", 0};
-        return empty;
+httpserver *least_connection(const char *key, size_t key_len) {
+    (void)key;
+    (void)key_len;
+    httpserver *selected_server = NULL;
+    int min_connections = 0;
+    int min_ramp = RAMP_FULL;
+    backend_set *set = snapshot();
+
+    for (int i = 0; set != NULL && i < set->count; i++) {
+        httpserver *server = set->servers[i];
+        if (!is_available(server)) {
+            continue;
+        }
+        // (진행 중 요청 + 1) / 몫 이 가장 작은 서버 (곱셈으로 비교). slow start 가 없으면 진행 중 요청 수 비교와 같음
+        int connections = atomic_load_explicit(&server->active_connections, memory_order_relaxed);
+        int ramp = ramp_permille(server);
+        if (selected_server == NULL || (long)(connections + 1) * min_ramp < (long)(min_connections + 1) * ramp) {
+            min_connections = connections;
+            min_ramp = ramp;
+            selected_server = server;
+        }
+    }
+
+    return selected_server;
+}
+
+// 가중치 대비 진행 중 요청이 적은 쪽 (a/wa < b/wb 를 곱셈으로 비교)
+static httpserver *less_loaded(httpserver *a, httpserver *b) {
+    int weight_a = atomic_load_explicit(&a->weight, memory_order_relaxed);
+    int weight_b = atomic_load_explicit(&b->weight, memory_order_relaxed);
+    long load_a = (long)atomic_load_explicit(&a->active_connections, memory_order_relaxed) * (weight_b > 0 ? weight_b : 1);
+    long load_b = (long)atomic_load_explicit(&b->active_connections, memory_order_relaxed) * (weight_a > 0 ? weight_a : 1);
+    return load_b < load_a ? b : a;
+}
+
+// 서로 다른 두 서버를 무작위로 골라 less 로 비교. 서버 수와 관계없이 두 개만 보고,
+// 모든 스레드가 같은 최솟값으로 몰리는 least_connection 과 달리 동시에 골라도 흩어짐
+static httpserver *pick_two(httpserver *(*less)(httpserver *, httpserver *)) {
+    backend_set *set = snapshot();
+    if (set == NULL || set->count < 2) {
+        return set != NULL && set->count == 1 && is_available(set->servers[0]) ? set->servers[0] : NULL;
     }
 
-    int min_connections = http_servers[0].active_connections;
-    int min_index = 0;
-    for (int i = 1; i < http_server_count; i++) {
-        if (http_servers[i].active_connections < min_connections) {
-            min_connections = http_servers[i].active_connections;
-            min_index = i;
+    uint32_t r = next_random();
+    int i = r % set->count;
+    int j = (r >> 16) % (set->count - 1);
+    if (j >= i) {
+        j++;
+    }
+    httpserver *a = set->servers[i];
+    httpserver *b = set->servers[j];
+    int a_healthy = is_available(a);
+    int b_healthy = is_available(b);
+    if (a_healthy && b_healthy) {
+        // slow start 중인 서버가 이기면 몫만큼의 확률로만 받고 아니면 다른 쪽
+        // (peak_ewma 에서는 측정값이 없는 되살아난 서버의 예상 지연이 0 이라 모든 비교에서 이기므로)
+        httpserver *winner = less(a, b);
+        int ramp = ramp_permille(winner);
+        if (ramp < RAMP_FULL && (int)(next_random() % RAMP_FULL) >= ramp) {
+            return winner == a ? b : a;
         }
+        return winner;
     }
+    if (a_healthy || b_healthy) {
+        return a_healthy ? a : b;
+    }
+    // 둘 다 비정상이면 남은 서버 중에서
+    return least_connection(NULL, 0);
+}
 
-    http_servers[min_index].active_connections += 1;
-    if (http_servers[min_index].active_connections < 0) {
-        http_servers[min_index].active_connections = 0;
+httpserver *power_of_two_choices(const char *key, size_t key_len) {
+    (void)key;
+    (void)key_len;
+    return pick_two(less_loaded);
+}
+
+// 마지막 측정 뒤 지난 시간만큼 0 쪽으로 줄어든 peak-EWMA. 한동안 요청을 받지 못한 서버도 다시 시도되게 함
+static double decayed_latency(httpserver *server, long long now) {
+    long long stamp = atomic_load_explicit(&server->latency_stamp_us, memory_order_relaxed);
+    double latency = (double)atomic_load_explicit(&server->latency_us, memory_order_relaxed);
+    return now > stamp ? latency * exp(-(now - stamp) / ewma_decay_us) : latency;
+}
+
+// 예상 지연 x (진행 중 요청 + 1). 아직 첫 바이트를 받아 보지 못한 서버(새로 추가된 서버 등)는 지연이 0 이라
+// 첫 응답이 올 때까지 모든 요청을 받게 되므로, 진행 중 요청이 있으면 큰 벌점 + 진행 중 요청 수
+static double latency_cost(httpserver *server, long long now) {
+    int active = atomic_load_explicit(&server->active_connections, memory_order_relaxed);
+    double latency = decayed_latency(server, now);
+    if (latency == 0 && active > 0) {
+        return EWMA_PENALTY_US + active;
     }
+    return latency * (active + 1);
+}
+
+// 비용(latency_cost)이 작은 쪽
+static httpserver *less_latency(httpserver *a, httpserver *b) {
+    long long now = monotonic_us();
+    return latency_cost(b, now) < latency_cost(a, now) ? b : a;
+}
 
-    return http_servers[min_index];
+httpserver *peak_ewma(const char *key, size_t key_len) {
+    (void)key;
+    (void)key_len;
+    return pick_two(less_latency);
 }
 
-httpserver (*load_balancer_select(int mode))() {
+// 키 해시 이상인 첫 점부터 시계 방향으로 건강한 서버를 찾음 (이진 탐색 + 보통 한두 칸)
+httpserver *consistent_hash(const char *key, size_t key_len) {
+    backend_set *set = snapshot();
+    if (set == NULL || set->ring_size == 0) {
+        return NULL;
+    }
+    const ring_point *ring = set->ring;
+    int ring_size = set->ring_size;
+    uint64_t h = hash_bytes(key, key_len);
+    int lo = 0, hi = ring_size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ring[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // slow start 중인 서버는 키 해시의 아래 자리로 정한 몫의 키만 받음. 같은 키는 계속 같은 쪽으로 가고,
+    // 몫이 늘어 가며 원래 이 서버의 키가 돌아옴
+    httpserver *fallback = NULL;
+    for (int i = 0; i < ring_size; i++) {
+        httpserver *server = set->servers[ring[(lo + i) % ring_size].server];
+        if (!is_available(server)) {
+            continue;
+        }
+        int ramp = ramp_permille(server);
+        if (ramp == RAMP_FULL || (int)(h % RAMP_FULL) < ramp) {
+            return server;
+        }
+        if (fallback == NULL) {
+            fallback = server;
+        }
+    }
+    return fallback;
+}
+
+void load_balancer_set_hash_vnodes(int vnodes) {
+    hash_vnodes = vnodes > 0 ? vnodes : 1;
+    backend_set *set = snapshot();
+    if (set != NULL) {
+        build_ring(set);
+    }
+}
+
+void load_balancer_set_ewma_decay(long decay_ms) {
+    ewma_decay_us = decay_ms > 0 ? decay_ms * 1000.0 : 1000.0;
+}
+
+// 측정값이 지금 값보다 크면 바로 올리고(peak), 작으면 지난 시간에 따른 가중치로 천천히 내림
+// 두 값을 따로 atomic 으로 갱신하므로 동시에 기록하면 근사치가 되지만 선택에는 충분함
+void load_balancer_observe(httpserver *server, long long latency_us) {
+    long long now = monotonic_us();
+    long long stamp = atomic_exchange_explicit(&server->latency_stamp_us, now, memory_order_relaxed);
+    double w = now > stamp ? exp(-(now - stamp) / ewma_decay_us) : 1.0;
+
+    long long old = atomic_load_explicit(&server->latency_us, memory_order_relaxed);
+    long long updated;
+    do {
+        updated = latency_us > old ? latency_us : (long long)(old * w + latency_us * (1.0 - w));
+    } while (!atomic_compare_exchange_weak_explicit(&server->latency_us, &old, updated,
+                                                    memory_order_relaxed, memory_order_relaxed));
+}
+
+httpserver *(*load_balancer_select(int mode))(const char *, size_t) {
     switch (mode) {
-        case 0:
+        case LB_ROUND_ROBIN:
             return round_robin;
-        case 1:
+        case LB_WEIGHTED_ROUND_ROBIN:
             return weighted_round_robin;
-        case 2:
+        case LB_LEAST_CONNECTION:
             return least_connection;
+        case LB_POWER_OF_TWO_CHOICES:
+            return power_of_two_choices;
+        case LB_PEAK_EWMA:
+            return peak_ewma;
+        case LB_CONSISTENT_HASH:
+            return consistent_hash;
         default:
             fprintf(stderr, "Invalid load balancer mode!\n");
             exit(EXIT_FAILURE);
     }
 }
+
+void load_balancer_set_mode(int mode) {
+    selected = load_balancer_select(mode);
+}
+
+void load_balancer_set_breaker(const lb_breaker_config *config) {
+    breaker = *config;
+    if (breaker.window_ms <= 0) {
+        breaker.window_ms = 1;
+    }
+    if (breaker.open_ms <= 0) {
+        breaker.open_ms = 1;
+    }
+    if (breaker.max_open_ms < breaker.open_ms) {
+        breaker.max_open_ms = breaker.open_ms;
+    }
+}
+
+void load_balancer_set_slow_start(long slow_start_ms, int min_percent, int exponential) {
+    slow_start_us = slow_start_ms > 0 ? slow_start_ms * 1000LL : 0;
+    slow_start_min = (min_percent > 0 ? (min_percent < 100 ? min_percent : 100) : 1) / 100.0;
+    slow_start_exponential = exponential;
+}
+
+// 정상이 된 것을 알리기 전에 slow start 시각을 먼저 기록 (선택하는 쪽이 몫 없이 정상 상태만 보지 않도록)
+void load_balancer_set_healthy(httpserver *server, int healthy) {
+    if (healthy && !atomic_load(&server->is_healthy)) {
+        start_slow_start(server);
+    }
+    atomic_store(&server->is_healthy, healthy);
+}
+
+// 차단 시간이 끝난 서버를 고르면 OPEN -> HALF_OPEN 으로 바꾼 스레드 하나만 시험 요청을 보냄 (*trial = 1)
+// 다른 스레드가 먼저 가져갔으면 그 서버는 이제 선택 대상이 아니므로 다시 고름
+httpserver *load_balancer_pick(const char *key, size_t key_len, int *trial) {
+    return load_balancer_pick_other(key, key_len, NULL, trial);
+}
+
+// 선택 함수가 계속 avoid 를 고르면 (consistent_hash, least_connection 처럼 결정적인 모드)
+// 닫힌 서버 중 진행 중 요청이 가장 적은 다른 서버
+static httpserver *least_loaded_other(httpserver *avoid) {
+    httpserver *best = NULL;
+    backend_set *set = snapshot();
+    for (int i = 0; set != NULL && i < set->count; i++) {
+        httpserver *server = set->servers[i];
+        if (server == avoid || !is_available(server) ||
+            atomic_load_explicit(&server->breaker_state, memory_order_relaxed) != LB_BREAKER_CLOSED) {
+            continue;
+        }
+        if (best == NULL || atomic_load_explicit(&server->active_connections, memory_order_relaxed) <
+                                atomic_load_explicit(&best->active_connections, memory_order_relaxed)) {
+            best = server;
+        }
+    }
+    return best;
+}
+
+httpserver *load_balancer_pick_other(const char *key, size_t key_len, httpserver *avoid, int *trial) {
+    *trial = 0;
+    backend_set *set = snapshot();
+    int count = set != NULL ? set->count : 0;
+    for (int attempt = 0; attempt <= count; attempt++) {
+        httpserver *server = selected(key, key_len);
+        if (server == NULL) {
+            return NULL;
+        }
+        if (server == avoid) {
+            continue;
+        }
+        int state = atomic_load_explicit(&server->breaker_state, memory_order_relaxed);
+        if (state != LB_BREAKER_CLOSED) {
+            if (state != LB_BREAKER_OPEN ||
+                monotonic_us() < atomic_load_explicit(&server->open_until_us, memory_order_relaxed) ||
+                !atomic_compare_exchange_strong(&server->breaker_state, &state, LB_BREAKER_HALF_OPEN)) {
+                continue;
+            }
+            printf("Server %s:%d half-open, sending a trial request\n", server->ip, server->port);
+            *trial = 1;
+        }
+        atomic_fetch_add_explicit(&server->active_connections, 1, memory_order_relaxed);
+        return server;
+    }
+    httpserver *server = avoid != NULL ? least_loaded_other(avoid) : NULL;
+    if (server != NULL) {
+        atomic_fetch_add_explicit(&server->active_connections, 1, memory_order_relaxed);
+    }
+    return server;
+}
+
+static void reset_counts(httpserver *server, long long now) {
+    atomic_store_explicit(&server->consecutive_failures, 0, memory_order_relaxed);
+    atomic_store_explicit(&server->window_requests, 0, memory_order_relaxed);
+    atomic_store_explicit(&server->window_failures, 0, memory_order_relaxed);
+    atomic_store_explicit(&server->window_start_us, now, memory_order_relaxed);
+}
+
+// from 상태에서 OPEN 으로. 차단 시간은 open_ms x 2^(연달아 차단된 횟수), max_open_ms 까지
+// 차단 시각을 먼저 기록한 뒤 상태를 바꾸므로 OPEN 을 본 스레드는 항상 새 차단 시각을 봄
+static void trip(httpserver *server, int from, long long now) {
+    int ejections = atomic_load_explicit(&server->ejections, memory_order_relaxed);
+    long long open_us = breaker.open_ms * 1000LL << (ejections < 20 ? ejections : 20);
+    if (open_us > breaker.max_open_ms * 1000LL) {
+        open_us = breaker.max_open_ms * 1000LL;
+    }
+    atomic_store(&server->open_until_us, now + open_us);
+    if (!atomic_compare_exchange_strong(&server->breaker_state, &from, LB_BREAKER_OPEN)) {
+        return;
+    }
+    atomic_fetch_add_explicit(&server->ejections, 1, memory_order_relaxed);
+    reset_counts(server, now);
+    printf("Server %s:%d ejected for %lld ms\n", server->ip, server->port, open_us / 1000);
+}
+
+// window 가 지났으면 먼저 본 스레드가 새로 시작. 동시에 끝난 요청 몇 개가 옛 window 에 세어질 수 있지만
+// 오류율을 보기에는 충분함
+static void count_result(httpserver *server, int failed, long long now) {
+    long long start = atomic_load_explicit(&server->window_start_us, memory_order_relaxed);
+    if (now - start >= breaker.window_ms * 1000LL &&
+        atomic_compare_exchange_strong(&server->window_start_us, &start, now)) {
+        atomic_store_explicit(&server->window_requests, 0, memory_order_relaxed);
+        atomic_store_explicit(&server->window_failures, 0, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&server->window_requests, 1, memory_order_relaxed);
+    if (failed) {
+        atomic_fetch_add_explicit(&server->window_failures, 1, memory_order_relaxed);
+    }
+}
+
+static int should_trip(httpserver *server, int consecutive) {
+    if (breaker.consecutive_failures > 0 && consecutive >= breaker.consecutive_failures) {
+        return 1;
+    }
+    if (breaker.error_percent <= 0) {
+        return 0;
+    }
+    int requests = atomic_load_explicit(&server->window_requests, memory_order_relaxed);
+    int failures = atomic_load_explicit(&server->window_failures, memory_order_relaxed);
+    return requests >= breaker.min_requests && (long)failures * 100 >= (long)requests * breaker.error_percent;
+}
+
+// 진행 중 요청 수를 줄이고 결과를 circuit breaker 에 반영
+// HALF_OPEN 은 시험 요청(trial)의 결과로만 닫거나 다시 차단함. 그 밖의 요청(차단 전에 보낸 것)은 수만 셈
+// OPEN 동안 끝난 요청의 결과도 상태를 바꾸지 않음
+void load_balancer_release(httpserver *server, int result, int trial) {
+    atomic_fetch_sub_explicit(&server->active_connections, 1, memory_order_relaxed);
+
+    int state = atomic_load_explicit(&server->breaker_state, memory_order_relaxed);
+    int probing = trial && state == LB_BREAKER_HALF_OPEN;
+    if (result == LB_RESULT_CANCELLED) {
+        // 시험 요청이 결과 없이 끝났으면 다음 요청이 다시 시험하도록 (차단 시각은 이미 지남)
+        if (probing) {
+            atomic_compare_exchange_strong(&server->breaker_state, &state, LB_BREAKER_OPEN);
+        }
+        return;
+    }
+
+    long long now = monotonic_us();
+    if (result == LB_RESULT_SUCCESS) {
+        atomic_store_explicit(&server->consecutive_failures, 0, memory_order_relaxed);
+        if (probing && atomic_compare_exchange_strong(&server->breaker_state, &state, LB_BREAKER_CLOSED)) {
+            atomic_store_explicit(&server->ejections, 0, memory_order_relaxed);
+            reset_counts(server, now);
+            start_slow_start(server);
+            printf("Server %s:%d recovered\n", server->ip, server->port);
+            return;
+        }
+        count_result(server, 0, now);
+        return;
+    }
+
+    count_result(server, 1, now);
+    int consecutive = atomic_fetch_add_explicit(&server->consecutive_failures, 1, memory_order_relaxed) + 1;
+    if (probing || (state == LB_BREAKER_CLOSED && should_trip(server, consecutive))) {
+        trip(server, state, now);
+    }
+}
+
+const char *load_balancer_breaker_name(httpserver *server) {
+    switch (atomic_load_explicit(&server->breaker_state, memory_order_relaxed)) {
+        case LB_BREAKER_OPEN:
+            return "open";
+        case LB_BREAKER_HALF_OPEN:
+            return "half-open";
+        default:
+            return "closed";
+    }
+}
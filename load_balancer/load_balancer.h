@@ -3,26 +3,152 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 
+#define LB_DEFAULT_HASH_VNODES 100 // consistent_hash: 가중치 1 당 링의 가상 노드 수
+
+// 백엔드 서버. 여러 reactor 스레드와 health_check 스레드가 함께 읽고 쓰는 값은 atomic
+// 설정을 다시 읽어도 같은 ip:port 는 같은 항목을 계속 쓰므로 상태와 통계가 이어짐
 typedef struct httpserver {
     char ip[16];
     int port;
-    int weight;
-    int active_connections;
-    int is_healthy;
-    int current_weight;
+    atomic_int weight;             // 설정을 다시 읽으면 바뀔 수 있음
+    atomic_int active_connections; // 선택된 뒤 아직 끝나지 않은 요청 수 (load_balancer_pick/release)
+    atomic_int is_healthy;
+    atomic_llong latency_us;       // 첫 바이트까지 걸린 시간의 peak-EWMA (load_balancer_observe)
+    atomic_llong latency_stamp_us; // latency_us 를 마지막으로 갱신한 시각
+
+    // passive health check: 실제 요청의 결과로 움직이는 circuit breaker (load_balancer_release)
+    atomic_int breaker_state;         // LB_BREAKER_CLOSED, OPEN, HALF_OPEN
+    atomic_int consecutive_failures;
+    atomic_int window_requests;       // window_start_us 부터 끝난 요청 수와 그중 실패 수
+    atomic_int window_failures;
+    atomic_llong window_start_us;
+    atomic_llong open_until_us;       // 이 시각이 지나야 시험 요청을 보냄
+    atomic_int ejections;             // 시험 요청이 성공하기 전까지 연달아 차단된 횟수
+
+    atomic_llong slow_start_until_us; // 0 이 아니면 다시 받기 시작한 서버, 이 시각까지 받는 몫을 늘려 감
+
+    // upstream 풀 통계 (모든 reactor 합산)
+    atomic_ulong pool_hits;      // 유휴 연결 재사용
+    atomic_ulong pool_misses;    // 새로 connect
+    atomic_ulong pool_evictions; // 유휴 연결 정리 (타임아웃, 비정상 백엔드, 원격 종료, 개수 초과)
+    atomic_ulong pool_waits;     // 최대 연결 수 초과로 대기한 요청
+
+    // 설정에서 빠진 서버: 진행 중 요청과 이 서버를 쥔 풀, 검사가 모두 놓은 뒤 해제 (load_balancer_reclaim)
+    atomic_int retired;
+    atomic_int refs;                    // 이 서버의 upstream 풀(reactor 마다)과 health check 검사 수
+    struct httpserver *retired_next;    // 아래 둘은 설정을 다시 읽는 스레드만 사용
+    unsigned long long free_epoch;
 } httpserver;
 
-// 초기화 함수
+// 설정의 BACKEND 줄 하나
+typedef struct {
+    char ip[16];
+    int port;
+    int weight;
+} lb_backend;
+
+// circuit breaker 상태. OPEN 인 서버는 선택하지 않고, 차단 시간이 끝나면 시험 요청 하나만 보내는 HALF_OPEN
+enum {
+    LB_BREAKER_CLOSED,
+    LB_BREAKER_OPEN,
+    LB_BREAKER_HALF_OPEN
+};
+
+// load_balancer_release 에 알리는 요청 결과
+enum {
+    LB_RESULT_SUCCESS,   // 응답을 끝까지 받음
+    LB_RESULT_FAILURE,   // 연결 실패, 읽기 오류, 시간 초과, 5xx 응답
+    LB_RESULT_CANCELLED  // 클라이언트가 먼저 끊는 등 백엔드와 관계없이 끝남
+};
+
+// circuit breaker 설정. 연속 실패 수나 window_ms 동안의 오류율이 기준에 닿으면 open_ms 동안 차단하고,
+// 시험 요청이 실패할 때마다 차단 시간을 두 배로 (max_open_ms 까지)
+typedef struct {
+    int consecutive_failures; // 0 이면 연속 실패로는 차단하지 않음
+    int error_percent;        // 0 이면 오류율로는 차단하지 않음
+    int min_requests;         // 오류율을 따지기 위한 window 안의 최소 요청 수
+    long window_ms;
+    long open_ms;
+    long max_open_ms;
+} lb_breaker_config;
+
+// LOAD_BALANCER_MODE 설정 값
+enum {
+    LB_ROUND_ROBIN,
+    LB_WEIGHTED_ROUND_ROBIN,
+    LB_LEAST_CONNECTION,
+    LB_POWER_OF_TWO_CHOICES,
+    LB_PEAK_EWMA,
+    LB_CONSISTENT_HASH,
+    LB_MODE_COUNT
+};
+
+// 호출한 쪽이 가진 servers 배열을 그대로 백엔드 목록으로 씀 (벤치마크용, 스레드를 시작하기 전에)
+// load_balancer_update 와 섞어 쓰지 않음
 void init_http_servers(httpserver servers[], int count);
 
-// 로드 밸런싱 전략 함수 선언
-httpserver round_robin();
-httpserver weighted_round_robin();
-httpserver least_connection();
+// 백엔드 목록을 바꿔 끼움. 같은 ip:port 는 기존 항목을 그대로 쓰고(가중치만 갱신), 새 서버는 slow start 로 시작
+// 목록은 통째로 새로 만들어 포인터 하나로 바꾸므로 선택하는 쪽은 락 없이 옛 목록이나 새 목록 중 하나를 봄
+// 빠진 서버는 진행 중 요청이 끝난 뒤 load_balancer_reclaim 이 해제. 한 스레드에서만 호출
+int load_balancer_update(const lb_backend *backends, int count);
+
+// 옛 목록과 빠진 서버 중 이제 아무도 보지 않는 것을 해제. load_balancer_update 를 부르는 스레드가 주기적으로 호출
+void load_balancer_reclaim(void);
+
+// 목록을 읽는 스레드(reactor, health_check)가 루프를 한 바퀴 돌 때마다 호출. 이 호출 사이에서만 목록을 읽고,
+// 이 호출 전에 받은 목록과 서버 포인터(진행 중 요청으로 쥔 것은 제외)는 더 쓰지 않음을 알림
+void load_balancer_quiescent(void);
+
+// 현재 백엔드 목록. 호출한 스레드의 다음 load_balancer_quiescent 까지 유효. generation 은 목록이 바뀔 때마다 증가
+httpserver *const *load_balancer_servers(int *count, unsigned *generation);
+
+// 로드 밸런싱 전략 함수 선언. 건강하고 circuit breaker 가 막지 않는 서버가 없으면 NULL
+// 락 없이 여러 스레드에서 동시에 호출 가능. 고르기만 하고 진행 중 요청 수는 바꾸지 않음
+// key 는 요청의 해시 키 (consistent_hash 만 사용)
+httpserver *round_robin(const char *key, size_t key_len);
+httpserver *weighted_round_robin(const char *key, size_t key_len);
+httpserver *least_connection(const char *key, size_t key_len);
+httpserver *power_of_two_choices(const char *key, size_t key_len);
+httpserver *peak_ewma(const char *key, size_t key_len);
+httpserver *consistent_hash(const char *key, size_t key_len);
 
 // 모드에 따른 로드 밸런싱 함수 포인터 반환
-httpserver (*load_balancer_select(int mode))();
+httpserver *(*load_balancer_select(int mode))(const char *key, size_t key_len);
 
-#endif
+// 설정의 모드로 선택 함수를 정함 (reactor 스레드를 시작하기 전에)
+void load_balancer_set_mode(int mode);
+
+// peak-EWMA 가 옛 측정값을 잊는 시간 상수(ms)
+void load_balancer_set_ewma_decay(long decay_ms);
+
+// consistent_hash 링을 가중치 1 당 vnodes 개의 가상 노드로 다시 만듦 (reactor 스레드를 시작하기 전에)
+void load_balancer_set_hash_vnodes(int vnodes);
+
+// circuit breaker 기준 설정 (reactor 스레드를 시작하기 전에)
+void load_balancer_set_breaker(const lb_breaker_config *config);
 
+// 되살아난 서버가 몫을 다 받기까지의 시간(ms, 0 이면 바로)과 시작 비율(%).
+// exponential 이면 시작 비율에서 지수적으로, 아니면 직선으로 늘림
+void load_balancer_set_slow_start(long slow_start_ms, int min_percent, int exponential);
+
+// 능동 health check 결과 반영. 비정상에서 정상이 되면 slow start 시작
+void load_balancer_set_healthy(httpserver *server, int healthy);
+
+// 현재 모드로 백엔드를 골라 진행 중 요청 수를 늘림. 요청이 어떻게 끝나든(응답 완료, 오류, 클라이언트 종료)
+// 정확히 한 번 결과(LB_RESULT_*)와 함께 load_balancer_release 를 호출해야 함
+// *trial 은 이 요청이 HALF_OPEN 서버의 시험 요청이면 1. release 에 그대로 넘겨야 함
+httpserver *load_balancer_pick(const char *key, size_t key_len, int *trial);
+
+// load_balancer_pick 과 같지만 avoid 가 아닌 서버 (재시도, hedge). 다른 서버가 없으면 NULL
+httpserver *load_balancer_pick_other(const char *key, size_t key_len, httpserver *avoid, int *trial);
+void load_balancer_release(httpserver *server, int result, int trial);
+
+// 통계 출력용 circuit breaker 상태 이름
+const char *load_balancer_breaker_name(httpserver *server);
+
+// 요청을 시작해서 백엔드 응답의 첫 바이트가 올 때까지 걸린 시간 기록 (peak_ewma 가 사용)
+void load_balancer_observe(httpserver *server, long long latency_us);
+
+#endif
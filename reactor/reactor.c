@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "reactor.h"
+#include "../connection/connection.h"
+#include "../upstream/upstream_pool.h"
+#include "../cache/cache.h"
+#include "../cache/coalesce.h"
+
+volatile sig_atomic_t reactor_stats_requested = 0;
+
+int reactor_init(reactor *r, int listen_fd) {
+    memset(r, 0, sizeof(*r));
+    buffer_pool_init(&r->buffers);
+
+    // accept 를 루프로 비우기 위해 listen 소켓도 non-blocking 으로
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl failed");
+        return -1;
+    }
+
+    r->epoll_fd = epoll_create1(0);
+    if (r->epoll_fd == -1) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    r->listener.fd = listen_fd;
+    r->listener.kind = ENDPOINT_LISTEN;
+    r->listener.conn = NULL;
+    if (reactor_watch(r, &r->listener, EPOLLIN) < 0) {
+        close(r->epoll_fd);
+        return -1;
+    }
+
+    r->waker.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->waker.kind = ENDPOINT_WAKE;
+    r->waker.conn = NULL;
+    if (r->waker.fd == -1 || reactor_watch(r, &r->waker, EPOLLIN) < 0) {
+        perror("Failed to create reactor eventfd");
+        close(r->epoll_fd);
+        return -1;
+    }
+    return 0;
+}
+
+// 관심 이벤트 등록/변경. 이미 같은 이벤트거나 fd 가 없으면(클라이언트 없는 갱신 연결) syscall 생략
+int reactor_watch(reactor *r, endpoint *ep, uint32_t events) {
+    if ((ep->registered && ep->events == events) || ep->fd < 0) {
+        return 0;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = ep;
+    int op = ep->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(r->epoll_fd, op, ep->fd, &ev) == -1) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+
+    ep->registered = 1;
+    ep->events = events;
+    return 0;
+}
+
+void reactor_unwatch(reactor *r, endpoint *ep) {
+    if (ep->registered) {
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, ep->fd, NULL);
+        ep->registered = 0;
+        ep->events = 0;
+    }
+}
+
+// 대기 중인 연결을 한 번에 모두 수락
+static void reactor_accept(reactor *r) {
+    while (1) {
+        int client_sock = accept4(r->listener.fd, NULL, NULL, SOCK_NONBLOCK);
+        if (client_sock == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("Accept failed");
+            return;
+        }
+
+        if (connection_create(r, client_sock) == NULL) {
+            close(client_sock);
+        }
+    }
+}
+
+void reactor_run(reactor *r) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    time_t last_sweep = time(NULL);
+
+    while (1) {
+        // 지난 바퀴에서 읽은 백엔드 목록은 더 쓰지 않음 (설정을 다시 읽은 뒤 옛 목록을 해제할 수 있도록)
+        load_balancer_quiescent();
+
+        int timeout = r->flight_waiting != NULL ? REACTOR_WAIT_TICK_MS : REACTOR_TICK_MS;
+        // hedge 시각이 된 요청을 보내고, 다음 hedge 시각에 맞춰 깨어남
+        if (r->hedge_waiting != NULL) {
+            int next = connection_check_hedges(r);
+            if (next >= 0 && next < timeout) {
+                timeout = next;
+            }
+        }
+        int nfds = epoll_wait(r->epoll_fd, events, REACTOR_MAX_EVENTS, timeout);
+        if (nfds == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            endpoint *ep = events[i].data.ptr;
+            if (ep->kind == ENDPOINT_LISTEN) {
+                reactor_accept(r);
+            } else if (ep->kind == ENDPOINT_WAKE) {
+                uint64_t count;
+                while (read(r->waker.fd, &count, sizeof(count)) > 0) {
+                }
+            } else if (ep->kind == ENDPOINT_POOLED) {
+                upstream_pool_on_event((struct upstream_conn *)ep, events[i].events);
+            } else if (ep->conn->state != CONN_CLOSED) {
+                connection_handle(ep->conn, ep, events[i].events);
+            }
+        }
+
+        // 기다리던 요청이 끝났거나 대기 시간이 지난 연결을 이어서 처리
+        if (r->flight_waiting != NULL) {
+            connection_check_flights(r);
+        }
+        if (r->disk_waiting != NULL) {
+            connection_check_disk_reads(r);
+        }
+
+        // 같은 배치 안에서 닫힌 연결의 이벤트가 남아있을 수 있어 배치가 끝난 뒤 해제
+        connection_reap(r);
+        upstream_pool_reap(r);
+
+        time_t now = time(NULL);
+        if (now != last_sweep) {
+            connection_sweep(r, now);
+            upstream_pool_sweep(r, now);
+            connection_reap(r);
+            upstream_pool_reap(r);
+            last_sweep = now;
+        }
+
+        if (r->stats_seen != reactor_stats_requested) {
+            r->stats_seen = reactor_stats_requested;
+            if (r->id == 0) {
+                upstream_pool_print_stats();
+                cache_print_stats();
+                coalesce_print_stats();
+            }
+            buffer_pool_print_stats(&r->buffers, r->id);
+        }
+    }
+}
+
+void *reactor_thread(void *arg) {
+    reactor *r = (reactor *)arg;
+
+    if (r->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(r->cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            fprintf(stderr, "Reactor %d: failed to pin to cpu %d: %s\n", r->id, r->cpu, strerror(err));
+        }
+    }
+
+    reactor_run(r);
+    return NULL;
+}
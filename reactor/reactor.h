@@ -0,0 +1,63 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <signal.h>
+#include "../buffer/buffer_pool.h"
+
+#define REACTOR_MAX_EVENTS 1024
+#define REACTOR_TICK_MS 1000 // 타임아웃 검사 주기
+#define REACTOR_WAIT_TICK_MS 50 // 다른 연결의 요청 결과를 기다리는 연결이 있을 때의 검사 주기
+
+typedef enum {
+    ENDPOINT_LISTEN,
+    ENDPOINT_CLIENT,
+    ENDPOINT_BACKEND,
+    ENDPOINT_POOLED, // upstream 풀에서 쉬고 있는 백엔드 연결
+    ENDPOINT_WAKE    // 다른 스레드가 이 reactor 를 깨우는 eventfd
+} endpoint_kind;
+
+struct connection;
+struct upstream_pool;
+struct upstream_conn;
+
+// epoll 에 등록되는 fd 하나. epoll_event.data.ptr 로 이 구조체를 넘긴다
+typedef struct endpoint {
+    int fd;
+    endpoint_kind kind;
+    int registered;          // epoll 에 ADD 되었는지
+    uint32_t events;         // 현재 관심 이벤트
+    struct connection *conn; // 소속 연결 (listen 소켓은 NULL)
+} endpoint;
+
+typedef struct reactor {
+    int id;
+    int cpu;                    // 고정할 CPU 코어 (-1 이면 고정하지 않음)
+    int epoll_fd;
+    endpoint listener;
+    endpoint waker;             // 합친 요청이나 디스크 계층 읽기가 끝났을 때 다른 스레드가 쓰는 eventfd
+    struct connection *active;  // 살아있는 연결 목록 (타임아웃 검사용)
+    struct connection *closed;  // 이번 epoll_wait 배치가 끝나면 해제할 연결
+    struct connection *flight_waiting; // 같은 URL 을 가져오는 다른 연결의 결과를 기다리는 연결
+    struct connection *disk_waiting;   // 캐시 I/O 스레드의 디스크 읽기를 기다리는 연결
+    struct connection *hedge_waiting;  // 첫 바이트를 기다리며 hedge 시각이 잡힌 연결 (hedge 시각 순)
+    struct connection *hedge_tail;
+    int connection_count;
+    struct upstream_pool *pools;             // 백엔드별 upstream 연결 풀 목록 (이 reactor 전용)
+    struct upstream_conn *retired_upstream;  // 배치 종료 후 해제할 풀 항목
+    buffer_pool buffers;        // 연결 버퍼용 슬랩 아레나 (이 reactor 전용)
+    sig_atomic_t stats_seen;    // 마지막으로 통계를 출력한 요청 번호
+} reactor;
+
+// SIGUSR1 을 받을 때마다 증가. 각 reactor 가 자기 버퍼 통계를, reactor 0 이 풀 통계를 출력
+extern volatile sig_atomic_t reactor_stats_requested;
+
+int reactor_init(reactor *r, int listen_fd);
+int reactor_watch(reactor *r, endpoint *ep, uint32_t events);
+void reactor_unwatch(reactor *r, endpoint *ep);
+void reactor_run(reactor *r);
+
+// 멀티 reactor 모드의 스레드 진입점: 코어 고정 후 reactor_run
+void *reactor_thread(void *arg);
+
+#endif
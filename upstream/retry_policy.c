@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "retry_policy.h"
+
+#define BUDGET_UNIT 100          // 재시도 하나의 값 (요청마다 percent 만큼 쌓임)
+#define BUDGET_MAX_SECONDS 10    // 쌓아 둘 수 있는 예산: min_per_sec 의 이 초 수만큼 (최소 10 개)
+#define HEDGE_BUCKETS 128
+#define HEDGE_MIN_SAMPLES 100    // 이만큼 모이기 전에는 hedge 하지 않음
+#define HEDGE_UPDATE_EVERY 64    // 이만큼 기록할 때마다 percentile 다시 계산
+#define HEDGE_DECAY_TOTAL 4096   // 표본이 이보다 많으면 모두 반으로 줄여 최근 분포를 따라감
+
+static atomic_long budget_balance;
+static atomic_llong budget_refilled_sec;
+static int budget_percent = 20;
+static int budget_min_per_sec = 10;
+static long budget_max = 10L * BUDGET_UNIT * BUDGET_MAX_SECONDS;
+
+static int hedge_percentile = 95;
+static long long hedge_min_delay_us = 10000;
+
+// 2 의 거듭제곱 구간마다 4 칸인 로그 히스토그램
+typedef struct {
+    uint32_t counts[HEDGE_BUCKETS];
+    uint32_t total;
+    uint32_t since_update;
+    long long delay_us;
+} ttfb_histogram;
+
+static __thread ttfb_histogram histogram = {.delay_us = -1};
+
+static long long monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+void retry_budget_configure(int percent, int min_per_sec) {
+    budget_percent = percent > 0 ? percent : 0;
+    budget_min_per_sec = min_per_sec > 0 ? min_per_sec : 0;
+    long per_sec = budget_min_per_sec > 10 ? budget_min_per_sec : 10;
+    budget_max = per_sec * BUDGET_UNIT * BUDGET_MAX_SECONDS;
+    atomic_store(&budget_balance, (long)budget_min_per_sec * BUDGET_UNIT);
+    atomic_store(&budget_refilled_sec, monotonic_sec());
+}
+
+void retry_budget_deposit(void) {
+    if (budget_percent > 0 && atomic_load_explicit(&budget_balance, memory_order_relaxed) < budget_max) {
+        atomic_fetch_add_explicit(&budget_balance, budget_percent, memory_order_relaxed);
+    }
+}
+
+// 초가 바뀌었으면 먼저 본 스레드가 지난 초 수만큼 최소 예산을 채움
+static void refill(void) {
+    long long now = monotonic_sec();
+    long long last = atomic_load_explicit(&budget_refilled_sec, memory_order_relaxed);
+    if (now <= last || !atomic_compare_exchange_strong(&budget_refilled_sec, &last, now)) {
+        return;
+    }
+    long long seconds = now - last < BUDGET_MAX_SECONDS ? now - last : BUDGET_MAX_SECONDS;
+    long add = (long)(seconds * budget_min_per_sec * BUDGET_UNIT);
+    long balance = atomic_fetch_add_explicit(&budget_balance, add, memory_order_relaxed) + add;
+    if (balance > budget_max) {
+        atomic_fetch_sub_explicit(&budget_balance, balance - budget_max, memory_order_relaxed);
+    }
+}
+
+int retry_budget_withdraw(void) {
+    refill();
+    long balance = atomic_load_explicit(&budget_balance, memory_order_relaxed);
+    while (balance >= BUDGET_UNIT) {
+        if (atomic_compare_exchange_weak_explicit(&budget_balance, &balance, balance - BUDGET_UNIT,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void hedge_configure(int percentile, long min_delay_ms) {
+    hedge_percentile = percentile > 0 && percentile < 100 ? percentile : 95;
+    hedge_min_delay_us = min_delay_ms > 0 ? min_delay_ms * 1000LL : 0;
+}
+
+static int bucket_of(long long us) {
+    if (us < 4) {
+        return us > 0 ? (int)us : 0;
+    }
+    int msb = 63 - __builtin_clzll((unsigned long long)us);
+    int index = 4 * (msb - 1) + (int)((us >> (msb - 2)) & 3);
+    return index < HEDGE_BUCKETS ? index : HEDGE_BUCKETS - 1;
+}
+
+// 칸의 위쪽 경계 (percentile 을 조금 크게 잡아 hedge 를 아낌)
+static long long bucket_limit(int index) {
+    index++;
+    if (index < 4) {
+        return index;
+    }
+    int msb = index / 4 + 1;
+    return (long long)(4 + index % 4) << (msb - 2);
+}
+
+static void update_delay(ttfb_histogram *h) {
+    uint64_t target = ((uint64_t)h->total * hedge_percentile + 99) / 100;
+    uint64_t seen = 0;
+    int i = 0;
+    for (; i < HEDGE_BUCKETS - 1; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+    long long delay = bucket_limit(i);
+    h->delay_us = delay > hedge_min_delay_us ? delay : hedge_min_delay_us;
+
+    if (h->total > HEDGE_DECAY_TOTAL) {
+        h->total = 0;
+        for (int j = 0; j < HEDGE_BUCKETS; j++) {
+            h->counts[j] /= 2;
+            h->total += h->counts[j];
+        }
+    }
+}
+
+void hedge_record(long long ttfb_us) {
+    ttfb_histogram *h = &histogram;
+    h->counts[bucket_of(ttfb_us)]++;
+    h->total++;
+    if (++h->since_update >= HEDGE_UPDATE_EVERY && h->total >= HEDGE_MIN_SAMPLES) {
+        h->since_update = 0;
+        update_delay(h);
+    }
+}
+
+long long hedge_delay_us(void) {
+    return histogram.delay_us;
+}
@@ -0,0 +1,16 @@
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+// 재시도와 hedge 가 백엔드 부하를 키우지 않도록 하는 예산 (모든 reactor 가 공유)
+// 원래 요청 하나마다 percent% 개, 초마다 min_per_sec 개가 쌓이고 재시도(hedge 포함) 하나가 1 개를 씀
+void retry_budget_configure(int percent, int min_per_sec);
+void retry_budget_deposit(void);
+int retry_budget_withdraw(void); // 쓸 수 있으면 1
+
+// 백엔드 응답의 첫 바이트까지 걸린 시간 분포 (reactor 스레드마다 따로)
+// hedge 지연은 그 percentile 값, 최소 min_delay_ms
+void hedge_configure(int percentile, long min_delay_ms);
+void hedge_record(long long ttfb_us);
+long long hedge_delay_us(void); // 표본이 아직 부족하면 -1
+
+#endif
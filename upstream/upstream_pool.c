@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include "upstream_pool.h"
+#include "../connection/connection.h"
+
+static int pool_max_idle = 32;
+static int pool_max_conns = 256;
+static int pool_idle_timeout = 30;
+
+void upstream_pool_configure(int max_idle, int max_conns, int idle_timeout) {
+    pool_max_idle = max_idle;
+    pool_max_conns = max_conns;
+    pool_idle_timeout = idle_timeout;
+}
+
+upstream_pool *upstream_pool_find(reactor *r, httpserver *server) {
+    for (upstream_pool *p = r->pools; p != NULL; p = p->next) {
+        if (p->server == server) {
+            return p;
+        }
+    }
+
+    upstream_pool *p = calloc(1, sizeof(upstream_pool));
+    if (p == NULL) {
+        perror("Failed to allocate upstream pool");
+        return NULL;
+    }
+    p->reactor = r;
+    p->server = server;
+    atomic_fetch_add(&server->refs, 1);
+    p->next = r->pools;
+    r->pools = p;
+    return p;
+}
+
+static int pool_connect(upstream_pool *p, int *in_progress) {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in target_addr;
+    memset(&target_addr, 0, sizeof(target_addr));
+    target_addr.sin_family = AF_INET;
+    target_addr.sin_port = htons(p->server->port);
+    inet_pton(AF_INET, p->server->ip, &target_addr.sin_addr);
+
+    if (connect(sock, (struct sockaddr *)&target_addr, sizeof(target_addr)) == 0) {
+        *in_progress = 0;
+    } else if (errno == EINPROGRESS) {
+        *in_progress = 1;
+    } else {
+        perror("Connection failed");
+        close(sock);
+        return -1;
+    }
+
+    p->open_count++;
+    atomic_fetch_add_explicit(&p->server->pool_misses, 1, memory_order_relaxed);
+    return sock;
+}
+
+// 같은 epoll_wait 배치에 이 연결의 이벤트가 남아있을 수 있어 해제는 배치가 끝난 뒤에
+static void retire(upstream_pool *p, upstream_conn *u) {
+    reactor_unwatch(p->reactor, &u->ep);
+    u->ep.fd = -1;
+    u->next = p->reactor->retired_upstream;
+    p->reactor->retired_upstream = u;
+    p->idle_count--;
+}
+
+// 유휴 연결을 epoll 과 풀에서 떼어내 닫음
+static void evict_idle(upstream_pool *p, upstream_conn *u) {
+    int fd = u->ep.fd;
+    retire(p, u);
+    close(fd);
+    p->open_count--;
+    atomic_fetch_add_explicit(&p->server->pool_evictions, 1, memory_order_relaxed);
+}
+
+static void unlink_idle(upstream_pool *p, upstream_conn *u) {
+    upstream_conn **link = &p->idle;
+    while (*link != NULL && *link != u) {
+        link = &(*link)->next;
+    }
+    if (*link == u) {
+        *link = u->next;
+    }
+}
+
+int upstream_pool_acquire(upstream_pool *p, int allow_reuse, int *reused, int *in_progress) {
+    if (allow_reuse && p->idle != NULL) {
+        upstream_conn *u = p->idle;
+        p->idle = u->next;
+
+        int fd = u->ep.fd;
+        retire(p, u);
+
+        *reused = 1;
+        *in_progress = 0;
+        atomic_fetch_add_explicit(&p->server->pool_hits, 1, memory_order_relaxed);
+        return fd;
+    }
+
+    // 유휴 연결 하나를 닫으면 자리가 나는 경우
+    if (p->open_count >= pool_max_conns && p->idle != NULL) {
+        upstream_conn *u = p->idle;
+        p->idle = u->next;
+        evict_idle(p, u);
+    }
+    if (p->open_count >= pool_max_conns) {
+        return UPSTREAM_POOL_FULL;
+    }
+
+    *reused = 0;
+    return pool_connect(p, in_progress);
+}
+
+// 대기 중인 요청이 있으면 하나 깨워서 방금 생긴 연결/자리를 쓰게 함
+static void wake_waiter(upstream_pool *p) {
+    connection *c = p->wait_head;
+    if (c == NULL) {
+        return;
+    }
+    p->wait_head = c->wait_next;
+    if (p->wait_head == NULL) {
+        p->wait_tail = NULL;
+    }
+    c->wait_next = NULL;
+    connection_resume_upstream(c);
+}
+
+void upstream_pool_release(upstream_pool *p, int fd) {
+    if (p->idle_count >= pool_max_idle || !p->server->is_healthy || p->server->retired) {
+        upstream_pool_discard(p, fd);
+        return;
+    }
+
+    upstream_conn *u = calloc(1, sizeof(upstream_conn));
+    if (u == NULL) {
+        upstream_pool_discard(p, fd);
+        return;
+    }
+    u->ep.fd = fd;
+    u->ep.kind = ENDPOINT_POOLED;
+    u->pool = p;
+    u->idle_since = time(NULL);
+
+    // 쉬는 동안 백엔드가 끊거나 데이터를 보내면 바로 정리
+    if (reactor_watch(p->reactor, &u->ep, EPOLLIN | EPOLLRDHUP) < 0) {
+        free(u);
+        upstream_pool_discard(p, fd);
+        return;
+    }
+
+    u->next = p->idle;
+    p->idle = u;
+    p->idle_count++;
+    wake_waiter(p);
+}
+
+void upstream_pool_discard(upstream_pool *p, int fd) {
+    close(fd);
+    p->open_count--;
+    wake_waiter(p);
+}
+
+void upstream_pool_wait(upstream_pool *p, connection *c) {
+    c->wait_next = NULL;
+    if (p->wait_tail != NULL) {
+        p->wait_tail->wait_next = c;
+    } else {
+        p->wait_head = c;
+    }
+    p->wait_tail = c;
+    atomic_fetch_add_explicit(&p->server->pool_waits, 1, memory_order_relaxed);
+}
+
+void upstream_pool_cancel_wait(upstream_pool *p, connection *c) {
+    connection *prev = NULL;
+    for (connection *it = p->wait_head; it != NULL; prev = it, it = it->wait_next) {
+        if (it != c) {
+            continue;
+        }
+        if (prev != NULL) {
+            prev->wait_next = c->wait_next;
+        } else {
+            p->wait_head = c->wait_next;
+        }
+        if (p->wait_tail == c) {
+            p->wait_tail = prev;
+        }
+        c->wait_next = NULL;
+        return;
+    }
+}
+
+// 유휴 연결에 이벤트가 오면 종료(또는 요청하지 않은 응답)이므로 버림
+void upstream_pool_on_event(upstream_conn *u, uint32_t events) {
+    (void)events;
+    if (u->ep.fd < 0) {
+        return; // 이미 꺼내졌거나 정리됨
+    }
+    upstream_pool *p = u->pool;
+    unlink_idle(p, u);
+    evict_idle(p, u);
+}
+
+void upstream_pool_reap(reactor *r) {
+    while (r->retired_upstream != NULL) {
+        upstream_conn *u = r->retired_upstream;
+        r->retired_upstream = u->next;
+        free(u);
+    }
+}
+
+// 오래 쉰 연결과 비정상 백엔드의 유휴 연결 정리
+// 설정에서 빠진 백엔드의 풀은 유휴 연결을 모두 닫고, 사용 중인 연결과 대기 요청까지 없어지면 해제
+void upstream_pool_sweep(reactor *r, time_t now) {
+    upstream_pool **pool_link = &r->pools;
+    while (*pool_link != NULL) {
+        upstream_pool *p = *pool_link;
+        int retired = atomic_load(&p->server->retired);
+        upstream_conn **link = &p->idle;
+        while (*link != NULL) {
+            upstream_conn *u = *link;
+            if (retired || !p->server->is_healthy || now - u->idle_since >= pool_idle_timeout) {
+                *link = u->next;
+                evict_idle(p, u);
+            } else {
+                link = &u->next;
+            }
+        }
+
+        // 정리한 유휴 연결 항목은 배치가 끝난 뒤 해제되지만 (upstream_pool_reap) 풀을 다시 보지 않음
+        if (retired && p->open_count == 0 && p->wait_head == NULL) {
+            *pool_link = p->next;
+            atomic_fetch_sub(&p->server->refs, 1);
+            free(p);
+        } else {
+            pool_link = &p->next;
+        }
+    }
+}
+
+void upstream_pool_print_stats(void) {
+    int count;
+    httpserver *const *servers = load_balancer_servers(&count, NULL);
+    for (int i = 0; i < count; i++) {
+        httpserver *s = servers[i];
+        printf("Upstream pool %s:%d weight=%d hits=%lu misses=%lu evictions=%lu waits=%lu in_flight=%d breaker=%s\n",
+               s->ip, s->port, atomic_load(&s->weight),
+               atomic_load(&s->pool_hits), atomic_load(&s->pool_misses),
+               atomic_load(&s->pool_evictions), atomic_load(&s->pool_waits),
+               atomic_load(&s->active_connections),
+               load_balancer_breaker_name(s));
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,53 @@
+#ifndef UPSTREAM_POOL_H
+#define UPSTREAM_POOL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include "../load_balancer/load_balancer.h"
+#include "../reactor/reactor.h"
+
+#define UPSTREAM_POOL_FULL (-2) // 최대 연결 수에 도달, 반납을 기다려야 함
+
+struct connection;
+
+// 풀에서 쉬고 있는 백엔드 연결
+typedef struct upstream_conn {
+    endpoint ep; // 첫 멤버: reactor 가 endpoint* 를 그대로 캐스팅
+    struct upstream_pool *pool;
+    time_t idle_since;
+    struct upstream_conn *next;
+} upstream_conn;
+
+// reactor 하나가 백엔드 하나에 대해 가지는 풀. 해당 reactor 스레드만 접근하므로 락이 없음
+// 처음 그 백엔드로 요청을 보낼 때 만들고, 백엔드가 설정에서 빠지면 연결이 모두 닫힌 뒤 해제
+typedef struct upstream_pool {
+    reactor *reactor;
+    httpserver *server;         // health_check 가 is_healthy 를 갱신하는 항목 (풀이 있는 동안 refs 를 쥠)
+    struct upstream_pool *next;
+    upstream_conn *idle;        // 최근 반납 순 (LIFO)
+    int idle_count;
+    int open_count;             // 유휴 + 사용 중
+    struct connection *wait_head;
+    struct connection *wait_tail;
+} upstream_pool;
+
+void upstream_pool_configure(int max_idle, int max_conns, int idle_timeout);
+
+// 이 reactor 의 server 풀 (없으면 만듦)
+upstream_pool *upstream_pool_find(reactor *r, httpserver *server);
+
+// 유휴 연결(allow_reuse 일 때) 또는 새 non-blocking 연결의 fd 반환
+int upstream_pool_acquire(upstream_pool *p, int allow_reuse, int *reused, int *in_progress);
+void upstream_pool_release(upstream_pool *p, int fd);
+void upstream_pool_discard(upstream_pool *p, int fd);
+
+void upstream_pool_wait(upstream_pool *p, struct connection *c);
+void upstream_pool_cancel_wait(upstream_pool *p, struct connection *c);
+
+void upstream_pool_on_event(upstream_conn *u, uint32_t events);
+void upstream_pool_reap(reactor *r);
+void upstream_pool_sweep(reactor *r, time_t now);
+void upstream_pool_print_stats(void);
+
+#endif